@@ -0,0 +1,282 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/vector.h>
+#include <vap/detail/thread_pool.h>
+#include <vap/expressions/cost.h>
+#include <vap/simd/evaluate.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace vap	   {
+namespace adaptive {
+
+// How an evaluation is carried out
+enum class strategy { scalar, simd, parallel };
+
+// Measured costs from which the strategy is chosen. The time of a serial evaluation is
+// modelled as n * (bytes * ns_per_byte + ops * ns_per_op) from the cost of the
+// expression (expressions/cost.h), a transcendental call counting transcendental_ops.
+struct thresholds
+{
+	static constexpr double transcendental_ops = 20;
+
+	std::size_t threads;  // concurrency of the thread pool when calibrated
+	double		fork_ns;  // cost of handing a job to the thread pool and waiting for it
+	double		ns_per_byte;
+	double		ns_per_op;
+	std::size_t simd_min; // smallest size for which packets beat the element-wise loop
+
+	// Estimated time of evaluating one element serially with packets
+	double element_ns(const expressions::cost& c) const
+	{
+		return c.bytes * ns_per_byte + (c.flops + transcendental_ops * c.transcendentals) * ns_per_op;
+	}
+};
+
+namespace detail {
+
+using V = vap::vector<double, constructors::SIMD>;
+
+// Data kept in the caches: what matters is the cost of small evaluations, since large
+// ones go parallel whatever the exact cost of an element
+static const std::size_t calibration_size = 4096;
+static const std::size_t runs			  = 64;
+
+template <class Function>
+double median_ns(Function&& f)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::vector<double> samples(runs);
+	for (double& t : samples)
+	{
+		const auto start = clock::now();
+		f();
+		t = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+	}
+
+	std::nth_element(samples.begin(), samples.begin() + runs / 2, samples.end());
+	return samples[runs / 2];
+}
+
+template <class C, class E>
+double element_ns(C& c, const E& e)
+{
+	const std::size_t n = e.size();
+	return median_ns([&] { vap::simd::evaluate(c, e, 0, n); }) / n;
+}
+
+// Smallest power of two up to 64 for which packet evaluation is not slower than the
+// element-wise loop
+template <class C, class E>
+std::size_t simd_min(C& c, const E& e)
+{
+	std::size_t n = 1;
+	for (; n < 64; n *= 2)
+	{
+		const double scalar = median_ns([&] { vap::simd::detail::evaluate_scalar(c, e, 0, n); });
+		const double packet = median_ns([&] { vap::simd::evaluate(c, e, 0, n); });
+
+		if (packet <= scalar) break;
+	}
+
+	return n;
+}
+
+} // end namespace detail
+
+// Runs the micro-benchmarks: a product of two vectors and a cosine, which differ in
+// their ratio of bytes to operations, and an empty job on the thread pool
+inline thresholds calibrate()
+{
+	using namespace vap::operators;
+	using detail::V;
+
+	V x(detail::calibration_size), y(detail::calibration_size), r(detail::calibration_size);
+
+	std::vector<double>& xs = x;
+	std::vector<double>& ys = y;
+	for (std::size_t i = 0; i < xs.size(); ++i)
+	{
+		xs[i] = 1 + 1e-3 * i;
+		ys[i] = 2 - 1e-3 * i;
+	}
+
+	std::vector<double>& c = r;
+
+	const auto product = vap::rewrite(x * y);
+	const auto cosine  = vap::rewrite(vap::operators::cos(x));
+
+	const expressions::cost cp = vap::cost_of(product);
+	const expressions::cost cc = vap::cost_of(cosine);
+
+	const double tp = detail::element_ns(c, product);
+	const double tc = detail::element_ns(c, cosine);
+
+	// tp = bytes_p * a + ops_p * b and tc = bytes_c * a + ops_c * b
+	const double op = cp.flops + thresholds::transcendental_ops * cp.transcendentals;
+	const double oc = cc.flops + thresholds::transcendental_ops * cc.transcendentals;
+	const double determinant = double(cp.bytes) * oc - double(cc.bytes) * op;
+
+	thresholds t;
+	t.threads	  = vap::detail::thread_pool::instance().concurrency();
+	t.ns_per_byte = std::max(0.0, (tp * oc - tc * op) / determinant);
+	t.ns_per_op	  = std::max(0.0, (tc * cp.bytes - tp * cc.bytes) / determinant);
+	t.simd_min	  = detail::simd_min(c, product);
+
+	std::vector<char> touched(t.threads);
+	t.fork_ns = detail::median_ns([&] {
+		vap::detail::parallel_for(0, t.threads, 1, [&](const std::size_t first, const std::size_t last) {
+			for (std::size_t k = first; k < last; ++k)
+				touched[k] = 1;
+		});
+	});
+
+	return t;
+}
+
+// Calibrations are saved as name value lines
+inline bool save(const std::string& path, const thresholds& t)
+{
+	std::ofstream out(path);
+	out.precision(17);
+	out << "threads "	  << t.threads	   << '\n'
+		<< "fork_ns "	  << t.fork_ns	   << '\n'
+		<< "ns_per_byte " << t.ns_per_byte << '\n'
+		<< "ns_per_op "	  << t.ns_per_op   << '\n'
+		<< "simd_min "	  << t.simd_min	   << '\n';
+
+	return bool(out);
+}
+
+// Fails if the file is missing or incomplete, or was calibrated for another number of threads
+inline bool load(const std::string& path, thresholds& t)
+{
+	std::ifstream in(path);
+	if (!in) return false;
+
+	thresholds loaded = {};
+	unsigned   found  = 0;
+
+	std::string name;
+	while (in >> name)
+	{
+		if		(name == "threads")		{ in >> loaded.threads;		found |= 1; }
+		else if (name == "fork_ns")		{ in >> loaded.fork_ns;		found |= 2; }
+		else if (name == "ns_per_byte") { in >> loaded.ns_per_byte; found |= 4; }
+		else if (name == "ns_per_op")	{ in >> loaded.ns_per_op;	found |= 8; }
+		else if (name == "simd_min")	{ in >> loaded.simd_min;	found |= 16; }
+		else							{ in >> name; }
+	}
+
+	if (found != 31 || loaded.threads != vap::detail::thread_pool::instance().concurrency()) return false;
+
+	t = loaded;
+	return true;
+}
+
+namespace detail {
+
+// Calibrates on first use. When VAP_CALIBRATION names a file, the thresholds are read
+// from it, or calibrated and written to it if it cannot be used.
+inline thresholds initial()
+{
+	thresholds t;
+
+	const char* path = std::getenv("VAP_CALIBRATION");
+	if (path && load(path, t)) return t;
+
+	t = calibrate();
+	if (path) save(path, t);
+
+	return t;
+}
+
+inline thresholds& current()
+{
+	static thresholds t = initial();
+	return t;
+}
+
+} // end namespace detail
+
+// The thresholds in use
+inline const thresholds& current() { return detail::current(); }
+
+// Replaces the thresholds in use, e.g. with calibrate() or load(); not to be called
+// while an evaluation is running
+inline void set(const thresholds& t) { detail::current() = t; }
+
+// Strategy for n elements of an expression of cost c: packets once n reaches simd_min,
+// and the thread pool once the estimated serial time outweighs the cost of the fork
+inline strategy choose(const std::size_t n, const expressions::cost& c, const thresholds& t = current())
+{
+	if (n < t.simd_min) return strategy::scalar;
+
+	const double threads = double(t.threads);
+	if (threads > 1 && n * t.element_ns(c) > t.fork_ns * threads / (threads - 1))
+		return strategy::parallel;
+
+	return strategy::simd;
+}
+
+} // end namespace adaptive
+
+namespace constructors {
+
+// Adaptive ctor: chooses at run time, from the size and the cost of the expression,
+// between the element-wise loop, packets on the calling thread and packets on the
+// thread pool (see adaptive::choose). Meant for code that mixes tiny and huge vectors.
+class Adaptive
+{
+protected:
+	template <class C, class E>
+	void ctor(C& c, const E& e)
+	{
+		const std::size_t			 n = e.size();
+		const adaptive::thresholds&	 t = adaptive::current();
+		// From the type alone, so a repeated vector counts as another load (see static_cost)
+		const expressions::cost		 k = expressions::static_cost<E>();
+
+		switch (adaptive::choose(n, k, t))
+		{
+		case adaptive::strategy::scalar:
+			vap::simd::detail::evaluate_scalar(c, e, 0, n);
+			return;
+
+		case adaptive::strategy::simd:
+			vap::simd::evaluate(c, e, 0, n);
+			return;
+
+		case adaptive::strategy::parallel:
+		{
+			// Chunks long enough to be worth a fork
+			const double	  ns	= t.element_ns(k);
+			const std::size_t grain = ns > 0 ? static_cast<std::size_t>(std::ceil(t.fork_ns / ns)) : n;
+
+			vap::detail::parallel_for(0, n, std::max<std::size_t>(grain, 1024), [&c, &e](const std::size_t first, const std::size_t last)
+			{
+				vap::simd::evaluate(c, e, first, last);
+			});
+			return;
+		}
+		}
+	}
+
+	template <class C, class E>
+	void assignment(C &c, const E& e)
+	{
+		ctor(c, e);
+	}
+};
+
+} // end namespace constructors
+} // end namespace vap
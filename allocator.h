@@ -0,0 +1,554 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/first_touch.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#	include <malloc.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#	include <fstream>
+#	include <string>
+#	include <linux/mempolicy.h>
+#	include <sys/syscall.h>
+#endif
+
+namespace vap	 {
+namespace memory {
+
+// Page sizes an allocator can request from the operating system. Huge pages only apply
+// to allocations of at least one huge page (2 MiB); smaller ones use normal pages.
+namespace pages {
+
+// Normal pages
+struct normal {};
+
+// Transparent huge pages: the allocation is aligned on a huge page and the kernel is
+// asked to back it with huge pages (madvise on Linux, normal pages elsewhere)
+struct transparent {};
+
+// Huge pages reserved by the administrator (MAP_HUGETLB on Linux, MEM_LARGE_PAGES on
+// Windows), or transparent huge pages when none are available
+struct huge {};
+
+} // end namespace pages
+
+// Where the pages of a numa_allocator are placed on machines with several NUMA nodes
+namespace placement {
+
+// On the node of the thread that touches them first. The elements are not initialized by
+// the allocator, so a vap::vector touches them from the threads that evaluate them.
+struct first_touch {};
+
+// Spread page by page over every node
+struct interleave {};
+
+// On the given node
+template <int Node>
+struct bind {};
+
+} // end namespace placement
+
+namespace detail {
+
+// Alignment of every allocation, the size of a cache line and of an AVX-512 register
+static const std::size_t alignment = 64;
+
+static const std::size_t huge_page = 2 * 1024 * 1024;
+
+// Allocations up to this size are not pooled
+static const std::size_t pool_threshold = 64 * 1024;
+
+enum class kind : unsigned char { normal, transparent, huge };
+
+template <class Pages>
+struct kind_of;
+
+template <> struct kind_of <pages::normal>		: std::integral_constant<kind, kind::normal> {};
+template <> struct kind_of <pages::transparent> : std::integral_constant<kind, kind::transparent> {};
+template <> struct kind_of <pages::huge>		: std::integral_constant<kind, kind::huge> {};
+
+// How a block was obtained from the operating system
+enum class origin : unsigned char { heap, huge_heap, mapped };
+
+// Stored in front of every block; the elements start alignment bytes later
+struct header
+{
+	std::size_t bytes;
+	kind		pages;
+	origin		from;
+};
+
+static_assert(sizeof(header) <= alignment, "vap::memory: header does not fit in front of the elements");
+
+inline std::size_t round_up(const std::size_t n, const std::size_t multiple)
+{
+	return (n + multiple - 1) / multiple * multiple;
+}
+
+// Pooled sizes are rounded up to classes a quarter of a power of two apart, so that a
+// block is at most 25% larger than requested
+inline std::size_t size_class(const std::size_t bytes)
+{
+	if (bytes <= pool_threshold) return round_up(bytes, alignment);
+
+	std::size_t power = pool_threshold;
+	while (power * 2 < bytes)
+		power *= 2;
+
+	return round_up(bytes, power / 4);
+}
+
+inline void* aligned_allocate(const std::size_t bytes, const std::size_t align)
+{
+#if defined(_WIN32)
+	return _aligned_malloc(bytes, align);
+#else
+	void* p = nullptr;
+	return posix_memalign(&p, align, bytes) == 0 ? p : nullptr;
+#endif
+}
+
+inline void aligned_free(void* p)
+{
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+// Maps bytes rounded up to whole huge pages
+inline void* map_huge(const std::size_t bytes)
+{
+#if defined(_WIN32)
+	const SIZE_T large = GetLargePageMinimum();
+	if (large == 0) return nullptr;
+
+	return VirtualAlloc(nullptr, round_up(bytes, large), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#elif defined(MAP_HUGETLB)
+	void* p = mmap(nullptr, round_up(bytes, huge_page), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	return p == MAP_FAILED ? nullptr : p;
+#else
+	(void) bytes;
+	return nullptr;
+#endif
+}
+
+inline void unmap_huge(void* p, const std::size_t bytes)
+{
+#if defined(_WIN32)
+	(void) bytes;
+	VirtualFree(p, 0, MEM_RELEASE);
+#elif defined(MAP_HUGETLB)
+	munmap(p, round_up(bytes, huge_page));
+#else
+	(void) p;
+	(void) bytes;
+#endif
+}
+
+// Allocates a block of bytes (header included) from the operating system, aligned on
+// align bytes
+inline header* system_allocate(const std::size_t bytes, const kind pages, const std::size_t align = alignment)
+{
+	void* p = nullptr;
+	origin from = origin::heap;
+
+	if (pages == kind::huge && bytes >= huge_page)
+	{
+		p	 = map_huge(bytes);
+		from = origin::mapped;
+	}
+
+	if (!p && pages != kind::normal && bytes >= huge_page)
+	{
+		p	 = aligned_allocate(bytes, std::max(align, huge_page));
+		from = origin::huge_heap;
+
+#		if defined(MADV_HUGEPAGE)
+		if (p) madvise(p, bytes, MADV_HUGEPAGE);
+#		endif
+	}
+
+	if (!p)
+	{
+		p	 = aligned_allocate(bytes, align);
+		from = origin::heap;
+	}
+
+	if (!p) throw std::bad_alloc();
+
+	return ::new (p) header{ bytes, pages, from };
+}
+
+inline void system_free(header* h)
+{
+	if (h->from == origin::mapped) unmap_huge(h, h->bytes);
+	else						   aligned_free(h);
+}
+
+inline std::size_t environment_limit()
+{
+	// VAP_POOL_LIMIT is given in MiB
+	if (const char* env = std::getenv("VAP_POOL_LIMIT"))
+	{
+		const long n = std::atol(env);
+		if (n >= 0) return static_cast<std::size_t>(n) * 1024 * 1024;
+	}
+
+	return std::size_t(256) * 1024 * 1024;
+}
+
+// Blocks of recently freed buffers, by size class and page kind. A freed block is kept
+// for reuse unless the pool would then hold more than limit bytes, in which case it is
+// returned to the operating system.
+class pool
+{
+private:
+	using key = std::pair<std::size_t, kind>;
+
+	std::mutex						   mutex;
+	std::map<key, std::vector<header*>> blocks;
+	std::size_t						   cached;
+	std::size_t						   limit;
+
+	void clear()
+	{
+		for (auto& list : blocks)
+			for (header* h : list.second)
+				system_free(h);
+
+		blocks.clear();
+		cached = 0;
+	}
+
+public:
+	pool() : cached(0), limit(environment_limit()) {}
+
+	// The pool is never destroyed, so that vectors with static storage duration can be
+	// freed at exit in any order
+	static pool& instance()
+	{
+		static pool* p = new pool;
+		return *p;
+	}
+
+	header* allocate(const std::size_t bytes, const kind pages)
+	{
+		const std::size_t size = size_class(bytes);
+
+		if (size > pool_threshold)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			auto list = blocks.find(key(size, pages));
+			if (list != blocks.end() && !list->second.empty())
+			{
+				header* h = list->second.back();
+				list->second.pop_back();
+
+				cached -= size;
+				return h;
+			}
+		}
+
+		return system_allocate(size, pages);
+	}
+
+	void deallocate(header* h)
+	{
+		if (h->bytes > pool_threshold)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (cached + h->bytes <= limit)
+			{
+				blocks[key(h->bytes, h->pages)].push_back(h);
+				cached += h->bytes;
+				return;
+			}
+		}
+
+		system_free(h);
+	}
+
+	// Returns every cached block to the operating system
+	void release()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		clear();
+	}
+
+	void set_limit(const std::size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		limit = bytes;
+		if (cached > limit) clear();
+	}
+
+	std::size_t cached_bytes()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return cached;
+	}
+};
+
+inline std::size_t page_size()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	const long n = sysconf(_SC_PAGESIZE);
+	return n > 0 ? static_cast<std::size_t>(n) : 4096;
+#endif
+}
+
+// Nodes of the machine, as a bit mask read from /sys/devices/system/node/online
+// ("0-1,3"); node 0 alone where it cannot be read
+inline unsigned long online_nodes()
+{
+	unsigned long mask = 0;
+
+#if defined(__linux__)
+	std::ifstream in("/sys/devices/system/node/online");
+	std::string list;
+
+	if (in >> list)
+	{
+		std::size_t first = 0, value = 0;
+		bool		range = false;
+
+		list += ',';
+		for (const char c : list)
+		{
+			if (c >= '0' && c <= '9')
+				value = 10 * value + (c - '0');
+			else if (c == '-')
+			{
+				first = value;
+				value = 0;
+				range = true;
+			}
+			else
+			{
+				for (std::size_t node = range ? first : value; node <= value && node < 8 * sizeof(mask); ++node)
+					mask |= 1ul << node;
+
+				value = 0;
+				range = false;
+			}
+		}
+	}
+#endif
+
+	return mask ? mask : 1;
+}
+
+inline void place(void* p, const std::size_t bytes, const int policy, const unsigned long nodes)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	syscall(SYS_mbind, p, bytes, policy, &nodes, 8 * sizeof(nodes), 0);
+#else
+	(void) p;
+	(void) bytes;
+	(void) policy;
+	(void) nodes;
+#endif
+}
+
+template <class Placement>
+struct placer
+{
+	static void apply(void*, const std::size_t) {}
+};
+
+template <>
+struct placer <placement::interleave>
+{
+#if defined(__linux__)
+	static void apply(void* p, const std::size_t bytes) { place(p, bytes, MPOL_INTERLEAVE, online_nodes()); }
+#else
+	static void apply(void*, const std::size_t) {}
+#endif
+};
+
+template <int Node>
+struct placer <placement::bind<Node>>
+{
+	static_assert(Node >= 0 && Node < 8 * sizeof(unsigned long), "placement::bind: Invalid node");
+
+#if defined(__linux__)
+	static void apply(void* p, const std::size_t bytes) { place(p, bytes, MPOL_BIND, 1ul << Node); }
+#else
+	static void apply(void*, const std::size_t) {}
+#endif
+};
+
+} // end namespace detail
+
+// Allocator for the Container of a vap::vector: the elements are aligned on 64 bytes,
+// large buffers can be backed by huge pages, and the buffers of freed containers are
+// pooled so that a container of a similar size allocated next reuses them without
+// going through the operating system (and without page faults).
+//
+//	using V = vap::vector<double, vap::constructors::SIMD, vap::memory::container<double>>;
+//
+template <typename T, class Pages = pages::normal>
+class allocator
+{
+public:
+	using value_type = T;
+	using pages_type = Pages;
+
+	template <typename U>
+	struct rebind { using other = allocator<U, Pages>; };
+
+	allocator() noexcept {}
+
+	template <typename U>
+	allocator(const allocator<U, Pages>&) noexcept {}
+
+	T* allocate(const std::size_t n)
+	{
+		if (n == 0) return nullptr;
+		if (n > (std::numeric_limits<std::size_t>::max() - detail::alignment) / sizeof(T)) throw std::bad_alloc();
+
+		detail::header* h = detail::pool::instance().allocate(n * sizeof(T) + detail::alignment, detail::kind_of<Pages>::value);
+		return reinterpret_cast<T*>(reinterpret_cast<char*>(h) + detail::alignment);
+	}
+
+	void deallocate(T* p, const std::size_t)
+	{
+		if (!p) return;
+		detail::pool::instance().deallocate(reinterpret_cast<detail::header*>(reinterpret_cast<char*>(p) - detail::alignment));
+	}
+
+	template <typename U>
+	bool operator == (const allocator<U, Pages>&) const noexcept { return true; }
+
+	template <typename U>
+	bool operator != (const allocator<U, Pages>&) const noexcept { return false; }
+};
+
+// std::vector with the allocator above, for the Container parameter of vap::vector
+template <typename T, class Pages = pages::normal>
+using container = std::vector<T, allocator<T, Pages>>;
+
+// Allocator for NUMA machines. Blocks are aligned on pages and placed with Placement;
+// they are not pooled, since a reused block keeps the placement of its previous owner.
+// Elements are default-initialized, which leaves the pages of a new block untouched:
+// vap::vector fills them in parallel, in the chunks its parallel evaluations use (see
+// detail/first_touch.h), so that each chunk lives on the node of the thread evaluating it.
+//
+//	using V = vap::vector<double, vap::constructors::Parallel, vap::memory::numa_container<double>>;
+//
+template <typename T, class Placement = placement::first_touch, class Pages = pages::normal>
+class numa_allocator
+{
+public:
+	using value_type	 = T;
+	using placement_type = Placement;
+	using pages_type	 = Pages;
+
+	template <typename U>
+	struct rebind { using other = numa_allocator<U, Placement, Pages>; };
+
+	numa_allocator() noexcept {}
+
+	template <typename U>
+	numa_allocator(const numa_allocator<U, Placement, Pages>&) noexcept {}
+
+	T* allocate(const std::size_t n)
+	{
+		if (n == 0) return nullptr;
+
+		const std::size_t page = detail::page_size();
+		if (n > (std::numeric_limits<std::size_t>::max() - 2 * page) / sizeof(T)) throw std::bad_alloc();
+
+		const std::size_t bytes = detail::round_up(n * sizeof(T) + detail::alignment, page);
+		detail::header*	  h		= detail::system_allocate(bytes, detail::kind_of<Pages>::value, page);
+
+		detail::placer<Placement>::apply(h, bytes);
+		return reinterpret_cast<T*>(reinterpret_cast<char*>(h) + detail::alignment);
+	}
+
+	void deallocate(T* p, const std::size_t)
+	{
+		if (!p) return;
+		detail::system_free(reinterpret_cast<detail::header*>(reinterpret_cast<char*>(p) - detail::alignment));
+	}
+
+	// Default-initialization: no zeroing, so no page is touched
+	template <typename U>
+	void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) { ::new (static_cast<void*>(p)) U; }
+
+	template <typename U, typename... Args>
+	void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+	template <typename U>
+	bool operator == (const numa_allocator<U, Placement, Pages>&) const noexcept { return true; }
+
+	template <typename U>
+	bool operator != (const numa_allocator<U, Placement, Pages>&) const noexcept { return false; }
+};
+
+// std::vector with numa_allocator
+template <typename T, class Placement = placement::first_touch, class Pages = pages::normal>
+using numa_container = std::vector<T, numa_allocator<T, Placement, Pages>>;
+
+} // end namespace memory
+
+namespace detail {
+
+template <typename T, class Placement, class Pages>
+struct first_touch <std::vector<T, memory::numa_allocator<T, Placement, Pages>>> : std::true_type {};
+
+} // end namespace detail
+
+namespace memory {
+
+// Number of NUMA nodes of the machine
+inline std::size_t numa_nodes()
+{
+	std::size_t count = 0;
+	for (unsigned long mask = detail::online_nodes(); mask; mask >>= 1)
+		count += mask & 1;
+
+	return count;
+}
+
+// Bytes held by the pool for reuse
+inline std::size_t cached_bytes() { return detail::pool::instance().cached_bytes(); }
+
+// Returns the buffers held by the pool to the operating system
+inline void release() { detail::pool::instance().release(); }
+
+// Largest number of bytes the pool holds for reuse, 256 MiB by default or VAP_POOL_LIMIT
+// MiB from the environment. 0 disables pooling.
+inline void set_pool_limit(const std::size_t bytes) { detail::pool::instance().set_limit(bytes); }
+
+} // end namespace memory
+} // end namespace vap
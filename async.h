@@ -0,0 +1,210 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/thread_pool.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#	if __has_include(<coroutine>)
+#		include <coroutine>
+#		define VAP_COROUTINES
+#	endif
+#endif
+
+namespace vap	{
+namespace async {
+namespace detail {
+
+// Result of one evaluation, shared by the task computing it and the future reading it
+template <class V>
+class state
+{
+private:
+	std::mutex				mutex;
+	std::condition_variable changed;
+	bool					done;
+	std::unique_ptr<V>		value;
+	std::exception_ptr		error;
+	std::function<void()>	continuation;
+
+	void finish()
+	{
+		std::function<void()> next;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+			next.swap(continuation);
+		}
+		changed.notify_all();
+
+		if (next) next();
+	}
+
+public:
+	state() : done(false) {}
+
+	void set_value(V&& v)
+	{
+		value.reset(new V(std::move(v)));
+		finish();
+	}
+
+	void set_error(std::exception_ptr e)
+	{
+		error = e;
+		finish();
+	}
+
+	bool ready()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return done;
+	}
+
+	// Helps the thread pool while the evaluation is queued or split into chunks, and
+	// sleeps once there is nothing left to steal
+	void wait()
+	{
+		vap::detail::thread_pool& pool = vap::detail::thread_pool::instance();
+
+		while (!ready())
+		{
+			if (pool.help()) continue;
+
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait_for(lock, std::chrono::milliseconds(1), [this] { return done; });
+		}
+	}
+
+	V take()
+	{
+		wait();
+
+		if (error) std::rethrow_exception(error);
+		return std::move(*value);
+	}
+
+	// Calls f on the thread that completes the evaluation; returns false, without
+	// keeping f, if it has already completed
+	bool then(std::function<void()> f)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (done) return false;
+
+		continuation = std::move(f);
+		return true;
+	}
+};
+
+// Operands are passed to make as const references, whichever way they are held
+template <class T>
+const T& unwrap(const T& x) { return x; }
+
+template <class T>
+const T& unwrap(const std::shared_ptr<T>& p) { return *p; }
+
+template <class T>
+const T& unwrap(const std::reference_wrapper<T>& r) { return r.get(); }
+
+template <class V, class Make, class Operands, std::size_t... K>
+V build(Make& make, const Operands& operands, std::index_sequence<K...>)
+{
+	return V(make(unwrap(std::get<K>(operands))...));
+}
+
+} // end namespace detail
+
+// Result of an asynchronous evaluation. Like std::future, get() may be called once;
+// in a C++20 coroutine, co_await gives the vector without blocking the thread.
+template <class V>
+class future
+{
+private:
+	std::shared_ptr<detail::state<V>> result;
+
+public:
+	future() {}
+	explicit future(std::shared_ptr<detail::state<V>> s) : result(std::move(s)) {}
+
+	bool valid() const { return bool(result); }
+
+	bool ready() const { return result->ready(); }
+
+	void wait() const { result->wait(); }
+
+	// Waits for the vector, or rethrows the exception thrown while evaluating it
+	V get()
+	{
+		if (!result) throw std::logic_error("vap::async::future::get: no state");
+
+		std::shared_ptr<detail::state<V>> s = std::move(result);
+		return s->take();
+	}
+
+#	if defined(VAP_COROUTINES)
+	bool await_ready() const { return result->ready(); }
+
+	// The coroutine resumes on the worker that completes the evaluation
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		return result->then([h] { h.resume(); });
+	}
+
+	V await_resume() { return get(); }
+#	endif
+};
+
+// Evaluates make(operands...) into a vector of type V on the thread pool and returns
+// at once. Evaluations started one after the other run concurrently, and each one is
+// still evaluated with the constructor policy of V:
+//
+//	auto a = vap::async::evaluate<V>([](const V& x, const V& y) { return x * y + 1.0; }, std::move(x), y);
+//	auto b = vap::async::evaluate<V>([](const V& z) { return sin(z); }, std::cref(z));
+//	...
+//	V r = a.get(), s = b.get();
+//
+// An expression references the vectors at its leaves, so it is built by make inside the
+// task, on operands owned by the task: they are moved or copied into it, or shared
+// through a std::shared_ptr<const V>. std::cref(v) passes v by reference instead, and
+// v must then outlive the evaluation and not change until it completes.
+template <class V, class Make, class... Operands>
+future<V> evaluate(Make make, Operands&&... operands)
+{
+	using operands_t = std::tuple<std::decay_t<Operands>...>;
+
+	auto result = std::make_shared<detail::state<V>>();
+	auto held	= std::make_shared<operands_t>(std::forward<Operands>(operands)...);
+
+	vap::detail::thread_pool::instance().submit([result, held, make]() mutable
+	{
+		try
+		{
+			V value = detail::build<V>(make, *held, std::index_sequence_for<Operands...>());
+
+			// The operands are released before the result is published, so that a vector
+			// shared with the caller is not freed by a worker after get() has returned
+			held.reset();
+			result->set_value(std::move(value));
+		}
+		catch (...)
+		{
+			held.reset();
+			result->set_error(std::current_exception());
+		}
+	});
+
+	return future<V>(std::move(result));
+}
+
+} // end namespace async
+} // end namespace vap
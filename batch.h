@@ -0,0 +1,661 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/thread_pool.h>
+#include <vap/detail/traits.h>
+#include <vap/execution_policy.h>
+#include <vap/expressions/cost.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/rewrite.h>
+#include <vap/expressions/shared.h>
+#include <vap/simd/evaluate.h>
+#include <vap/tiled.h>
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vap	{
+namespace batch {
+
+template <typename T, class Exec = serial_execution>
+class local;
+
+namespace detail {
+
+// An intermediate declared in a graph: its index among the intermediates of the graph
+// and its number of elements
+struct slot
+{
+	std::size_t index;
+	std::size_t size;
+};
+
+// Where the elements of an intermediate live while a pass runs on this thread: element i
+// is data[i - first]. Either a buffer of one tile, or the whole intermediate when it is
+// used by several passes.
+struct window
+{
+	void*		data;
+	std::size_t first;
+};
+
+// Windows of the intermediates, set by the pass running on this thread
+inline std::vector<window>*& current()
+{
+	static thread_local std::vector<window>* windows = nullptr;
+	return windows;
+}
+
+// Sets the windows of this thread for the life of a chunk of a pass
+class frame
+{
+private:
+	std::vector<window>* previous;
+
+public:
+	explicit frame(std::vector<window>& windows) : previous(current()) { current() = &windows; }
+	~frame() { current() = previous; }
+
+	frame(const frame&) = delete;
+	frame& operator = (const frame&) = delete;
+};
+
+template <typename T>
+T* address(const slot& s, const std::size_t i)
+{
+	assert(current() && "batch::local: only readable by the statements of a graph");
+
+	const window& w = (*current())[s.index];
+	return static_cast<T*>(w.data) + (i - w.first);
+}
+
+// Destination of a statement assigning an intermediate
+template <typename T>
+struct span
+{
+	using value_type = T;
+
+	const slot* s;
+
+	T& operator [] (const std::size_t i) const { return *address<T>(*s, i); }
+};
+
+// What a statement reads: the storage of its vectors and intermediates, and whether it
+// has leaves of an unknown type, which may read any destination at any index
+struct reads
+{
+	std::vector<const void*> storage;
+	bool					 opaque = false;
+};
+
+template <class E>
+struct reader
+{
+	static void apply(const E&, reads& r) { r.opaque = true; }
+};
+
+template <class E>
+void read(const E& e, reads& r)
+{
+	reader<typename E::Derived>::apply(e, r);
+}
+
+template <typename T>
+struct reader <expressions::Scalar<T>>
+{
+	static void apply(const expressions::Scalar<T>&, reads&) {}
+};
+
+// Constants are read as the Scalar they derive from; named for readers reached directly
+template <typename T, long Num, long Den>
+struct reader <expressions::Constant<T, Num, Den>>
+{
+	static void apply(const expressions::Constant<T, Num, Den>&, reads&) {}
+};
+
+template <typename T, class Ctor, typename C, class Exec>
+struct reader <expressions::vector<T, Ctor, C, Exec>>
+{
+	static void apply(const expressions::vector<T, Ctor, C, Exec>& v, reads& r)
+	{ r.storage.push_back(&static_cast<const C&>(v)); }
+};
+
+template <typename T, class Exec>
+struct reader <local<T, Exec>>
+{
+	static void apply(const local<T, Exec>& l, reads& r) { r.storage.push_back(l.storage()); }
+};
+
+template <class V>
+struct is_local : std::false_type {};
+
+template <typename T, class Exec>
+struct is_local <local<T, Exec>> : std::true_type {};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct reader <expressions::Binary<L, R, Op, Exec, IsOp>>
+{
+	static void apply(const expressions::Binary<L, R, Op, Exec, IsOp>& e, reads& r)
+	{
+		read(e.lhs(), r);
+		read(e.rhs(), r);
+	}
+};
+
+template <typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct reader <expressions::Ternary<A, B, C, Op, Exec, IsOp>>
+{
+	static void apply(const expressions::Ternary<A, B, C, Op, Exec, IsOp>& e, reads& r)
+	{
+		read(e.first(), r);
+		read(e.second(), r);
+		read(e.third(), r);
+	}
+};
+
+template <typename U, class Op, class Exec, bool IsOp>
+struct reader <expressions::Unary<U, Op, Exec, IsOp>>
+{
+	static void apply(const expressions::Unary<U, Op, Exec, IsOp>& e, reads& r) { read(e.operand(), r); }
+};
+
+template <typename U>
+struct reader <expressions::Shared<U>>
+{
+	static void apply(const expressions::Shared<U>& e, reads& r) { read(e.operand(), r); }
+};
+
+// A recorded assignment, with the expression types erased
+class node
+{
+public:
+	const void* destination;	// storage written
+	const slot* target;			// the intermediate written, if any
+	std::size_t size;
+	std::size_t footprint;		// bytes per element, see tiled::tile_size
+	bool		parallel;
+	reads		sources;
+
+	virtual ~node() {}
+
+	// Rewrites the expression, so that its shared sub-expressions get new ids on every
+	// run, and resizes a destination vector smaller than it, as operator = does
+	virtual void prepare() = 0;
+
+	// Evaluates [first, last) in place
+	virtual void evaluate(const std::size_t first, const std::size_t last) const = 0;
+
+	// Evaluates the whole statement on its own, through a temporary if needed
+	virtual void assign() const = 0;
+};
+
+template <class V, class E>
+class vector_node : public node
+{
+private:
+	V&																	v;
+	vap::detail::operand_t<E>											expression;
+	boost::optional<vap::detail::operand_t<expressions::rewrite_t<E>>>	rewritten;
+
+	vap::detail::container_t<V>& container() const { return static_cast<vap::detail::container_t<V>&>(v); }
+
+public:
+	vector_node(V& destination, const E& e) : v(destination), expression(e) {}
+
+	void prepare() override
+	{
+		rewritten.emplace(vap::rewrite(expression));
+		if (v.size() < size) v.resize(size);
+	}
+
+	void evaluate(const std::size_t first, const std::size_t last) const override
+	{ vap::simd::evaluate(container(), *rewritten, first, last); }
+
+	void assign() const override { v = expression; }
+};
+
+template <typename T, class E>
+class local_node : public node
+{
+private:
+	vap::detail::operand_t<E>											expression;
+	boost::optional<vap::detail::operand_t<expressions::rewrite_t<E>>>	rewritten;
+
+public:
+	local_node(const E& e) : expression(e) {}
+
+	void prepare() override { rewritten.emplace(vap::rewrite(expression)); }
+
+	void evaluate(const std::size_t first, const std::size_t last) const override
+	{
+		span<T> s{ target };
+		vap::simd::evaluate(s, *rewritten, first, last);
+	}
+
+	// Statements that assign an intermediate on their own write all of it
+	void assign() const override { evaluate(0, size); }
+};
+
+// Statements evaluated together, tile by tile, in the order of the graph
+struct pass
+{
+	std::vector<const node*> statements;
+	std::size_t				 size;
+	bool					 alone;		// a statement evaluated on its own
+	bool					 parallel;
+};
+
+} // end namespace detail
+
+// An intermediate of a batch, declared by graph::declare. It is assigned and read by the
+// statements of its graph like a vector, but its elements only exist while the graph
+// runs: unless statements of different passes use it, only one tile of it is kept at a
+// time, on each thread.
+template <typename T, class Exec>
+class local :
+	public expressions::Expression <local <T, Exec>>
+{
+public:
+	using typename expressions::Expression<local>::value_type;
+	using typename expressions::Expression<local>::iterator;
+	using typename expressions::Expression<local>::const_iterator;
+	using typename expressions::Expression<local>::exec;
+
+private:
+	const detail::slot* s;
+
+public:
+	explicit local(const detail::slot* declared) : s(declared) {}
+
+	const void* storage() const { return s; }
+	const detail::slot* declaration() const { return s; }
+
+	std::size_t size() const { return s->size; }
+
+	T operator [] (const std::size_t i) const { return *detail::address<T>(*s, i); }
+
+	// Unaligned load of Packet::width elements, as for vectors
+	template <class Packet>
+	Packet packet(const std::size_t i) const { return vap::simd::load<Packet>(detail::address<T>(*s, i)); }
+};
+
+// Deferred evaluation of a block of assignments. Statements are recorded, not executed;
+// run() then evaluates all of them, with the result of running them in order:
+//
+//	vap::batch::graph g;
+//	auto t = g.declare<double>(n);		// an intermediate, never stored as a whole
+//
+//	g.assign(t, a * b);
+//	g.assign(u, t + sin(c));
+//	g.assign(v, u * t);
+//	g.assign(w, x - y);
+//
+//	for (int step = 0; step < steps; ++step)
+//		g.run();
+//
+// run() orders the statements in levels. A statement goes one level after a statement it
+// depends on through other indices than its own (a leaf of unknown type), or of another
+// size; otherwise it stays on the same level. The statements of a level that have the
+// same size form a pass, evaluated tile by tile in a single loop as in tiled.h, so the
+// values written by a statement are read back from the cache by the next ones. Passes
+// of different sizes in a level are independent and run concurrently. Tiles and passes
+// are distributed over the thread pool when a statement has a parallel_execution policy.
+// The statements reference the vectors they read and write, which must outlive the graph;
+// recording them again is not needed to run the graph again.
+class graph
+{
+private:
+	std::deque<detail::slot>					slots;
+	std::vector<std::unique_ptr<detail::node>>	nodes;
+	std::vector<std::size_t>					element_bytes;
+	std::vector<bool>							assigned;	// intermediates assigned so far
+	std::vector<std::vector<detail::pass>>		levels;
+
+	template <class E>
+	void record(std::unique_ptr<detail::node> n, const expressions::Expression<E>& e)
+	{
+		using exec = typename E::exec;
+
+		n->size		 = e.size();
+		n->footprint = expressions::static_cost<E>().bytes;
+		n->parallel	 = std::is_same<exec, parallel_execution>::value;
+		detail::read(e.derived(), n->sources);
+
+		for (const detail::slot& s : slots)
+		{
+			if (!assigned[s.index] && std::find(n->sources.storage.begin(), n->sources.storage.end(), &s) != n->sources.storage.end())
+				throw std::logic_error("batch::graph: intermediate read before being assigned");
+		}
+
+		nodes.push_back(std::move(n));
+		levels.clear();
+	}
+
+	static bool reads(const detail::node& n, const void* storage)
+	{
+		return n.sources.opaque || std::find(n.sources.storage.begin(), n.sources.storage.end(), storage) != n.sources.storage.end();
+	}
+
+	static bool depends(const detail::node& earlier, const detail::node& later)
+	{
+		return earlier.destination == later.destination ||
+			   reads(later, earlier.destination) || reads(earlier, later.destination);
+	}
+
+	// Dependencies through the same index keep two statements on the same level
+	static bool elementwise(const detail::node& earlier, const detail::node& later)
+	{
+		return !earlier.sources.opaque && !later.sources.opaque && earlier.size == later.size;
+	}
+
+	void plan()
+	{
+		std::vector<std::size_t> level(nodes.size(), 0);
+
+		for (std::size_t j = 0; j < nodes.size(); ++j)
+		{
+			for (std::size_t i = 0; i < j; ++i)
+			{
+				if (depends(*nodes[i], *nodes[j]))
+					level[j] = std::max(level[j], level[i] + (elementwise(*nodes[i], *nodes[j]) ? 0 : 1));
+			}
+		}
+
+		levels.assign(nodes.empty() ? 0 : *std::max_element(level.begin(), level.end()) + 1, {});
+
+		for (std::size_t j = 0; j < nodes.size(); ++j)
+		{
+			const detail::node& n = *nodes[j];
+			std::vector<detail::pass>& passes = levels[level[j]];
+
+			auto p = std::find_if(passes.begin(), passes.end(), [&n](const detail::pass& q) { return !q.alone && q.size == n.size; });
+
+			if (n.sources.opaque || p == passes.end())
+			{
+				passes.push_back(detail::pass{ {}, n.size, n.sources.opaque, false });
+				p = passes.end() - 1;
+			}
+
+			p->statements.push_back(&n);
+			p->parallel = p->parallel || n.parallel;
+		}
+	}
+
+	// Intermediates used by several passes, or by a statement evaluated on its own, are
+	// stored as a whole for the run
+	std::vector<bool> whole() const
+	{
+		std::vector<bool> result(slots.size(), false);
+		std::vector<const detail::pass*> user(slots.size(), nullptr);
+
+		for (const std::vector<detail::pass>& passes : levels)
+			for (const detail::pass& p : passes)
+				for (const detail::node* n : p.statements)
+					for (const detail::slot& s : slots)
+					{
+						if (n->target != &s && !reads(*n, &s)) continue;
+
+						if (p.alone || (user[s.index] && user[s.index] != &p)) result[s.index] = true;
+						user[s.index] = &p;
+					}
+
+		return result;
+	}
+
+	// Evaluates a pass over [first, last), one tile after the other. The intermediates
+	// marked local get a buffer of one tile for the chunk.
+	static void tiles(const detail::pass& p, const std::size_t tile, std::vector<detail::window> windows,
+					  const std::vector<bool>& local, const std::vector<std::size_t>& bytes,
+					  const std::size_t first, const std::size_t last)
+	{
+		std::vector<std::unique_ptr<char[]>> buffers;
+		for (std::size_t k = 0; k < windows.size(); ++k)
+		{
+			if (!local[k]) continue;
+
+			buffers.emplace_back(new char[tile * bytes[k]]);
+			windows[k].data = buffers.back().get();
+		}
+
+		detail::frame f(windows);
+
+		for (std::size_t begin = first; begin < last; begin += tile)
+		{
+			const std::size_t end = std::min(last, begin + tile);
+
+			for (std::size_t k = 0; k < windows.size(); ++k)
+				if (local[k]) windows[k].first = begin;
+
+			for (const detail::node* n : p.statements)
+				n->evaluate(begin, end);
+		}
+	}
+
+public:
+	graph() {}
+
+	graph(const graph&) = delete;
+	graph& operator = (const graph&) = delete;
+
+	// Declares an intermediate of n elements. Like a vector, it gives its execution policy
+	// to the expressions reading it.
+	template <typename T, class Exec = serial_execution>
+	batch::local<T, Exec> declare(const std::size_t n)
+	{
+		static_assert(std::is_arithmetic<T>::value, "batch::graph: arithmetic intermediates expected");
+
+		slots.push_back(detail::slot{ slots.size(), n });
+		assigned.push_back(false);
+		element_bytes.push_back(sizeof(T));
+
+		return batch::local<T, Exec>(&slots.back());
+	}
+
+	// Records destination = e
+	template <class V, class E>
+	std::enable_if_t<!detail::is_local<V>::value> assign(V& destination, const expressions::Expression<E>& e)
+	{
+		std::unique_ptr<detail::node> n(new detail::vector_node<V, E>(destination, e.derived()));
+		n->destination = &static_cast<const vap::detail::container_t<V>&>(destination);
+		n->target	   = nullptr;
+
+		record(std::move(n), e);
+	}
+
+	template <typename T, class Exec, class E>
+	void assign(const batch::local<T, Exec>& destination, const expressions::Expression<E>& e)
+	{
+		assert(e.size() == destination.size());
+
+		std::unique_ptr<detail::node> n(new detail::local_node<T, E>(e.derived()));
+		n->destination = destination.storage();
+		n->target	   = destination.declaration();
+
+		record(std::move(n), e);
+		assigned[destination.declaration()->index] = true;
+	}
+
+	// Number of statements recorded
+	std::size_t statements() const { return nodes.size(); }
+
+	// Number of loops run() makes over the data, once planned
+	std::size_t passes()
+	{
+		if (levels.empty()) plan();
+
+		std::size_t count = 0;
+		for (const std::vector<detail::pass>& l : levels)
+			count += l.size();
+
+		return count;
+	}
+
+	// Forgets the statements; the intermediates stay declared
+	void clear()
+	{
+		nodes.clear();
+		levels.clear();
+		std::fill(assigned.begin(), assigned.end(), false);
+	}
+
+	// Evaluates the statements. The plan is kept until another statement is recorded.
+	void run()
+	{
+		if (levels.empty()) plan();
+
+		for (const std::unique_ptr<detail::node>& n : nodes)
+			n->prepare();
+
+		// Intermediates stored as a whole
+		const std::vector<bool>	  stored = whole();
+		std::vector<std::vector<char>> storage(slots.size());
+		std::vector<detail::window>	  windows(slots.size(), detail::window{ nullptr, 0 });
+
+		for (const detail::slot& s : slots)
+		{
+			if (!stored[s.index]) continue;
+
+			storage[s.index].resize(s.size * element_bytes[s.index]);
+			windows[s.index].data = storage[s.index].data();
+		}
+
+		for (const std::vector<detail::pass>& passes : levels)
+		{
+			const auto evaluate = [&](const detail::pass& p)
+			{
+				if (p.alone)
+				{
+					detail::frame f(windows);
+					p.statements.front()->assign();
+					return;
+				}
+
+				std::size_t		  footprint = 0;
+				std::vector<bool> local(slots.size(), false);
+
+				for (const detail::node* n : p.statements)
+				{
+					footprint += n->footprint;
+					if (n->target && !stored[n->target->index]) local[n->target->index] = true;
+				}
+
+				const std::size_t tile = tiled::tile_size({ footprint });
+
+				const auto chunk = [&](const std::size_t first, const std::size_t last) {
+					tiles(p, tile, windows, local, element_bytes, first, last);
+				};
+
+				if (p.parallel) vap::detail::parallel_for(0, p.size, std::max(vap::detail::parallel_grain, tile), chunk);
+				else			chunk(0, p.size);
+			};
+
+			const bool parallel = std::any_of(passes.begin(), passes.end(), [](const detail::pass& p) { return p.parallel; });
+
+			if (parallel && passes.size() > 1)
+			{
+				vap::detail::parallel_for(0, passes.size(), 1, [&](const std::size_t first, const std::size_t last) {
+					for (std::size_t k = first; k < last; ++k)
+						evaluate(passes[k]);
+				});
+			}
+			else
+			{
+				for (const detail::pass& p : passes)
+					evaluate(p);
+			}
+		}
+	}
+};
+
+} // end namespace batch
+
+namespace expressions {
+
+template <typename T, class Exec>
+struct expression_traits<batch::local<T, Exec>>
+{
+	static const bool is_operator	= false;
+	static const bool packet_access = true;
+
+	static const std::size_t loads			 = 1;
+	static const std::size_t bytes			 = sizeof(T);
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 0;
+	static const std::size_t depth			 = 0;
+
+	using value_type	 = T;
+	using exec			 = Exec;
+	using iterator		 = const T*;
+	using const_iterator = const T*;
+};
+
+namespace rewriting {
+
+// Intermediates are equal when they are the same declaration, for the common
+// sub-expression pass
+template <typename T, class Exec>
+struct equality <batch::local<T, Exec>>
+{
+	static bool apply(const batch::local<T, Exec>& a, const batch::local<T, Exec>& b) { return a.storage() == b.storage(); }
+};
+
+} // end namespace rewriting
+} // end namespace expressions
+
+namespace detail {
+
+// Intermediates never share storage with a vector
+template <typename T, class Exec>
+struct aliasing <batch::local<T, Exec>>
+{
+	template <class C>
+	using may_read = std::false_type;
+
+	template <class C>
+	static alias classify(const C&, const batch::local<T, Exec>&) { return alias::none; }
+};
+
+} // end namespace detail
+
+namespace simd	 {
+namespace detail {
+
+template <typename T, class E, isa I>
+struct use_packets <batch::detail::span<T>, E, I>
+{
+	static const bool value = has_packet<typename E::value_type, I>::value &&
+							  vap::expressions::expression_traits<typename E::Derived>::packet_access &&
+							  std::is_convertible<typename E::value_type, T>::value;
+};
+
+// Packets of the expression's value type, narrowed on store like the generic loop
+template <typename T, class E>
+struct packet_loop <batch::detail::span<T>, E>
+{
+	template <isa I>
+	static void run(batch::detail::span<T>& c, const E& e, const std::size_t first, const std::size_t last)
+	{
+		using Packet = packet<typename E::value_type, I>;
+
+		T* out = batch::detail::address<T>(*c.s, first);
+
+		std::size_t i = first;
+		for (; i + Packet::width <= last; i += Packet::width)
+			vap::simd::store(e.template packet<Packet>(i), out + (i - first));
+
+		evaluate_scalar(c, e, i, last);
+	}
+};
+
+} // end namespace detail
+} // end namespace simd
+} // end namespace vap
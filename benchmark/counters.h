@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vap/config.h>
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__linux__)
+#	include <dirent.h>
+#	include <linux/perf_event.h>
+#	include <sys/ioctl.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+namespace vap		{
+namespace benchmark {
+
+// Hardware events counted around a benchmark
+enum class event : std::size_t { cycles, instructions, l1_misses, llc_misses, branch_misses };
+
+static const std::size_t event_count = 5;
+
+inline const char* name(const event e)
+{
+	static const char* names[event_count] = { "cycles", "instructions", "l1_misses", "llc_misses", "branch_misses" };
+	return names[static_cast<std::size_t>(e)];
+}
+
+// Counts of one run. An event the processor or the operating system could not count
+// is NaN; available is false when none could be counted.
+struct counts
+{
+	bool						   available = false;
+	std::array<double, event_count> values	 = {{ NAN, NAN, NAN, NAN, NAN }};
+
+	double operator [] (const event e) const { return values[static_cast<std::size_t>(e)]; }
+
+	// Instructions per cycle
+	double ipc() const { return (*this)[event::instructions] / (*this)[event::cycles]; }
+};
+
+namespace detail {
+
+#if defined(__linux__)
+
+struct encoding
+{
+	std::uint32_t type;
+	std::uint64_t config;
+};
+
+inline encoding encode(const event e)
+{
+	using cache = std::uint64_t;
+	const cache read = PERF_COUNT_HW_CACHE_OP_READ << 8;
+	const cache miss = cache(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16;
+
+	switch (e)
+	{
+	case event::cycles:		   return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES };
+	case event::instructions:  return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS };
+	case event::l1_misses:	   return { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read | miss };
+	case event::llc_misses:	   return { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read | miss };
+	default:				   return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES };
+	}
+}
+
+inline int open_counter(const event e, const pid_t thread)
+{
+	const encoding code = encode(e);
+
+	perf_event_attr attr = {};
+	attr.size			= sizeof(attr);
+	attr.type			= code.type;
+	attr.config			= code.config;
+	attr.disabled		= 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv		= 1;
+	attr.read_format	= PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return static_cast<int>(syscall(SYS_perf_event_open, &attr, thread, -1, -1, 0));
+}
+
+// Threads of the process, so that the workers of the thread pool are counted too
+inline std::vector<pid_t> threads()
+{
+	std::vector<pid_t> result;
+
+	if (DIR* tasks = opendir("/proc/self/task"))
+	{
+		while (const dirent* entry = readdir(tasks))
+		{
+			if (entry->d_name[0] != '.')
+				result.push_back(static_cast<pid_t>(std::atol(entry->d_name)));
+		}
+		closedir(tasks);
+	}
+
+	if (result.empty()) result.push_back(0);
+	return result;
+}
+
+#endif
+
+} // end namespace detail
+
+// Hardware counters of every thread of the process, through perf_event_open on Linux.
+// Threads started after construction are not counted; elsewhere, or when the kernel
+// refuses (perf_event_paranoid, containers, virtual machines), nothing is counted and
+// read() returns counts that are not available.
+class counters
+{
+private:
+	// One descriptor per thread for each event; an empty list if the event is not counted
+	std::array<std::vector<int>, event_count> descriptors;
+
+	template <class Function>
+	void each(Function&& f) const
+	{
+		for (const std::vector<int>& list : descriptors)
+			for (const int fd : list)
+				f(fd);
+	}
+
+public:
+	counters()
+	{
+#	if defined(__linux__)
+		const std::vector<pid_t> tasks = detail::threads();
+
+		for (std::size_t e = 0; e < event_count; ++e)
+		{
+			for (const pid_t thread : tasks)
+			{
+				const int fd = detail::open_counter(static_cast<event>(e), thread);
+
+				// A thread that exited since it was listed is skipped; an event that cannot
+				// be counted on the first thread is not counted at all
+				if (fd >= 0)					  descriptors[e].push_back(fd);
+				else if (thread == tasks.front()) break;
+			}
+		}
+#	endif
+	}
+
+	~counters()
+	{
+#	if defined(__linux__)
+		each([](const int fd) { close(fd); });
+#	endif
+	}
+
+	counters(const counters&) = delete;
+	counters& operator = (const counters&) = delete;
+
+	bool available() const
+	{
+		for (const std::vector<int>& list : descriptors)
+			if (!list.empty()) return true;
+
+		return false;
+	}
+
+	void start()
+	{
+#	if defined(__linux__)
+		each([](const int fd) { ioctl(fd, PERF_EVENT_IOC_RESET, 0); });
+		each([](const int fd) { ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); });
+#	endif
+	}
+
+	void stop()
+	{
+#	if defined(__linux__)
+		each([](const int fd) { ioctl(fd, PERF_EVENT_IOC_DISABLE, 0); });
+#	endif
+	}
+
+	// Counts since the last start, summed over the threads. Counts are scaled up when
+	// the kernel multiplexed more events than the processor has counters.
+	counts read() const
+	{
+		counts result;
+
+#	if defined(__linux__)
+		for (std::size_t e = 0; e < event_count; ++e)
+		{
+			if (descriptors[e].empty()) continue;
+
+			double total = 0;
+			for (const int fd : descriptors[e])
+			{
+				std::uint64_t value[3] = { 0, 0, 0 };
+				if (::read(fd, value, sizeof(value)) != sizeof(value)) continue;
+
+				total += value[2] > 0 ? double(value[0]) * value[1] / value[2] : 0;
+			}
+
+			result.values[e] = total;
+			result.available = true;
+		}
+#	endif
+
+		return result;
+	}
+};
+
+} // end namespace benchmark
+} // end namespace vap
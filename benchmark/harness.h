@@ -0,0 +1,513 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/benchmark/counters.h>
+#include <vap/detail/thread_pool.h>
+#include <vap/expressions/cost.h>
+#include <vap/simd/packet.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+namespace vap		{
+namespace benchmark {
+
+// Prevents the compiler from optimizing away the computation of the object at p
+inline void escape(const void* p)
+{
+#if defined(__GNUC__)
+	asm volatile("" : : "g"(p) : "memory");
+#else
+	static const void* volatile sink;
+	sink = p;
+	_ReadWriteBarrier();
+#endif
+}
+
+struct options
+{
+	// Untimed runs before the measurement, to fault in pages and warm caches
+	std::size_t warmup		= 2;
+	std::size_t repetitions = 10;
+};
+
+// Durations of the repetitions, in seconds
+struct statistics
+{
+	double mean;
+	double stddev;
+	double min;
+	double median;
+	double max;
+};
+
+inline statistics summarize(std::vector<double> samples)
+{
+	statistics s = { 0, 0, 0, 0, 0 };
+	if (samples.empty()) return s;
+
+	std::sort(samples.begin(), samples.end());
+
+	const std::size_t n = samples.size();
+	for (const double t : samples)
+		s.mean += t;
+	s.mean /= n;
+
+	for (const double t : samples)
+		s.stddev += (t - s.mean) * (t - s.mean);
+	s.stddev = n > 1 ? std::sqrt(s.stddev / (n - 1)) : 0;
+
+	s.min	 = samples.front();
+	s.max	 = samples.back();
+	s.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+	return s;
+}
+
+// Runs f options.warmup times, then times options.repetitions runs of f
+template <class Function>
+statistics measure(Function&& f, const options& o = options())
+{
+	using clock = std::chrono::steady_clock;
+
+	for (std::size_t k = 0; k < o.warmup; ++k)
+		f();
+
+	std::vector<double> samples;
+	samples.reserve(o.repetitions);
+
+	for (std::size_t k = 0; k < o.repetitions; ++k)
+	{
+		const auto start = clock::now();
+		f();
+		const auto stop = clock::now();
+
+		samples.push_back(std::chrono::duration<double>(stop - start).count());
+	}
+
+	return summarize(std::move(samples));
+}
+
+// As above, and also counts hardware events (counters.h) during the timed runs.
+// events receives the mean counts of one run, or counts that are not available when the
+// events cannot be counted, in which case only the time is measured.
+template <class Function>
+statistics measure(Function&& f, const options& o, counts& events)
+{
+	using clock = std::chrono::steady_clock;
+
+	// After the warm-up, so that threads started by the first runs (the thread pool) exist
+	for (std::size_t k = 0; k < o.warmup; ++k)
+		f();
+
+	counters hardware;
+	counts	 total;
+	total.values.fill(0);
+
+	std::vector<double> samples;
+	samples.reserve(o.repetitions);
+
+	for (std::size_t k = 0; k < o.repetitions; ++k)
+	{
+		hardware.start();
+		const auto start = clock::now();
+		f();
+		const auto stop = clock::now();
+		hardware.stop();
+
+		samples.push_back(std::chrono::duration<double>(stop - start).count());
+
+		const counts run = hardware.read();
+		for (std::size_t e = 0; e < event_count; ++e)
+			total.values[e] += run.values[e];
+		total.available = run.available;
+	}
+
+	events = counts();
+	if (total.available && o.repetitions > 0)
+	{
+		events.available = true;
+		for (std::size_t e = 0; e < event_count; ++e)
+			events.values[e] = total.values[e] / o.repetitions;
+	}
+
+	return summarize(std::move(samples));
+}
+
+// Work done per element by a benchmark: bytes moved to and from memory, and floating
+// point operations (transcendental functions counted apart, they are not single flops)
+struct work
+{
+	double bytes;
+	double flops;
+	double transcendentals;
+};
+
+// Work of an expression per element, from the cost model of expressions/cost.h:
+//
+//	bench::work_of(vap::cost_of(vap::rewrite(x * y + x)))
+//
+inline work work_of(const expressions::cost& c)
+{
+	return { double(c.bytes), double(c.flops), double(c.transcendentals) };
+}
+
+// Peak rates of the machine on all the threads of the pool, the roofs of the roofline
+// model. A transcendental call is counted as transcendental_flops operations, about the
+// polynomial evaluations of simd/math.h.
+struct machine
+{
+	static constexpr double transcendental_flops = 20;
+
+	double gb_per_second;
+	double gflop_per_second;
+
+	// Operations per byte above which a kernel is bound by arithmetic rather than memory
+	double ridge() const { return gflop_per_second / gb_per_second; }
+
+	// Operations per byte of the work, transcendental calls included
+	static double intensity(const work& w) { return (w.flops + transcendental_flops * w.transcendentals) / w.bytes; }
+
+	// Shortest times, in seconds, in which the machine can move and compute n elements
+	double memory_time(const work& w, const std::size_t n) const { return w.bytes * n / (gb_per_second * 1e9); }
+
+	double compute_time(const work& w, const std::size_t n) const { return intensity(w) * w.bytes * n / (gflop_per_second * 1e9); }
+
+	bool memory_bound(const work& w) const { return intensity(w) <= ridge(); }
+};
+
+namespace detail {
+
+// Independent multiply-add chains, enough of them to hide the latency of the
+// operations. Returns the number of operations done.
+inline double scalar_chains(const std::size_t iterations)
+{
+	const std::size_t chains = 16;
+	double x[chains];
+	for (std::size_t j = 0; j < chains; ++j)
+		x[j] = 1 + 1e-3 * j;
+
+	for (std::size_t k = 0; k < iterations; ++k)
+		for (std::size_t j = 0; j < chains; ++j)
+			x[j] = x[j] * 0.999999 + 1e-6;
+
+	escape(x);
+	return 2.0 * chains * iterations;
+}
+
+// The same with fused multiply-adds on packets, inlined into the kernels below
+template <class Packet>
+double packet_chains(const std::size_t iterations)
+{
+	const std::size_t chains = 12;
+	const Packet	  m		 = Packet::broadcast(0.999999);
+	const Packet	  a		 = Packet::broadcast(1e-6);
+
+	Packet x[chains];
+	for (std::size_t j = 0; j < chains; ++j)
+		x[j] = Packet::broadcast(1 + 1e-3 * j);
+
+	for (std::size_t k = 0; k < iterations; ++k)
+		for (std::size_t j = 0; j < chains; ++j)
+			x[j] = Packet::fma(x[j], m, a);
+
+	double lanes[Packet::width];
+	for (std::size_t j = 0; j < chains; ++j)
+	{
+		x[j].store(lanes);
+		escape(lanes);
+	}
+
+	return 2.0 * chains * Packet::width * iterations;
+}
+
+#ifdef VAP_SIMD_AVX2
+VAP_TARGET_AVX2
+inline double avx2_chains(const std::size_t iterations) { return packet_chains<simd::packet<double, simd::isa::avx2>>(iterations); }
+#endif
+
+#ifdef VAP_SIMD_AVX512
+VAP_TARGET_AVX512
+inline double avx512_chains(const std::size_t iterations) { return packet_chains<simd::packet<double, simd::isa::avx512>>(iterations); }
+#endif
+
+// With the widest packets the SIMD evaluator would use
+inline double multiply_add_chains(const std::size_t iterations)
+{
+	switch (simd::active())
+	{
+#	ifdef VAP_SIMD_AVX512
+	case simd::isa::avx512: return avx512_chains(iterations);
+#	endif
+
+#	ifdef VAP_SIMD_AVX2
+	case simd::isa::avx2:	return avx2_chains(iterations);
+#	endif
+
+	default:				return scalar_chains(iterations);
+	}
+}
+
+} // end namespace detail
+
+// Estimates the roofs with a triad over arrays larger than the caches and with chains
+// of multiply-adds on the widest packets available, each spread over the thread pool;
+// the best of a few runs is kept.
+inline machine measure_machine(const std::size_t elements = std::size_t(1) << 23)
+{
+	using vap::detail::parallel_for;
+
+	const options o = { 1, 5 };
+
+	std::vector<double> a(elements), b(elements, 1.0), c(elements, 2.0);
+
+	const statistics triad = measure([&] {
+		parallel_for(0, elements, vap::detail::parallel_grain, [&](const std::size_t first, const std::size_t last) {
+			for (std::size_t i = first; i < last; ++i)
+				a[i] = b[i] + 3.0 * c[i];
+		});
+		escape(a.data());
+	}, o);
+
+	const std::size_t threads	 = vap::detail::thread_pool::instance().concurrency();
+	const std::size_t iterations = 1 << 18;
+
+	std::vector<double> flops(threads);
+	const statistics chains = measure([&] {
+		parallel_for(0, threads, 1, [&](const std::size_t first, const std::size_t last) {
+			for (std::size_t t = first; t < last; ++t)
+				flops[t] = detail::multiply_add_chains(iterations);
+		});
+	}, o);
+
+	machine m;
+	m.gb_per_second	   = 3 * sizeof(double) * elements / triad.min / 1e9;
+	m.gflop_per_second = flops[0] * threads / chains.min / 1e9;
+	return m;
+}
+
+// One measurement: a benchmark (the expression), a variant (the constructor policy or
+// hand-written loop) and a size
+struct record
+{
+	std::string benchmark;
+	std::string variant;
+	std::size_t n;
+	work		per_element;
+	statistics	time;
+	counts		events;
+
+	// Rates are computed from the median duration
+	double ns_per_element() const { return time.median * 1e9 / n; }
+	double gb_per_second()	const { return per_element.bytes * n / time.median / 1e9; }
+	double gflop_per_second() const { return per_element.flops * n / time.median / 1e9; }
+
+	// Share of the time the roofline model allows that the measurement reaches, from 0 to 1
+	double roof_fraction(const machine& m) const
+	{
+		return std::max(m.memory_time(per_element, n), m.compute_time(per_element, n)) / time.median;
+	}
+
+	// Hardware events per element, NaN when not counted
+	double per_element_count(const event e) const { return events[e] / n; }
+
+	// Relative standard deviation of the durations, in percent
+	double variation() const { return time.mean > 0 ? 100 * time.stddev / time.mean : 0; }
+};
+
+// Collects records and writes them as a table, CSV or JSON
+class report
+{
+private:
+	std::vector<record> records;
+	machine				roofs;
+	bool				roofline;
+
+	static std::string escaped(const std::string& s)
+	{
+		std::string result;
+		for (const char c : s)
+		{
+			if (c == '"' || c == '\\') result += '\\';
+			result += c;
+		}
+		return result;
+	}
+
+public:
+	report() : roofs(), roofline(false) {}
+
+	void add(const record& r) { records.push_back(r); }
+
+	// Compares every record with the roofs of m: the arithmetic intensity of the work,
+	// which roof bounds it and the share of that bound reached
+	void compare_with(const machine& m)
+	{
+		roofs	 = m;
+		roofline = true;
+	}
+
+	const std::vector<record>& all() const { return records; }
+
+	void table(std::ostream& out) const
+	{
+		// Event columns are only shown when some events were counted
+		bool counted = false;
+		for (const record& r : records)
+			counted = counted || r.events.available;
+
+		out << std::left << std::setw(24) << "benchmark" << std::setw(12) << "variant" << std::right
+			<< std::setw(10) << "n" << std::setw(12) << "ns/elem" << std::setw(10) << "GB/s"
+			<< std::setw(10) << "GFLOP/s" << std::setw(8) << "cv %";
+
+		if (roofline)
+			out << std::setw(8) << "flop/B" << std::setw(9) << "bound" << std::setw(8) << "% roof";
+
+		if (counted)
+			out << std::setw(8) << "IPC" << std::setw(11) << "instr/el" << std::setw(11) << "L1 mis/el"
+				<< std::setw(11) << "LLC mis/el" << std::setw(11) << "br mis/el";
+
+		out << '\n';
+
+		for (const record& r : records)
+		{
+			out << std::left << std::setw(24) << r.benchmark << std::setw(12) << r.variant << std::right
+				<< std::setw(10) << r.n << std::fixed << std::setprecision(3)
+				<< std::setw(12) << r.ns_per_element() << std::setw(10) << r.gb_per_second()
+				<< std::setw(10) << r.gflop_per_second() << std::setprecision(1) << std::setw(8) << r.variation();
+
+			if (roofline)
+				out << std::setprecision(3) << std::setw(8) << roofs.intensity(r.per_element)
+					<< std::setw(9) << (roofs.memory_bound(r.per_element) ? "memory" : "compute")
+					<< std::setprecision(1) << std::setw(8) << 100 * r.roof_fraction(roofs);
+
+			if (counted)
+				out << std::setprecision(2) << std::setw(8) << r.events.ipc()
+					<< std::setw(11) << r.per_element_count(event::instructions)
+					<< std::setprecision(4) << std::setw(11) << r.per_element_count(event::l1_misses)
+					<< std::setw(11) << r.per_element_count(event::llc_misses)
+					<< std::setw(11) << r.per_element_count(event::branch_misses);
+
+			out << '\n';
+			out.unsetf(std::ios::fixed);
+		}
+	}
+
+	void csv(std::ostream& out) const
+	{
+		out << "benchmark,variant,n,bytes_per_element,flops_per_element,transcendentals_per_element,"
+			   "median_s,mean_s,stddev_s,min_s,max_s,ns_per_element,gb_per_s,gflop_per_s";
+
+		for (std::size_t e = 0; e < event_count; ++e)
+			out << ',' << name(static_cast<event>(e)) << "_per_element";
+
+		if (roofline) out << ",flops_per_byte,bound,roof_fraction";
+		out << '\n';
+
+		out << std::setprecision(9);
+		for (const record& r : records)
+		{
+			out << r.benchmark << ',' << r.variant << ',' << r.n << ','
+				<< r.per_element.bytes << ',' << r.per_element.flops << ',' << r.per_element.transcendentals << ','
+				<< r.time.median << ',' << r.time.mean << ',' << r.time.stddev << ',' << r.time.min << ',' << r.time.max << ','
+				<< r.ns_per_element() << ',' << r.gb_per_second() << ',' << r.gflop_per_second();
+
+			// Events that were not counted are left empty
+			for (std::size_t e = 0; e < event_count; ++e)
+			{
+				out << ',';
+				if (!std::isnan(r.events.values[e])) out << r.per_element_count(static_cast<event>(e));
+			}
+
+			if (roofline)
+				out << ',' << roofs.intensity(r.per_element) << ','
+					<< (roofs.memory_bound(r.per_element) ? "memory" : "compute") << ',' << r.roof_fraction(roofs);
+
+			out << '\n';
+		}
+	}
+
+	void json(std::ostream& out) const
+	{
+		out << "[\n" << std::setprecision(9);
+
+		for (std::size_t k = 0; k < records.size(); ++k)
+		{
+			const record& r = records[k];
+
+			out << "  {\"benchmark\": \"" << escaped(r.benchmark) << "\", \"variant\": \"" << escaped(r.variant) << "\", "
+				<< "\"n\": " << r.n << ", "
+				<< "\"bytes_per_element\": " << r.per_element.bytes << ", "
+				<< "\"flops_per_element\": " << r.per_element.flops << ", "
+				<< "\"transcendentals_per_element\": " << r.per_element.transcendentals << ", "
+				<< "\"median_s\": " << r.time.median << ", \"mean_s\": " << r.time.mean << ", "
+				<< "\"stddev_s\": " << r.time.stddev << ", \"min_s\": " << r.time.min << ", \"max_s\": " << r.time.max << ", "
+				<< "\"ns_per_element\": " << r.ns_per_element() << ", "
+				<< "\"gb_per_s\": " << r.gb_per_second() << ", "
+				<< "\"gflop_per_s\": " << r.gflop_per_second();
+
+			// Events that were not counted are null
+			for (std::size_t e = 0; e < event_count; ++e)
+			{
+				out << ", \"" << name(static_cast<event>(e)) << "_per_element\": ";
+				if (std::isnan(r.events.values[e])) out << "null";
+				else								out << r.per_element_count(static_cast<event>(e));
+			}
+
+			if (roofline)
+				out << ", \"flops_per_byte\": " << roofs.intensity(r.per_element)
+					<< ", \"bound\": \"" << (roofs.memory_bound(r.per_element) ? "memory" : "compute") << '"'
+					<< ", \"roof_fraction\": " << r.roof_fraction(roofs);
+
+			out << '}' << (k + 1 < records.size() ? ",\n" : "\n");
+		}
+
+		out << "]\n";
+	}
+
+	void save_csv(const std::string& path) const
+	{
+		std::ofstream out(path);
+		csv(out);
+	}
+
+	void save_json(const std::string& path) const
+	{
+		std::ofstream out(path);
+		json(out);
+	}
+};
+
+// Sizes of the published comparison, 1e4 to 5e6 elements
+inline std::vector<std::size_t> default_sizes()
+{
+	return {
+		static_cast<std::size_t>(1e4),
+		static_cast<std::size_t>(1e5),
+		static_cast<std::size_t>(2e5),
+		static_cast<std::size_t>(3e5),
+		static_cast<std::size_t>(4e5),
+		static_cast<std::size_t>(5e5),
+		static_cast<std::size_t>(6e5),
+		static_cast<std::size_t>(7e5),
+		static_cast<std::size_t>(1e6),
+		static_cast<std::size_t>(2e6),
+		static_cast<std::size_t>(3e6),
+		static_cast<std::size_t>(4e6),
+		static_cast<std::size_t>(5e6),
+	};
+}
+
+} // end namespace benchmark
+} // end namespace vap
@@ -0,0 +1,212 @@
+// Checks batch::graph against eager evaluation of the same statements, in order, for
+// the dependencies its planner has to respect. Prints the largest difference of each
+// case and returns non-zero if one of them is off.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <vap/vector.h>
+#include <vap/view.h>
+#include <vap/batch.h>
+
+using V	 = vap::vector<double, vap::constructors::SIMD>;
+using F	 = vap::vector<float, vap::constructors::SIMD>;
+using PV = vap::vector<double, vap::constructors::Parallel, std::vector<double>, vap::parallel_execution>;
+
+using std::endl;
+
+const std::size_t n = 100003;
+
+template <typename V>
+V ramp(const std::size_t N, const double first, const double step)
+{
+	V v(N);
+
+	std::vector<typename V::value_type>& elements = v;
+	for (std::size_t i = 0; i < N; ++i)
+		elements[i] = static_cast<typename V::value_type>(first + step * i);
+
+	return v;
+}
+
+// Largest difference between two vectors of the same size
+template <typename A, typename B>
+double difference(const A& a, const B& b)
+{
+	if (a.size() != b.size()) return INFINITY;
+
+	double error = 0;
+	for (std::size_t i = 0; i < a.size(); ++i)
+		error = std::max(error, std::fabs(double(a[i]) - double(b[i])));
+
+	return error;
+}
+
+// Read after write: each statement reads what the previous ones wrote, through an
+// intermediate and through vectors
+template <typename V>
+double read_after_write()
+{
+	using namespace vap::operators;
+
+	const V x = ramp<V>(n, 1, 1e-5), y = ramp<V>(n, 2, -1e-5);
+	V u(n), r(n);
+
+	vap::batch::graph g;
+	auto t = g.declare<double, typename V::exec>(n);
+
+	g.assign(t, x * y);
+	g.assign(u, t + x);
+	g.assign(r, u * vap::constant<2>() + t);
+	g.run();
+
+	const V T = x * y;
+	const V U = T + x;
+	const V R = U * vap::constant<2>() + T;
+
+	return std::max(difference(u, U), difference(r, R));
+}
+
+// Write after read: a statement overwrites a vector read by an earlier one, which must
+// still see the old elements, and by a later one, which must see the new ones
+template <typename V>
+double write_after_read()
+{
+	using namespace vap::operators;
+
+	V x = ramp<V>(n, 1, 1e-5);
+	const V y = ramp<V>(n, 2, -1e-5);
+	V r1(n), r2(n);
+
+	V X = x;
+
+	vap::batch::graph g;
+	g.assign(r1, x + 1.0);
+	g.assign(x, y * 2.0);
+	g.assign(r2, x + r1);
+
+	// Twice, so that the second run starts from the x written by the first one
+	g.run();
+	g.run();
+
+	V R1(n), R2(n);
+	for (int k = 0; k < 2; ++k)
+	{
+		R1 = X + 1.0;
+		X  = y * 2.0;
+		R2 = X + R1;
+	}
+
+	return std::max({ difference(r1, R1), difference(x, X), difference(r2, R2) });
+}
+
+// An intermediate written by one pass and read by a later one: the view reads z at other
+// indices, so its statement is evaluated on its own after the intermediate is complete.
+// A statement of another size runs alongside.
+template <typename V>
+double local_across_passes()
+{
+	using namespace vap::operators;
+
+	const V x = ramp<V>(n, 1, 1e-5), y = ramp<V>(n, 2, -1e-5);
+	V z = ramp<V>(n + 1, 0, 1e-3);
+	V u(n), w(n / 2);
+	const V a = ramp<V>(n / 2, 3, 1e-4);
+
+	vap::batch::graph g;
+	auto t = g.declare<double, typename V::exec>(n);
+
+	g.assign(t, x * y);
+	g.assign(u, t + vap::slice(z, 1, n));
+	g.assign(w, a * 3.0);
+	g.run();
+
+	const V T = x * y;
+	const V U = T + vap::slice(z, 1, n);
+	const V W = a * 3.0;
+
+	return std::max(difference(u, U), difference(w, W));
+}
+
+// An input changed between two runs: the repeated x + y is computed once per element,
+// and values of the first run must not be read back by the second one. The sizes leave
+// a partial packet and a scalar tail.
+template <typename V>
+double input_between_runs()
+{
+	using namespace vap::operators;
+
+	double error = 0;
+	for (const std::size_t N : { std::size_t(12), std::size_t(17), std::size_t(33), n })
+	{
+		V x = ramp<V>(N, 1, 1e-5);
+		const V y = ramp<V>(N, 2, -1e-5);
+		V u(N);
+
+		vap::batch::graph g;
+		g.assign(u, (x + y) * (x + y));
+		g.run();
+
+		x = ramp<V>(N, 10, 1e-3);
+		g.run();
+
+		const V U = (x + y) * (x + y);
+		error = std::max(error, difference(u, U));
+	}
+
+	return error;
+}
+
+// An intermediate narrower than its expression stores it like a vector of its type
+double narrow_local()
+{
+	using namespace vap::operators;
+
+	const V x = ramp<V>(n, 1, 1e-5), y = ramp<V>(n, 2, -1e-5);
+	F r(n);
+
+	vap::batch::graph g;
+	auto t = g.declare<float>(n);
+
+	g.assign(t, x * y);
+	g.assign(r, t + t);
+	g.run();
+
+	const F T = x * y;
+	const F R = T + T;
+
+	return difference(r, R);
+}
+
+int main()
+{
+	const double tolerance = 1e-12;
+
+	const double errors[] = {
+		read_after_write<V>(),	 read_after_write<PV>(),
+		write_after_read<V>(),	 write_after_read<PV>(),
+		local_across_passes<V>(), local_across_passes<PV>(),
+		input_between_runs<V>(),	 input_between_runs<PV>(),
+		narrow_local()
+	};
+
+	const char* names[] = {
+		"read after write", "read after write (parallel)",
+		"write after read", "write after read (parallel)",
+		"local across passes", "local across passes (parallel)",
+		"input between runs", "input between runs (parallel)",
+		"narrow local"
+	};
+
+	bool ok = true;
+	for (std::size_t k = 0; k < sizeof(errors) / sizeof(errors[0]); ++k)
+	{
+		std::cout << names[k] << ": " << errors[k] << endl;
+		ok = ok && errors[k] <= tolerance;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -1,6 +1,9 @@
 #pragma once
 
-#ifdef THRUST_DEVICE_SYSTEM
+// Thrust's CPU backends (THRUST_DEVICE_SYSTEM_OMP/TBB/CPP) are compiled by the host
+// compiler, which only sees __host__ and __device__ once a thrust header has been
+// included. Either include thrust before vap, or define VAP_USING_THRUST explicitly.
+#if defined(THRUST_DEVICE_SYSTEM) && !defined(VAP_USING_THRUST)
 #	ifdef __host__
 #		ifdef __device__
 #			define VAP_USING_THRUST
@@ -8,6 +11,14 @@
 #	endif
 #endif
 
+// vap::systems::tbb requires Intel TBB; define VAP_THRUST_TBB when it is available. It
+// is defined when thrust itself is built for TBB (THRUST_DEVICE_SYSTEM_TBB).
+#if defined(VAP_USING_THRUST) && defined(THRUST_DEVICE_SYSTEM_TBB) && !defined(VAP_THRUST_TBB)
+#	if THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_TBB
+#		define VAP_THRUST_TBB
+#	endif
+#endif
+
 // Provide __host__ __device__ preprocessor directives when available
 #ifdef VAP_USING_THRUST
 #	define ANY_SYSTEM __host__ __device__ 
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/traits.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+namespace vap	 {
+namespace detail {
+
+// How the storage read by an expression overlaps with the destination of an assignment
+// none:	the expression does not read the destination
+// exact:	element i of the destination is only read to compute element i, so the
+//			expression can be evaluated element-wise (or packet-wise) in place
+// partial:	other elements of the destination are read, a temporary is required
+enum class alias { none = 0, exact = 1, partial = 2 };
+
+inline alias worst(const alias a, const alias b)
+{ return a < b ? b : a; }
+
+// Addresses of the elements of a contiguous container or of a view (view.h): count
+// elements of size bytes, stride bytes apart
+struct extent
+{
+	const char*	   first;
+	std::ptrdiff_t stride;
+	std::size_t	   count;
+	std::size_t	   size;
+};
+
+template <class C>
+extent extent_of(const C& c, std::false_type)
+{
+	using T = typename C::value_type;
+	return extent{ reinterpret_cast<const char*>(c.data()), std::ptrdiff_t(sizeof(T)), c.size(), sizeof(T) };
+}
+
+template <class V>
+extent extent_of(const V& v, std::true_type)
+{
+	using T = typename V::value_type;
+	return extent{ reinterpret_cast<const char*>(v.data()), v.stride() * std::ptrdiff_t(sizeof(T)), v.size(), sizeof(T) };
+}
+
+template <class C>
+extent extent_of(const C& c) { return extent_of(c, is_view<C>()); }
+
+// The same elements in the same order overlap exactly; otherwise elements whose address
+// ranges meet are taken to overlap partially
+inline alias overlap(const extent& a, const extent& b)
+{
+	if (a.count == 0 || b.count == 0) return alias::none;
+	if (a.first == b.first && a.stride == b.stride && a.size == b.size) return alias::exact;
+
+	const char* a_last = a.first + std::ptrdiff_t(a.count - 1) * a.stride;
+	const char* b_last = b.first + std::ptrdiff_t(b.count - 1) * b.stride;
+
+	const char* a_low  = std::min(a.first, a_last);
+	const char* a_high = std::max(a.first, a_last) + a.size;
+	const char* b_low  = std::min(b.first, b_last);
+	const char* b_high = std::max(b.first, b_last) + b.size;
+
+	return a_low < b_high && b_low < a_high ? alias::partial : alias::none;
+}
+
+// aliasing<E>::may_read<C> tells at compile time whether an expression of type E can
+// read a container of type C; aliasing<E>::classify checks a given destination at
+// runtime. E is always the Derived type of an expression.
+// Unknown leaf types are assumed to overlap with every destination.
+template <class E>
+struct aliasing
+{
+	template <class C>
+	using may_read = std::true_type;
+
+	template <class C>
+	static alias classify(const C&, const E&) { return alias::partial; }
+};
+
+template <typename T>
+struct aliasing <expressions::Scalar<T>>
+{
+	template <class C>
+	using may_read = std::false_type;
+
+	template <class C>
+	static alias classify(const C&, const expressions::Scalar<T>&) { return alias::none; }
+};
+
+// A vector owns its container, so it overlaps with a container only if it is the
+// destination itself, and with a view only if the view is into its elements
+template <typename T, class Ctor, typename Container, class Exec>
+struct aliasing <expressions::vector<T, Ctor, Container, Exec>>
+{
+	template <class C>
+	using may_read = std::integral_constant<bool, std::is_same<C, Container>::value ||
+												  (is_view<C>::value && is_contiguous<Container>::value)>;
+
+	template <class C>
+	static alias classify(const C& destination, const Container& source, std::false_type)
+	{
+		return static_cast<const void*>(&source) == static_cast<const void*>(&destination) ? alias::exact : alias::none;
+	}
+
+	template <class C>
+	static alias classify(const C& destination, const Container& source, std::true_type)
+	{ return overlap(extent_of(destination), extent_of(source)); }
+
+	template <class C>
+	static alias classify(const C& destination, const expressions::vector<T, Ctor, Container, Exec>& leaf)
+	{ return classify(destination, static_cast<const Container&>(leaf), is_view<C>()); }
+};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct aliasing <expressions::Binary<L, R, Op, Exec, IsOp>>
+{
+	template <class C>
+	using may_read = std::integral_constant<bool,
+		aliasing<typename L::Derived>::template may_read<C>::value ||
+		aliasing<typename R::Derived>::template may_read<C>::value>;
+
+	template <class C>
+	static alias classify(const C& destination, const expressions::Binary<L, R, Op, Exec, IsOp>& e)
+	{
+		return worst(aliasing<typename L::Derived>::classify(destination, e.lhs()),
+					 aliasing<typename R::Derived>::classify(destination, e.rhs()));
+	}
+};
+
+template <typename T, class Op, class Exec, bool IsOp>
+struct aliasing <expressions::Unary<T, Op, Exec, IsOp>>
+{
+	template <class C>
+	using may_read = typename aliasing<typename T::Derived>::template may_read<C>;
+
+	template <class C>
+	static alias classify(const C& destination, const expressions::Unary<T, Op, Exec, IsOp>& e)
+	{ return aliasing<typename T::Derived>::classify(destination, e.operand()); }
+};
+
+// Classifies the overlap of expression e with the destination container c. The leaves
+// are only visited when the expression can read a container of type C at all.
+template <class C, class E>
+alias classify(const C& c, const E& e)
+{
+	using Derived = typename E::Derived;
+
+	return aliasing<Derived>::template may_read<C>::value ? aliasing<Derived>::classify(c, e)
+														  : alias::none;
+}
+
+} // end namespace detail
+} // end namespace vap
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vap/config.h>
+
+#include <cstddef>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#	include <vector>
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#	include <unistd.h>
+#endif
+
+namespace vap	 {
+namespace detail {
+
+// Sizes of the data caches of the CPU the process started on
+struct cache_sizes
+{
+	std::size_t l1;
+	std::size_t l2;
+};
+
+// Used when the operating system does not report a size
+static const std::size_t default_l1 = 32 * 1024;
+static const std::size_t default_l2 = 256 * 1024;
+
+inline cache_sizes detect_caches()
+{
+	cache_sizes sizes = { 0, 0 };
+
+#if defined(_WIN32)
+	DWORD bytes = 0;
+	GetLogicalProcessorInformation(nullptr, &bytes);
+
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(bytes / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!info.empty() && GetLogicalProcessorInformation(info.data(), &bytes))
+	{
+		for (const auto& i : info)
+		{
+			if (i.Relationship != RelationCache || i.Cache.Type == CacheInstruction) continue;
+
+			if (i.Cache.Level == 1) sizes.l1 = i.Cache.Size;
+			if (i.Cache.Level == 2) sizes.l2 = i.Cache.Size;
+		}
+	}
+#elif defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+	const long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+	const long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+
+	if (l1 > 0) sizes.l1 = static_cast<std::size_t>(l1);
+	if (l2 > 0) sizes.l2 = static_cast<std::size_t>(l2);
+#endif
+
+	if (sizes.l1 == 0) sizes.l1 = default_l1;
+	if (sizes.l2 == 0) sizes.l2 = default_l2;
+	return sizes;
+}
+
+// Detected once per process
+inline const cache_sizes& caches()
+{
+	static const cache_sizes sizes = detect_caches();
+	return sizes;
+}
+
+} // end namespace detail
+} // end namespace vap
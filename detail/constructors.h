@@ -1,13 +1,37 @@
+#pragma once
+
 #include <algorithm>
+#include <type_traits>
 
-#include <vap\config.h>
+#include <vap/config.h>
+#include <vap/execution_policy.h>
+#include <vap/detail/epoch.h>
+#include <vap/detail/thread_pool.h>
+#include <vap/simd/evaluate.h>
 
 #ifdef VAP_USING_THRUST
-#include <thrust\copy.h>
-#include <thrust\execution_policy.h>
+#include <thrust/copy.h>
+#include <thrust/execution_policy.h>
+#include <thrust/system/cpp/execution_policy.h>
+#include <thrust/system/omp/execution_policy.h>
+#	ifdef VAP_THRUST_TBB
+#	include <thrust/system/tbb/execution_policy.h>
+#	endif
 #endif
 
-namespace vap		   {
+namespace vap	 {
+namespace detail {
+
+// Told by constructors::Streaming each time a chunk of a destination container has
+// been evaluated, see mapped.h
+template <class C>
+struct stream_hooks
+{
+	static void written(C&, const std::size_t, const std::size_t) {}
+};
+
+} // end namespace detail
+
 namespace constructors {
 // This is the default constructor for the vector class below
 class Loop
@@ -16,6 +40,8 @@ protected:
 	template <class C, class E>
 	void ctor(C& c, const E& e)
 	{
+		vap::detail::next_epoch();
+
 		auto sz = e.size();
 		for (std::size_t i = 0; i < sz; ++i)
 			c[i] = e[i];
@@ -45,15 +71,128 @@ protected:
 	}
 };
 
-// thrust::copy ctor using expression iterators in parallel
-class Thrust
+// SIMD ctor: evaluates whole packets of the expression at a time with the widest
+// instruction set supported by the CPU, falling back to Expression::operator[]
+// for the tail and for expressions that cannot be vectorized
+class SIMD
+{
+protected:
+	template <class C, class E>
+	void ctor(C& c, const E& e)
+	{
+		vap::simd::evaluate(c, e, 0, e.size());
+	}
+
+	template <class C, class E>
+	void assignment(C &c, const E& e)
+	{
+		ctor(c, e);
+	}
+};
+
+// Multi-core ctor: the index range of the expression is split into chunks which
+// are evaluated with packets on the library's thread pool
+class Parallel
+{
+protected:
+	template <class C, class E>
+	void ctor(C& c, const E& e)
+	{
+		vap::detail::parallel_for(0, e.size(), vap::detail::parallel_grain, [&c, &e](const std::size_t first, const std::size_t last)
+		{
+			vap::simd::evaluate(c, e, first, last);
+		});
+	}
+
+	template <class C, class E>
+	void assignment(C &c, const E& e)
+	{
+		ctor(c, e);
+	}
+};
+
+// Out-of-core ctor: evaluates the expression in consecutive chunks of Chunk bytes of
+// output, each one with packets, and on the thread pool when Policy is
+// parallel_execution. Each chunk is handed to detail::stream_hooks once written, so
+// that a memory-mapped destination can write it back and release its pages before the
+// next one.
+template <class Policy = serial_execution, std::size_t Chunk = (std::size_t(4) << 20)>
+class Streaming
+{
+protected:
+	template <class C, class E>
+	void ctor(C& c, const E& e)
+	{
+		const std::size_t n		= e.size();
+		const std::size_t chunk = std::max<std::size_t>(Chunk / sizeof(typename C::value_type), 1);
+
+		for (std::size_t first = 0; first < n; first += chunk)
+		{
+			const std::size_t last = std::min(n, first + chunk);
+
+			if (std::is_same<Policy, parallel_execution>::value)
+			{
+				vap::detail::parallel_for(first, last, vap::detail::parallel_grain, [&c, &e](const std::size_t begin, const std::size_t end)
+				{
+					vap::simd::evaluate(c, e, begin, end);
+				});
+			}
+			else
+				vap::simd::evaluate(c, e, first, last);
+
+			vap::detail::stream_hooks<C>::written(c, first, last);
+		}
+	}
+
+	template <class C, class E>
+	void assignment(C &c, const E& e)
+	{
+		ctor(c, e);
+	}
+};
+
+#ifdef VAP_USING_THRUST
+namespace detail {
+
+// Maps a vap::systems tag onto the corresponding thrust execution policy
+template <class System>
+struct thrust_system {};
+
+template <>
+struct thrust_system <systems::device>
+{ static const decltype(thrust::device)& policy() { return thrust::device; } };
+
+template <>
+struct thrust_system <systems::host>
+{ static const decltype(thrust::host)& policy() { return thrust::host; } };
+
+template <>
+struct thrust_system <systems::cpp>
+{ static const decltype(thrust::cpp::par)& policy() { return thrust::cpp::par; } };
+
+template <>
+struct thrust_system <systems::omp>
+{ static const decltype(thrust::omp::par)& policy() { return thrust::omp::par; } };
+
+#	ifdef VAP_THRUST_TBB
+template <>
+struct thrust_system <systems::tbb>
+{ static const decltype(thrust::tbb::par)& policy() { return thrust::tbb::par; } };
+#	endif
+
+} // end namespace detail
+#endif
+
+// thrust::copy ctor using expression iterators in parallel on the given thrust system
+template <class System>
+class Thrust_System
 {
 protected:
 	template <class Container, class Exp>
 	void ctor(Container& c, const Exp& expression)
 	{
 #		ifdef VAP_USING_THRUST
-			thrust::copy(thrust::device, expression.cbegin(), expression.cend(), c.begin());
+			thrust::copy(detail::thrust_system<System>::policy(), expression.cbegin(), expression.cend(), c.begin());
 #		endif
 	}
 
@@ -62,5 +201,8 @@ protected:
 	{ ctor(c, e); }
 };
 
+// thrust::copy ctor on thrust::device
+using Thrust = Thrust_System<systems::device>;
+
 } // end namespace constructors
 } // end namespace vap
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vap/config.h>
+
+#include <cstddef>
+
+namespace vap	 {
+namespace detail {
+
+// Evaluations started on the calling thread. Values cached while an expression is
+// evaluated (see expressions/shared.h) belong to the epoch that computed them, so an
+// expression evaluated again, after its operands changed, does not read them back.
+inline std::size_t& epoch()
+{
+	static thread_local std::size_t current = 0;
+	return current;
+}
+
+// Starts an evaluation on the calling thread
+inline void next_epoch() { ++epoch(); }
+
+} // end namespace detail
+} // end namespace vap
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/thread_pool.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace vap	 {
+namespace detail {
+
+// Whether the elements of a container are left uninitialized by resize, so that the
+// vector owning it initializes them in parallel. Specialized for memory::numa_container
+// in allocator.h.
+template <class C>
+struct first_touch : std::false_type {};
+
+// Fills with the grain of the parallel constructors: for a range of n elements the thread
+// pool then hands the same chunks to the same workers, and each page is first touched by
+// the thread that later evaluates it
+template <class C, typename T>
+void parallel_fill(C& c, const std::size_t first, const std::size_t last, const T& value)
+{
+	auto* data = c.data();
+
+	parallel_for(first, last, parallel_grain, [data, &value](const std::size_t begin, const std::size_t end)
+	{
+		std::fill(data + begin, data + end, value);
+	});
+}
+
+// Resizes c to n elements, the first ones copied from c and the others set to value,
+// without touching the pages of a new block from a single thread
+template <class C, typename T>
+void touch_resize(C& c, const std::size_t n, const T& value)
+{
+	const std::size_t kept = std::min(c.size(), n);
+
+	if (n <= c.capacity())
+	{
+		c.resize(n);
+		if (n > kept) parallel_fill(c, kept, n, value);
+		return;
+	}
+
+	C fresh;
+	fresh.resize(n);
+
+	const auto* from = c.data();
+	auto*		to	 = fresh.data();
+
+	parallel_for(0, n, parallel_grain, [from, to, kept, &value](const std::size_t begin, const std::size_t end)
+	{
+		const std::size_t middle = std::max(begin, std::min(end, kept));
+
+		std::copy(from + begin, from + middle, to + begin);
+		std::fill(to + middle, to + end, value);
+	});
+
+	c.swap(fresh);
+}
+
+// Sets c to n copies of value
+template <class C, typename T>
+void touch_assign(C& c, const std::size_t n, const T& value)
+{
+	if (n > c.capacity())
+	{
+		C fresh;
+		c.swap(fresh);
+	}
+
+	c.resize(n);
+	parallel_fill(c, 0, n, value);
+}
+
+} // end namespace detail
+} // end namespace vap
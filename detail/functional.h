@@ -1,18 +1,22 @@
 #pragma once
 
 #include <cmath>
-#include <boost\tuple\tuple.hpp>
+#include <type_traits>
+#include <boost/tuple/tuple.hpp>
 
-#include <vap\config.h>
+#include <vap/config.h>
+#include <vap/detail/traits.h>
+#include <vap/simd/packet.h>
+#include <vap/simd/math.h>
 
 #ifdef VAP_USING_THRUST
-#include <thrust\tuple.h>
+#include <thrust/tuple.h>
 #endif
 
 
 namespace vap {
 
-enum { Arg1 = 0, Arg2 = 1, };
+enum { Arg1 = 0, Arg2 = 1, Arg3 = 2, };
 
 // Expands the arguments of a tuple into a binary functor
 template <class BinaryFunctor>
@@ -28,11 +32,92 @@ public:
 	ANY_SYSTEM
 	result_type operator () (const Tuple& args) const
 	{
-		using thrust::get;
+		IF_USING_THRUST(using thrust::get;)
+		NOT_USING_THRUST(using boost::get;)
 		return f(get<Arg1>(args), get<Arg2>(args));
 	}
+
+	// Packets are passed to the functor directly
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const
+	{
+		return f(x, y);
+	}
+};
+
+// Expands the arguments of a tuple into a ternary functor
+template <class TernaryFunctor>
+class apply_ternary
+{
+private:
+	TernaryFunctor f;
+
+public:
+	using result_type = typename TernaryFunctor::result_type;
+
+	template <class Tuple>
+	ANY_SYSTEM
+	result_type operator () (const Tuple& args) const
+	{
+		IF_USING_THRUST(using thrust::get;)
+		NOT_USING_THRUST(using boost::get;)
+		return f(get<Arg1>(args), get<Arg2>(args), get<Arg3>(args));
+	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y, const Packet& z) const
+	{
+		return f(x, y, z);
+	}
+};
+
+namespace detail {
+
+template <typename T>
+ANY_SYSTEM
+std::enable_if_t<std::is_arithmetic<T>::value, T> one(const T&) { return T(1); }
+
+template <class Packet>
+simd::enable_if_packet_t<Packet> one(const Packet&) { return Packet::broadcast(1); }
+
+// x^N for N > 0 by repeated squaring, unrolled at compile time
+template <unsigned long N>
+struct multiply_chain
+{
+	template <typename X>
+	ANY_SYSTEM
+	static X apply(const X& x)
+	{
+		const X half = multiply_chain<N / 2>::apply(x);
+		return N % 2 ? half * half * x : half * half;
+	}
+};
+
+template <>
+struct multiply_chain <1>
+{
+	template <typename X>
+	ANY_SYSTEM
+	static X apply(const X& x) { return x; }
 };
 
+// x^n for a runtime n > 0 by repeated squaring
+template <typename X>
+ANY_SYSTEM
+X multiply_loop(X x, unsigned long n)
+{
+	X result = one(x);
+
+	for (;;)
+	{
+		if (n & 1) result = result * x;
+		if ((n >>= 1) == 0) return result;
+		x = x * x;
+	}
+}
+
+} // end namespace detail
+
 // Binary operator functors 
 template <typename T>
 struct sum
@@ -44,6 +129,12 @@ struct sum
 	{ 
 		return x + y;
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const
+	{
+		return x + y;
+	}
 };
 
 template <typename T>
@@ -56,6 +147,12 @@ struct difference
 	{
 		return x - y;
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const
+	{
+		return x - y;
+	}
 };
 
 
@@ -69,6 +166,12 @@ struct product
 	{
 		return x * y;
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const
+	{
+		return x * y;
+	}
 };
 
 
@@ -82,10 +185,17 @@ struct quotient
 	{
 		return x / y;
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const
+	{
+		return x / y;
+	}
 };
 
 
-template <typename T>
+// The accuracy tier only applies to packets, see vap::accuracy
+template <typename T, class Accuracy = accuracy::default_tier>
 struct power
 {
 	using result_type = T;
@@ -95,10 +205,36 @@ struct power
 	{
 		return pow(x, y);
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const
+	{
+		return simd::pow(x, y, Accuracy());
+	}
 };
 
-// Unary operator functors
+// Ternary operator functors
+// x * y + z with a single rounding, created by the rewrite pass from a * b + c
 template <typename T>
+struct fused_multiply_add
+{
+	using result_type = T;
+
+	ANY_SYSTEM
+	T operator () (const T& x, const T& y, const T& z) const
+	{
+		return fma(x, y, z);
+	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y, const Packet& z) const
+	{
+		return Packet::fma(x, y, z);
+	}
+};
+
+// Unary operator functors, the accuracy tier only applies to packets
+template <typename T, class Accuracy = accuracy::default_tier>
 struct sin
 {
 	using result_type = T;
@@ -108,9 +244,15 @@ struct sin
 	{
 		return std::sin(value);
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& value) const
+	{
+		return simd::sin(value, Accuracy());
+	}
 };
 
-template <typename T>
+template <typename T, class Accuracy = accuracy::default_tier>
 struct cos
 {
 	using result_type = T;
@@ -120,9 +262,15 @@ struct cos
 	{
 		return std::cos(value);
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& value) const
+	{
+		return simd::cos(value, Accuracy());
+	}
 };
 
-template <typename T>
+template <typename T, class Accuracy = accuracy::default_tier>
 struct tan
 {
 	using result_type = T;
@@ -132,9 +280,15 @@ struct tan
 	{
 		return std::tan(value);
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& value) const
+	{
+		return simd::tan(value, Accuracy());
+	}
 };
 
-template <typename T>
+template <typename T, class Accuracy = accuracy::default_tier>
 struct log
 {
 	using result_type = T;
@@ -144,6 +298,100 @@ struct log
 	{
 		return std::log(value);
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& value) const
+	{
+		return simd::log(value, Accuracy());
+	}
+};
+
+// x^(Num / Den) for a compile-time exponent, as a chain of multiplications after a
+// square root when Den is 2. Created by the rewrite pass from x ^ vap::constant<Num, Den>().
+template <typename T, long Num, long Den = 1>
+struct constant_power
+{
+	static_assert(Num != 0 && (Den == 1 || Den == 2), "constant_power: Exponent must be a non-zero integer or half-integer");
+
+	using result_type = T;
+
+	template <typename X>
+	ANY_SYSTEM
+	static X root(const X& x, std::integral_constant<bool, false>) { return x; }
+
+	ANY_SYSTEM
+	static T root(const T& x, std::integral_constant<bool, true>) { return sqrt(x); }
+
+	template <class Packet>
+	static simd::enable_if_packet_t<Packet> root(const Packet& x, std::integral_constant<bool, true>) { return Packet::sqrt(x); }
+
+	template <typename X>
+	ANY_SYSTEM
+	static X evaluate(const X& x)
+	{
+		const X r = detail::multiply_chain<(Num < 0 ? -Num : Num)>::apply(root(x, std::integral_constant<bool, Den == 2>()));
+		return Num < 0 ? detail::one(x) / r : r;
+	}
+
+	ANY_SYSTEM
+	T operator () (const T& value) const
+	{
+		return evaluate(value);
+	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& value) const
+	{
+		return evaluate(value);
+	}
+};
+
+// x^y for an exponent y known when the expression is rewritten. Integers and halves of
+// integers up to max_exponent in magnitude use a square root and repeated squaring
+// (within a few ulp of pow); other exponents are passed on to vap::power.
+template <typename T>
+struct scalar_power
+{
+	using result_type = T;
+
+	static const long max_exponent = 32;
+
+	T	 y;
+	long twice; // 2y when the exponent is handled with multiplications, 0 otherwise
+
+	scalar_power() : y(1), twice(2) {}
+
+	explicit scalar_power(const T& exponent) : y(exponent), twice(0)
+	{
+		const T doubled = exponent + exponent;
+
+		if (doubled == static_cast<T>(static_cast<long>(doubled)) && doubled != 0 &&
+			doubled <= 2 * max_exponent && doubled >= -2 * max_exponent)
+			twice = static_cast<long>(doubled);
+	}
+
+	template <typename X>
+	ANY_SYSTEM
+	X evaluate(const X& x, const X& root) const
+	{
+		const unsigned long n = static_cast<unsigned long>(twice < 0 ? -twice : twice);
+		const X r = n % 2 ? detail::multiply_loop(root, n) : detail::multiply_loop(x, n / 2);
+		return twice < 0 ? detail::one(x) / r : r;
+	}
+
+	ANY_SYSTEM
+	T operator () (const T& value) const
+	{
+		if (twice == 0) return pow(value, y);
+		return evaluate(value, twice % 2 ? sqrt(value) : value);
+	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& value) const
+	{
+		if (twice == 0) return power<T>()(value, Packet::broadcast(y));
+		return evaluate(value, twice % 2 ? Packet::sqrt(value) : value);
+	}
 };
 
 template <typename T>
@@ -156,6 +404,70 @@ struct negate
 	{
 		return -(value);
 	}
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& value) const
+	{
+		return -(value);
+	}
 };
 
+namespace detail {
+
+// Operation counts of the functors above, for expression_traits
+
+template <class F>
+struct op_cost <apply<F>> : op_cost<F> {};
+
+template <class F>
+struct op_cost <apply_ternary<F>> : op_cost<F> {};
+
+template <typename T>
+struct op_cost <fused_multiply_add<T>>
+{
+	static const std::size_t flops			 = 2;
+	static const std::size_t transcendentals = 0;
+};
+
+struct transcendental
+{
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 1;
+};
+
+template <typename T, class Accuracy>
+struct op_cost <power<T, Accuracy>> : transcendental {};
+
+template <typename T, class Accuracy>
+struct op_cost <sin<T, Accuracy>> : transcendental {};
+
+template <typename T, class Accuracy>
+struct op_cost <cos<T, Accuracy>> : transcendental {};
+
+template <typename T, class Accuracy>
+struct op_cost <tan<T, Accuracy>> : transcendental {};
+
+template <typename T, class Accuracy>
+struct op_cost <log<T, Accuracy>> : transcendental {};
+
+// Multiplications of multiply_chain<N>
+constexpr std::size_t chain_length(const unsigned long n)
+{
+	return n <= 1 ? 0 : chain_length(n / 2) + (n % 2 ? 2 : 1);
+}
+
+// The square root counts as one operation, and so does the division of a negative exponent
+template <typename T, long Num, long Den>
+struct op_cost <constant_power<T, Num, Den>>
+{
+	static const std::size_t flops			 = chain_length(Num < 0 ? -Num : Num) + (Den == 2 ? 1 : 0) + (Num < 0 ? 1 : 0);
+	static const std::size_t transcendentals = 0;
+};
+
+// The exponent is only known at run time; counted as a call to pow
+template <typename T>
+struct op_cost <scalar_power<T>> : transcendental {};
+
+} // end namespace detail
+
 } // end namespace vap
\ No newline at end of file
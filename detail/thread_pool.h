@@ -0,0 +1,367 @@
+#pragma once
+
+#include <vap/config.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#	include <pthread.h>
+#	include <sched.h>
+#endif
+
+namespace vap	 {
+namespace detail {
+
+// Persistent work-stealing thread pool owned by the library.
+// Each worker owns a deque of range tasks: it pops work from the back of its own
+// deque and steals from the front of the others when it runs dry. The thread that
+// submits a job does not block, it helps execute tasks until its job has completed.
+// This allows nested parallel_for calls from inside a task without deadlocking.
+class thread_pool
+{
+private:
+	// Type-erased body of a parallel_for or submit call
+	struct job
+	{
+		std::atomic<std::size_t> remaining;
+		std::exception_ptr		 error;
+		std::mutex				 error_mutex;
+
+		job(const std::size_t tasks) : remaining(tasks) {}
+		virtual ~job() {}
+
+		virtual void run(const std::size_t first, const std::size_t last) = 0;
+
+		// Called once a task of the job has run
+		virtual void finished() { remaining.fetch_sub(1, std::memory_order_acq_rel); }
+	};
+
+	template <class Function>
+	struct job_for : job
+	{
+		Function& f;
+
+		job_for(Function& function, const std::size_t tasks) : job(tasks), f(function) {}
+
+		void run(const std::size_t first, const std::size_t last) override
+		{ f(first, last); }
+	};
+
+	// A job of submit: nobody waits for it, it owns its function and deletes itself
+	template <class Function>
+	struct detached_job : job
+	{
+		Function f;
+
+		detached_job(Function&& function) : job(1), f(std::move(function)) {}
+
+		void run(const std::size_t, const std::size_t) override { f(); }
+		void finished() override { delete this; }
+	};
+
+	// A task is a sub-range of a job; it does not allocate
+	struct task
+	{
+		job*		owner;
+		std::size_t first;
+		std::size_t last;
+	};
+
+	struct queue
+	{
+		std::mutex		 mutex;
+		std::deque<task> tasks;
+	};
+
+	std::vector<std::unique_ptr<queue>> queues;
+	std::vector<std::thread>			workers;
+
+	std::atomic<std::size_t> queued;
+	std::atomic<std::size_t> next_queue;
+
+	std::mutex				sleep_mutex;
+	std::condition_variable sleep_cv;
+	bool					stopping;
+
+	void push(const std::size_t index, const task& t)
+	{
+		{
+			std::lock_guard<std::mutex> lock(queues[index]->mutex);
+			queues[index]->tasks.push_back(t);
+		}
+
+		queued.fetch_add(1, std::memory_order_release);
+	}
+
+	// Owner end of the deque (LIFO keeps the most recent, cache-hot range local)
+	bool pop(const std::size_t index, task& t)
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+
+		if (queues[index]->tasks.empty()) return false;
+
+		t = queues[index]->tasks.back();
+		queues[index]->tasks.pop_back();
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Thief end of the deque, visiting the victims starting after start
+	bool steal(const std::size_t start, task& t)
+	{
+		const std::size_t n = queues.size();
+
+		for (std::size_t k = 1; k <= n; ++k)
+		{
+			queue& victim = *queues[(start + k) % n];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+
+			if (victim.tasks.empty()) continue;
+
+			t = victim.tasks.front();
+			victim.tasks.pop_front();
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		return false;
+	}
+
+	static void execute(const task& t)
+	{
+		try
+		{
+			t.owner->run(t.first, t.last);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(t.owner->error_mutex);
+			if (!t.owner->error) t.owner->error = std::current_exception();
+		}
+
+		t.owner->finished();
+	}
+
+	void worker_loop(const std::size_t index)
+	{
+		task t;
+
+		for (;;)
+		{
+			if (pop(index, t) || steal(index, t))
+			{
+				execute(t);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleep_mutex);
+			sleep_cv.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+
+			if (stopping && queued.load(std::memory_order_acquire) == 0) return;
+		}
+	}
+
+	static std::size_t default_concurrency()
+	{
+		// Allow the thread count to be overriden by the environment
+		if (const char* env = std::getenv("VAP_NUM_THREADS"))
+		{
+			const long n = std::atol(env);
+			if (n > 0) return static_cast<std::size_t>(n);
+		}
+
+		const std::size_t hardware = std::thread::hardware_concurrency();
+		return hardware > 0 ? hardware : 1;
+	}
+
+	// With VAP_PIN_THREADS=1, worker i runs on the (i + 1)-th processor the process may
+	// use (the caller keeps the first one), so that the pages a worker touches first stay
+	// on its NUMA node
+	static bool pinning()
+	{
+		const char* env = std::getenv("VAP_PIN_THREADS");
+		return env && std::atoi(env) != 0;
+	}
+
+	static void pin(std::thread& worker, const std::size_t index)
+	{
+#	if defined(__linux__)
+		cpu_set_t allowed;
+		if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+
+		const int count = CPU_COUNT(&allowed);
+		if (count == 0) return;
+
+		int wanted = static_cast<int>((index + 1) % count);
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (!CPU_ISSET(cpu, &allowed) || wanted-- > 0) continue;
+
+			cpu_set_t one;
+			CPU_ZERO(&one);
+			CPU_SET(cpu, &one);
+			pthread_setaffinity_np(worker.native_handle(), sizeof(one), &one);
+			return;
+		}
+#	else
+		(void) worker;
+		(void) index;
+#	endif
+	}
+
+public:
+	// The calling thread counts towards the concurrency, so n - 1 workers are spawned
+	explicit thread_pool(const std::size_t concurrency = default_concurrency()) :
+		queued(0), next_queue(0), stopping(false)
+	{
+		const std::size_t n = std::max<std::size_t>(concurrency, 1) - 1;
+
+		for (std::size_t i = 0; i < n; ++i)
+			queues.emplace_back(new queue);
+
+		for (std::size_t i = 0; i < n; ++i)
+			workers.emplace_back([this, i] { worker_loop(i); });
+
+		if (pinning())
+			for (std::size_t i = 0; i < n; ++i)
+				pin(workers[i], i);
+	}
+
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+			stopping = true;
+		}
+
+		sleep_cv.notify_all();
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator = (const thread_pool&) = delete;
+
+	// The library-wide pool, created on first use and kept alive until exit
+	static thread_pool& instance()
+	{
+		static thread_pool pool;
+		return pool;
+	}
+
+	// Number of threads taking part in a parallel_for, including the caller
+	std::size_t concurrency() const { return workers.size() + 1; }
+
+	// Split [first, last) into chunks of at least grain elements and call f(begin, end)
+	// on each chunk concurrently. Returns once every chunk has completed; the first
+	// exception thrown by f is rethrown here.
+	template <class Function>
+	void parallel_for(const std::size_t first, const std::size_t last, std::size_t grain, Function&& f)
+	{
+		if (last <= first) return;
+
+		const std::size_t n = last - first;
+		grain = std::max<std::size_t>(grain, 1);
+
+		// Over-decompose so that stealing can balance uneven chunks
+		const std::size_t max_chunks = 4 * concurrency();
+		const std::size_t chunks	 = std::min((n + grain - 1) / grain, max_chunks);
+
+		if (chunks <= 1 || workers.empty())
+		{
+			f(first, last);
+			return;
+		}
+
+		job_for<Function> body(f, chunks);
+
+		// Deal contiguous chunks round-robin. A job with a chunk for every queue starts at
+		// the first one, so that jobs over the same range hand the same chunks to the same
+		// workers (see detail/first_touch.h); smaller jobs start at a rotating queue.
+		const std::size_t base  = n / chunks;
+		const std::size_t extra = n % chunks;
+		const std::size_t start = chunks >= queues.size() ? 0 : next_queue.fetch_add(1, std::memory_order_relaxed);
+
+		std::size_t begin = first;
+		for (std::size_t k = 0; k < chunks; ++k)
+		{
+			const std::size_t end = begin + base + (k < extra ? 1 : 0);
+			push((start + k) % queues.size(), task{ &body, begin, end });
+			begin = end;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+		}
+		sleep_cv.notify_all();
+
+		// Help out until every chunk of this job is done
+		task t;
+		while (body.remaining.load(std::memory_order_acquire) != 0)
+		{
+			if (steal(start, t)) execute(t);
+			else				 std::this_thread::yield();
+		}
+
+		if (body.error) std::rethrow_exception(body.error);
+	}
+
+	// Queues f() to run on a worker and returns at once, or runs it on the calling thread
+	// if the pool has no workers. f must not throw; its own parallel_for calls are nested
+	// jobs like any other.
+	template <class Function>
+	void submit(Function f)
+	{
+		if (workers.empty())
+		{
+			f();
+			return;
+		}
+
+		job* body = new detached_job<Function>(std::move(f));
+		push(next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size(), task{ body, 0, 1 });
+
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex);
+		}
+		sleep_cv.notify_all();
+	}
+
+	// Runs one queued task on the calling thread, if there is one. Lets a thread that
+	// waits for a submitted job help instead of blocking.
+	bool help()
+	{
+		if (queues.empty()) return false;
+
+		task t;
+		if (!steal(next_queue.load(std::memory_order_relaxed) % queues.size(), t)) return false;
+
+		execute(t);
+		return true;
+	}
+};
+
+// Smallest number of elements worth handing to another thread. Evaluations over the
+// same range with this grain split it into the same chunks (see detail/first_touch.h).
+static const std::size_t parallel_grain = 1 << 14;
+
+// Convenience wrapper around the library-wide pool
+template <class Function>
+void parallel_for(const std::size_t first, const std::size_t last, const std::size_t grain, Function&& f)
+{
+	thread_pool::instance().parallel_for(first, last, grain, std::forward<Function>(f));
+}
+
+} // end namespace detail
+} // end namespace vap
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <type_traits>
+#include <vector>
 
-#include <vap\iterators\iterators.h>
-#include <vap\execution_policy.h>
+#include <vap/iterators/iterators.h>
+#include <vap/execution_policy.h>
 
 namespace vap		  {
 namespace expressions {
@@ -15,17 +18,33 @@ class Expression;
 template <typename, typename, class, class, bool>
 class Binary;
 
+template <typename, typename, typename, class, class, bool>
+class Ternary;
+
 template <typename, class, class, bool>
 class Unary;
 
 template <typename>
 class Scalar;
 
+template <typename, long, long>
+class Constant;
+
 template <typename, typename, typename, typename>
 class vector;
 
+template <typename, class>
+class view;
+
+template <typename, class>
+class sparse_vector;
+
 } // end namespace expressions
 
+// Compile-time constant Num / Den, see expressions::Constant
+template <long Num, long Den = 1>
+struct constant {};
+
 namespace detail {
 
 
@@ -39,6 +58,32 @@ namespace detail {
 //template <typename Class>
 //struct is_expression : std::false_type{};
 
+// Type in which elements stored as T are computed: T itself, except for the storage
+// types of precision.h (half, bfloat16), which specialize it
+template <typename T>
+struct compute_type
+{
+	using type = T;
+};
+
+template <typename T>
+using compute_t = typename compute_type<T>::type;
+
+// Types vectors may store: numbers, and the storage types of precision.h
+template <typename T>
+struct is_storage : std::is_arithmetic<T> {};
+
+// Value type of an operation on elements of the given types: the usual arithmetic
+// conversions of their compute types, so float * double is computed in double
+template <typename... Ts>
+struct promote
+{
+	using type = std::common_type_t<compute_t<Ts>...>;
+};
+
+template <typename... Ts>
+using promote_t = typename promote<Ts...>::type;
+
 // Convert the given type to a Scalar<T>, if it is not an arithmetic type.
 template <typename T>
 using vectorize = std::conditional<std::is_arithmetic<T>::value, 
@@ -48,6 +93,47 @@ using vectorize = std::conditional<std::is_arithmetic<T>::value,
 template <typename T>
 using vectorize_t = typename vectorize<T>::type;
 
+// Type in which a number of type T combined with elements of type E is broadcast: the
+// compute type of E when it is floating point, so that 2.0 * x stays in the precision
+// of x; otherwise the usual promotion, so that 0.5 * i is not truncated to an integer.
+template <typename T, typename E>
+using number_t = std::conditional_t<std::is_floating_point<compute_t<E>>::value, compute_t<E>, promote_t<T, E>>;
+
+// Numbers combined with an expression are broadcast as a Scalar of number_t. Expressions
+// are left as is.
+template <typename T, 
+		  typename Other,
+		  bool = std::is_arithmetic<T>::value,
+		  bool = std::is_arithmetic<Other>::value>
+struct broadcast
+{
+	using type = T;
+};
+
+template <typename T, typename Other>
+struct broadcast <T, Other, true, false>
+{
+	using type = expressions::Scalar<number_t<T, typename Other::value_type>>;
+};
+
+template <typename T, typename Other>
+struct broadcast <T, Other, true, true>
+{
+	using type = expressions::Scalar<T>;
+};
+
+// Fractions combined with integers are computed in double, like 0.5 * i
+template <long Num, long Den, typename Other>
+struct broadcast <vap::constant<Num, Den>, Other, false, false>
+{
+	using type = expressions::Constant<std::conditional_t<Den == 1,
+														  compute_t<typename Other::value_type>,
+														  number_t<double, typename Other::value_type>>, Num, Den>;
+};
+
+template <typename T, typename Other>
+using broadcast_t = typename broadcast<T, Other>::type;
+
 // General case: To is not a number type
 // Behaviour: The wrapper acts as the identity function
 template <typename To>
@@ -65,15 +151,16 @@ private:
 };
 
 // Scalar<T> case: To is a number type
-// Behaviour: The number lhs is wrapped in Scalar<T> with the correct dimensions
+// Behaviour: The number lhs is wrapped in Scalar<T> with the dimensions of rhs. The
+// Scalar stores only the number, however large rhs is.
 template <typename T>
 class wrap_number <expressions::Scalar<T>>
 {
 public:
 	using To = expressions::Scalar<T>;
 
-	template <typename Other>
-	wrap_number(const T& lhs, const Other& rhs) : wrapper(lhs, rhs.size()) {}
+	template <typename Number, typename Other>
+	wrap_number(const Number& lhs, const Other& rhs) : wrapper(static_cast<T>(lhs), rhs.size()) {}
 
 	operator To () const
 	{ return this->wrapper; }
@@ -82,6 +169,60 @@ private:
 	To wrapper;
 };
 
+// Constant<T, Num, Den> case: the value is part of the type
+template <typename T, long Num, long Den>
+class wrap_number <expressions::Constant<T, Num, Den>>
+{
+public:
+	using To = expressions::Constant<T, Num, Den>;
+
+	template <typename Number, typename Other>
+	wrap_number(const Number&, const Other& rhs) : wrapper(rhs.size()) {}
+
+	operator To () const
+	{ return this->wrapper; }
+
+private:
+	To wrapper;
+};
+
+// Expression nodes store their operands by value: sub-expressions and scalars are a
+// few pointers and numbers, and are usually temporaries that do not outlive the
+// operator call that created them. Vectors own their elements and are referenced.
+template <typename T>
+struct operand
+{
+	using type = T;
+};
+
+template <typename T, class Ctor, typename C, class Exec>
+struct operand <expressions::vector<T, Ctor, C, Exec>>
+{
+	using type = const expressions::vector<T, Ctor, C, Exec>&;
+};
+
+template <typename T, class Exec>
+struct operand <expressions::sparse_vector<T, Exec>>
+{
+	using type = const expressions::sparse_vector<T, Exec>&;
+};
+
+template <typename T>
+using operand_t = typename operand<T>::type;
+
+// Container holding the elements of a vector
+template <class V>
+struct container_of;
+
+template <typename T, class Ctor, typename C, class Exec>
+struct container_of <expressions::vector<T, Ctor, C, Exec>>
+{
+	using type = C;
+};
+
+template <class V>
+using container_t = typename container_of<V>::type;
+
 template <typename Check>
 struct is_exec : std::is_base_of<execution_policy, Check>{};
     
@@ -155,6 +296,48 @@ struct compatible_execs
 							  std::is_same<Exec1, Exec2>::value;
 };
 
+// Containers whose elements are stored contiguously in host memory can be
+// loaded and stored in SIMD packets
+template <typename Container>
+struct is_contiguous : std::false_type {};
+
+template <typename T, typename Allocator>
+struct is_contiguous <std::vector<T, Allocator>> : std::true_type {};
+
+template <typename T, std::size_t N>
+struct is_contiguous <std::array<T, N>> : std::true_type {};
+
+// Views of strided elements, see view.h
+template <class C>
+struct is_view : std::false_type {};
+
+template <typename T, class Exec>
+struct is_view <expressions::view<T, Exec>> : std::true_type {};
+
+// Expressions with sparse_vector leaves, which vectors evaluate without visiting the
+// zeros of the leaves (see sparse.h). E is the Derived type of an expression.
+template <class E>
+struct has_sparse : std::false_type {};
+
+template <typename T, class Exec>
+struct has_sparse <expressions::sparse_vector<T, Exec>> : std::true_type {};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct has_sparse <expressions::Binary<L, R, Op, Exec, IsOp>> :
+	std::integral_constant<bool, has_sparse<typename L::Derived>::value || has_sparse<typename R::Derived>::value> {};
+
+template <typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct has_sparse <expressions::Ternary<A, B, C, Op, Exec, IsOp>> :
+	std::integral_constant<bool, has_sparse<typename A::Derived>::value || has_sparse<typename B::Derived>::value ||
+								 has_sparse<typename C::Derived>::value> {};
+
+template <typename U, class Op, class Exec, bool IsOp>
+struct has_sparse <expressions::Unary<U, Op, Exec, IsOp>> : has_sparse<typename U::Derived> {};
+
+// Evaluation of expressions with sparse leaves into vectors, defined in sparse.h
+template <class E>
+struct sparse_evaluation;
+
 template <typename Type, Type x, Type y>
 struct max
 {
@@ -171,6 +354,15 @@ struct min
 template <class Check>
 struct is_expression;
 
+// Arithmetic operations and transcendental calls of one application of an operator
+// functor, for the cost members of expression_traits. Specialized in detail/functional.h.
+template <class Op>
+struct op_cost
+{
+	static const std::size_t flops			 = 1;
+	static const std::size_t transcendentals = 0;
+};
+
 } // end namespace detail
 
 namespace expressions {
@@ -181,6 +373,15 @@ struct expression_traits
 	static const bool is_operator = false;
 };
 
+// The packets of a node are computed from packets of its operands in the value type of
+// the node. That is exact for a leaf, whose elements are converted as they are loaded,
+// but an operation must already compute in that type for its packets to match its
+// elements.
+template <class Operand, typename T>
+struct packs_into : std::integral_constant<bool,
+	expression_traits<typename Operand::Derived>::packet_access &&
+	(expression_traits<typename Operand::Derived>::depth == 0 || std::is_same<typename Operand::value_type, T>::value)> {};
+
 // Defines expression_traits for derived specialization Binary
 template <typename L, typename R, class Op, class Exec, bool Is_Operator>
 class expression_traits<vap::expressions::Binary<L, R, Op, Exec, Is_Operator>>
@@ -196,6 +397,24 @@ public:
 
 	static const bool is_operator = Is_Operator;
 
+	// Packet evaluation is possible when both operands support it
+	static const bool packet_access = packs_into<L, vap::detail::promote_t<typename L::value_type, typename R::value_type>>::value &&
+									  packs_into<R, vap::detail::promote_t<typename L::value_type, typename R::value_type>>::value;
+
+	// Cost per element: leaf loads and the bytes they read, arithmetic operations,
+	// transcendental calls and the height of the tree (see expressions/cost.h)
+	static const std::size_t loads			 = expression_traits<typename L::Derived>::loads +
+											   expression_traits<typename R::Derived>::loads;
+	static const std::size_t bytes			 = expression_traits<typename L::Derived>::bytes +
+											   expression_traits<typename R::Derived>::bytes;
+	static const std::size_t flops			 = expression_traits<typename L::Derived>::flops +
+											   expression_traits<typename R::Derived>::flops + vap::detail::op_cost<Op>::flops;
+	static const std::size_t transcendentals = expression_traits<typename L::Derived>::transcendentals +
+											   expression_traits<typename R::Derived>::transcendentals + vap::detail::op_cost<Op>::transcendentals;
+	static const std::size_t depth			 = 1 + vap::detail::max<std::size_t,
+														expression_traits<typename L::Derived>::depth,
+														expression_traits<typename R::Derived>::depth>::value;
+
 private:
 	using left_iterator		   = typename L::iterator;
 	using left_const_iterator  = typename L::const_iterator;
@@ -205,7 +424,7 @@ private:
 
 public:
 	using exec		 = typename detail::get_strongest_exec<Exec, typename L::exec, typename R::exec>::type;
-	using value_type = typename L::value_type;
+	using value_type = vap::detail::promote_t<typename L::value_type, typename R::value_type>;
 
 	// Retrieve binary_iterator specialization type for the given execution policy
 	using iterator	= typename iterators
@@ -219,6 +438,55 @@ public:
 
 };
 
+// Defines expression_traits for derived specialization Ternary
+template <typename A, typename B, typename C, class Op, class Exec, bool Is_Operator>
+class expression_traits<vap::expressions::Ternary<A, B, C, Op, Exec, Is_Operator>>
+{
+public:
+	static_assert(
+		vap::detail::is_expression<A>::value && vap::detail::is_expression<B>::value && vap::detail::is_expression<C>::value,
+		"Ternary Traits: Operand types must be expressions");
+
+	static_assert(
+		vap::detail::is_exec<Exec>::value,
+		"Ternary Traits: Invalid execution policy");
+
+	static const bool is_operator = Is_Operator;
+
+	static const bool packet_access =
+		packs_into<A, vap::detail::promote_t<typename A::value_type, typename B::value_type, typename C::value_type>>::value &&
+		packs_into<B, vap::detail::promote_t<typename A::value_type, typename B::value_type, typename C::value_type>>::value &&
+		packs_into<C, vap::detail::promote_t<typename A::value_type, typename B::value_type, typename C::value_type>>::value;
+
+	static const std::size_t loads			 = expression_traits<typename A::Derived>::loads +
+											   expression_traits<typename B::Derived>::loads +
+											   expression_traits<typename C::Derived>::loads;
+	static const std::size_t bytes			 = expression_traits<typename A::Derived>::bytes +
+											   expression_traits<typename B::Derived>::bytes +
+											   expression_traits<typename C::Derived>::bytes;
+	static const std::size_t flops			 = expression_traits<typename A::Derived>::flops +
+											   expression_traits<typename B::Derived>::flops +
+											   expression_traits<typename C::Derived>::flops + vap::detail::op_cost<Op>::flops;
+	static const std::size_t transcendentals = expression_traits<typename A::Derived>::transcendentals +
+											   expression_traits<typename B::Derived>::transcendentals +
+											   expression_traits<typename C::Derived>::transcendentals + vap::detail::op_cost<Op>::transcendentals;
+	static const std::size_t depth			 = 1 + vap::detail::max<std::size_t, expression_traits<typename A::Derived>::depth,
+														vap::detail::max<std::size_t,
+															expression_traits<typename B::Derived>::depth,
+															expression_traits<typename C::Derived>::depth>::value>::value;
+
+	using exec		 = typename detail::get_strongest_exec<Exec, typename A::exec, typename B::exec, typename C::exec>::type;
+	using value_type = vap::detail::promote_t<typename A::value_type, typename B::value_type, typename C::value_type>;
+
+	using iterator = typename iterators
+		  ::ternary_iterator<exec>
+		  ::template type<Op, typename A::iterator, typename B::iterator, typename C::iterator>;
+
+	using const_iterator = typename iterators
+		  ::ternary_iterator<exec>
+		  ::template type<Op, typename A::const_iterator, typename B::const_iterator, typename C::const_iterator>;
+};
+
 // Defines expression_traits for derived specialization Unary
 template <typename T, class Op, class Exec, bool IsOp>
 class expression_traits<vap::expressions::Unary<T, Op, Exec, IsOp>>
@@ -234,13 +502,21 @@ public:
 
 	static const bool is_operator = IsOp;
 
+	static const bool packet_access = packs_into<T, vap::detail::compute_t<typename T::value_type>>::value;
+
+	static const std::size_t loads			 = expression_traits<typename T::Derived>::loads;
+	static const std::size_t bytes			 = expression_traits<typename T::Derived>::bytes;
+	static const std::size_t flops			 = expression_traits<typename T::Derived>::flops + vap::detail::op_cost<Op>::flops;
+	static const std::size_t transcendentals = expression_traits<typename T::Derived>::transcendentals + vap::detail::op_cost<Op>::transcendentals;
+	static const std::size_t depth			 = 1 + expression_traits<typename T::Derived>::depth;
+
 private:
 	using base_iterator		  = typename T::iterator;
 	using const_base_iterator = typename T::const_iterator;
 
 public:
 	using exec				  = typename detail::get_strongest_exec<Exec, typename T::exec>::type;
-	using value_type		  = typename T::value_type;
+	using value_type		  = vap::detail::compute_t<typename T::value_type>;
 
 	using iterator = typename iterators
 		  ::unary_iterator<exec>
@@ -262,6 +538,16 @@ struct expression_traits<vap::expressions::Scalar<T>>
 
 	static const bool is_operator = false;
 
+	// Scalars are broadcast into every lane of a packet
+	static const bool packet_access = true;
+
+	// Scalars are kept in registers
+	static const std::size_t loads			 = 0;
+	static const std::size_t bytes			 = 0;
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 0;
+	static const std::size_t depth			 = 0;
+
 	using exec = vap::absorption_policy;
 	using value_type = T;
 
@@ -280,8 +566,8 @@ template <typename T, class Ctor, typename C, class Exec>
 struct expression_traits<vap::expressions::vector<T, Ctor, C, Exec>>
 {
 	static_assert(
-		std::is_arithmetic<T>::value,
-		"Vector Traits: Scalar type must be an arithmetic type");
+		vap::detail::is_storage<T>::value,
+		"Vector Traits: Scalar type must be an arithmetic or storage type");
 
 	static_assert(
 		vap::detail::is_exec<Exec>::value,
@@ -289,6 +575,15 @@ struct expression_traits<vap::expressions::vector<T, Ctor, C, Exec>>
 
 	static const bool is_operator = false;
 
+	// Elements can only be loaded as packets from contiguous host memory
+	static const bool packet_access = detail::is_contiguous<C>::value;
+
+	static const std::size_t loads			 = 1;
+	static const std::size_t bytes			 = sizeof(T);
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 0;
+	static const std::size_t depth			 = 0;
+
 	using value_type	 = T;
 	using exec			 = Exec;
 	using iterator		 = typename C::iterator;
@@ -302,7 +597,7 @@ namespace detail
 	template <class Check>
 	struct is_expression
 	{
-		static const bool value = std::is_base_of<expressions::Expression<Check::Derived>, Check>::value ||
+		static const bool value = std::is_base_of<expressions::Expression<typename Check::Derived>, Check>::value ||
 												  expressions::expression_traits<Check>::is_operator;
 	};
 
@@ -316,6 +611,9 @@ using detail::is_scalar_expression;
 using detail::vectorize;
 using detail::vectorize_t;
 
+using detail::broadcast;
+using detail::broadcast_t;
+
 using detail::wrap_number;
     
 using detail::get_exec;
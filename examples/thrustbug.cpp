@@ -3,12 +3,12 @@
 #include <vector>
 #include <iostream>
 
-#include <thrust\copy.h>
-#include <thrust\tuple.h>
-#include <thrust\device_vector.h>
-#include <thrust\iterator\zip_iterator.h>
-#include <thrust\iterator\constant_iterator.h>
-#include <thrust\iterator\transform_iterator.h>
+#include <thrust/copy.h>
+#include <thrust/tuple.h>
+#include <thrust/device_vector.h>
+#include <thrust/iterator/zip_iterator.h>
+#include <thrust/iterator/constant_iterator.h>
+#include <thrust/iterator/transform_iterator.h>
 
 // Apply tuple arguments to binary functor
 
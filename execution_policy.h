@@ -1,6 +1,6 @@
 #pragma once
 
-#include <vap\config.h>
+#include <vap/config.h>
 
 namespace vap  {
 
@@ -22,4 +22,29 @@ struct serial_execution : execution_policy {};
 // Indicates that operations will be performed in parallel 
 struct parallel_execution: execution_policy {};
 
+/*=================*/
+/* Thrust Systems  */
+/*=================*/
+// Select the thrust system used by constructors::Thrust_System.
+// The containers must live in memory accessible by the chosen system, e.g. use
+// std::vector or thrust::host_vector with the CPU systems.
+namespace systems {
+
+// THRUST_DEVICE_SYSTEM, i.e. thrust::device (CUDA unless configured otherwise)
+struct device {};
+
+// THRUST_HOST_SYSTEM, i.e. thrust::host
+struct host {};
+
+// Serial C++ backend, thrust::cpp::par
+struct cpp {};
+
+// Multi-threaded OpenMP backend, thrust::omp::par
+struct omp {};
+
+// Multi-threaded Intel TBB backend, thrust::tbb::par
+struct tbb {};
+
+} // end namespace systems
+
 } // end namespace vap
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/shared.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+namespace vap		  {
+namespace expressions {
+
+// Work done to evaluate one element of an expression into a vector: the leaf loads, the
+// bytes moved to and from memory (the loads, in the types the leaves store, and the
+// store of a value_type), the arithmetic operations, the calls to transcendental
+// functions and the height of the tree.
+struct cost
+{
+	std::size_t loads;
+	std::size_t bytes;
+	std::size_t flops;
+	std::size_t transcendentals;
+	std::size_t depth;
+
+	// Arithmetic intensity, in operations per byte
+	double intensity() const { return bytes > 0 ? double(flops) / bytes : 0; }
+};
+
+inline std::ostream& operator << (std::ostream& out, const cost& c)
+{
+	return out << c.loads << " loads, " << c.bytes << " bytes, " << c.flops << " flops, "
+			   << c.transcendentals << " transcendentals, depth " << c.depth;
+}
+
+// Cost of an expression type, from expression_traits. The type does not tell two vectors
+// of the same type apart, so every leaf is counted, and x * x makes two loads; every
+// occurrence of a shared sub-expression is counted too. This is an upper bound of the
+// work; cost_of below removes the repeats at run time.
+//
+//	static_assert(vap::expressions::static_cost<decltype(x * y + x)>().flops == 2, "");
+//
+template <class E>
+constexpr cost static_cost()
+{
+	using traits = expression_traits<typename E::Derived>;
+
+	return cost{
+		traits::loads,
+		traits::bytes + sizeof(typename E::value_type),
+		traits::flops,
+		traits::transcendentals,
+		traits::depth
+	};
+}
+
+namespace counting {
+
+// Leaves and shared nodes already counted by cost_of
+struct seen
+{
+	std::vector<const void*> leaves;
+	std::vector<std::size_t> shared;
+
+	template <class List, typename T>
+	static bool insert(List& list, const T& x)
+	{
+		if (std::find(list.begin(), list.end(), x) != list.end()) return false;
+
+		list.push_back(x);
+		return true;
+	}
+};
+
+// The counts of expression_traits, except that a vector read several times is loaded
+// once and a Shared node is evaluated once per id
+template <class E>
+struct counter
+{
+	static void apply(const E&, cost& c, seen&)
+	{
+		using traits = expression_traits<E>;
+
+		c.loads			  += traits::loads;
+		c.bytes			  += traits::bytes;
+		c.flops			  += traits::flops;
+		c.transcendentals += traits::transcendentals;
+	}
+};
+
+template <class E>
+void count(const E& e, cost& c, seen& s)
+{
+	counter<typename E::Derived>::apply(e, c, s);
+}
+
+template <typename T, class Ctor, typename C, class Exec>
+struct counter <vector<T, Ctor, C, Exec>>
+{
+	static void apply(const vector<T, Ctor, C, Exec>& v, cost& c, seen& s)
+	{
+		if (seen::insert(s.leaves, static_cast<const void*>(&v)))
+		{
+			++c.loads;
+			c.bytes += sizeof(T);
+		}
+	}
+};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct counter <Binary<L, R, Op, Exec, IsOp>>
+{
+	static void apply(const Binary<L, R, Op, Exec, IsOp>& e, cost& c, seen& s)
+	{
+		count(e.lhs(), c, s);
+		count(e.rhs(), c, s);
+
+		c.flops			  += vap::detail::op_cost<Op>::flops;
+		c.transcendentals += vap::detail::op_cost<Op>::transcendentals;
+	}
+};
+
+template <typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct counter <Ternary<A, B, C, Op, Exec, IsOp>>
+{
+	static void apply(const Ternary<A, B, C, Op, Exec, IsOp>& e, cost& c, seen& s)
+	{
+		count(e.first(), c, s);
+		count(e.second(), c, s);
+		count(e.third(), c, s);
+
+		c.flops			  += vap::detail::op_cost<Op>::flops;
+		c.transcendentals += vap::detail::op_cost<Op>::transcendentals;
+	}
+};
+
+template <typename U, class Op, class Exec, bool IsOp>
+struct counter <Unary<U, Op, Exec, IsOp>>
+{
+	static void apply(const Unary<U, Op, Exec, IsOp>& e, cost& c, seen& s)
+	{
+		count(e.operand(), c, s);
+
+		c.flops			  += vap::detail::op_cost<Op>::flops;
+		c.transcendentals += vap::detail::op_cost<Op>::transcendentals;
+	}
+};
+
+template <typename T>
+struct counter <Shared<T>>
+{
+	static void apply(const Shared<T>& e, cost& c, seen& s)
+	{
+		if (e.identifier() == 0 || seen::insert(s.shared, e.identifier()))
+			count(e.operand(), c, s);
+	}
+};
+
+} // end namespace counting
+
+// Cost of evaluating an expression as it stands, counting each distinct vector and
+// each shared sub-expression once. Pass vap::rewrite(e) to get the cost of what an
+// assignment actually evaluates.
+template <class E>
+cost cost_of(const E& e)
+{
+	cost c = static_cost<E>();
+	c.loads = c.flops = c.transcendentals = 0;
+	c.bytes = sizeof(typename E::value_type);
+
+	counting::seen s;
+	counting::count(e, c, s);
+
+	return c;
+}
+
+} // end namespace expressions
+
+using expressions::cost;
+using expressions::cost_of;
+using expressions::static_cost;
+
+} // end namespace vap
@@ -1,9 +1,11 @@
 #pragma once
 
-#include <vap\config.h>
-#include <vap\iterators\iterators.h>
-#include <vap\detail\traits.h>
-#include <vap\execution_policy.h>
+#include <vap/config.h>
+#include <vap/iterators/iterators.h>
+#include <vap/detail/traits.h>
+#include <vap/execution_policy.h>
+
+#include <cassert>
 
 // This is more descriptive than the usual static_cast code
 #define CRTP_DOWNCAST(_D) static_cast<_D>(*this)
@@ -43,6 +45,10 @@ public:
 	value_type operator [] (std::size_t i) const { return CRTP_DOWNCAST(const Derived&)[i]; }
 	std::size_t size()					   const { return CRTP_DOWNCAST(const Derived&).size(); }
 
+	// Evaluates Packet::width consecutive elements starting at i
+	template <class Packet>
+	Packet packet(std::size_t i) const { return CRTP_DOWNCAST(const Derived&).template packet<Packet>(i); }
+
 	// Provides implicit (or C-style) cast to expression type
 	operator Derived& ()			 { return CRTP_DOWNCAST(Derived&); }
 	operator const Derived& () const { return CRTP_DOWNCAST(const Derived&); }
@@ -57,9 +63,15 @@ template <typename Left,
 class Binary :
 	public Expression <Binary <Left, Right, Operator, Exec_Policy, Is_Operator>>
 {
+public:
+	using typename Expression<Binary>::value_type;
+	using typename Expression<Binary>::iterator;
+	using typename Expression<Binary>::const_iterator;
+	using typename Expression<Binary>::exec;
+
 protected:
-	const Left&  left;
-	const Right& right;
+	vap::detail::operand_t<Left>  left;
+	vap::detail::operand_t<Right> right;
 
 	Operator apply;
 
@@ -84,42 +96,114 @@ public:
 
 	iterator begin() 
 	{
-		return make_transform_iterator(
-					make_zip_iterator (
-					make_tuple(left.begin(), right.begin())),
-					apply);
+		return iterators::binary_iterator<exec>::make(apply, left.begin(), right.begin());
 	}
 
 	iterator end() 
 	{
-		return make_transform_iterator(
-					make_zip_iterator (
-					make_tuple(left.end(), right.end())),
-					apply);
+		return iterators::binary_iterator<exec>::make(apply, left.end(), right.end());
 	}
 
 	const_iterator cbegin() const 
 	{
-		return make_transform_iterator(
-					make_zip_iterator (
-					make_tuple(left.cbegin(), right.cbegin())),
-					apply);
+		return iterators::binary_iterator<exec>::make(apply, left.cbegin(), right.cbegin());
 	}
 
 	const_iterator cend() const
 	{
-		return make_transform_iterator(
-					make_zip_iterator (
-					make_tuple(left.cend(), right.cend())),
-					apply);
+		return iterators::binary_iterator<exec>::make(apply, left.cend(), right.cend());
 	}
 
+	// Operands of the expression, e.g. for visiting its leaves
+	const Left&  lhs() const { return left; }
+	const Right& rhs() const { return right; }
+
 	std::size_t size() const { return std::max(left.size(), right.size()); }
 	value_type operator [] (std::size_t i) const 
 	{ 
 		using boost::make_tuple; 
 		return apply(make_tuple(left[i], right[i]));
 	}
+
+	template <class Packet>
+	Packet packet(std::size_t i) const
+	{ return apply(left.template packet<Packet>(i), right.template packet<Packet>(i)); }
+};
+
+// Represents a ternary expression, such as a fused multiply-add, to be executed under
+// the given execution policy and operator
+template <typename First,
+		  typename Second,
+		  typename Third,
+		  class	   Operator,
+		  class	   Exec_Policy = absorption_policy,
+		  bool	   Is_Operator = false>
+class Ternary :
+	public Expression <Ternary <First, Second, Third, Operator, Exec_Policy, Is_Operator>>
+{
+public:
+	using typename Expression<Ternary>::value_type;
+	using typename Expression<Ternary>::iterator;
+	using typename Expression<Ternary>::const_iterator;
+	using typename Expression<Ternary>::exec;
+
+protected:
+	vap::detail::operand_t<First>  x;
+	vap::detail::operand_t<Second> y;
+	vap::detail::operand_t<Third>  z;
+
+	Operator apply;
+
+public:
+	Ternary(const First& a, const Second& b, const Third& c) : x(a), y(b), z(c)
+	{
+		static_assert (
+			vap::is_expression<First>::value && vap::is_expression<Second>::value && vap::is_expression<Third>::value,
+			"Ternary: Operand types must be expressions");
+
+		static_assert (
+			vap::compatible_execs<typename First::exec, typename Second::exec>::value &&
+			vap::compatible_execs<typename First::exec, typename Third::exec>::value &&
+			vap::compatible_execs<typename Second::exec, typename Third::exec>::value,
+			"Ternary: Incompatible execution policies selected");
+
+		assert(x.size() == y.size() && y.size() == z.size());
+	}
+
+	iterator begin()
+	{
+		return iterators::ternary_iterator<exec>::make(apply, x.begin(), y.begin(), z.begin());
+	}
+
+	iterator end()
+	{
+		return iterators::ternary_iterator<exec>::make(apply, x.end(), y.end(), z.end());
+	}
+
+	const_iterator cbegin() const
+	{
+		return iterators::ternary_iterator<exec>::make(apply, x.cbegin(), y.cbegin(), z.cbegin());
+	}
+
+	const_iterator cend() const
+	{
+		return iterators::ternary_iterator<exec>::make(apply, x.cend(), y.cend(), z.cend());
+	}
+
+	const First&  first()  const { return x; }
+	const Second& second() const { return y; }
+	const Third&  third()  const { return z; }
+
+	std::size_t size() const { return std::max(x.size(), std::max(y.size(), z.size())); }
+	value_type operator [] (std::size_t i) const
+	{
+		using boost::make_tuple;
+		return apply(make_tuple(x[i], y[i], z[i]));
+	}
+
+	template <class Packet>
+	Packet packet(std::size_t i) const
+	{ return apply(x.template packet<Packet>(i), y.template packet<Packet>(i), z.template packet<Packet>(i)); }
 };
 
 // Represents a unary expression to be executed under the given execution policy and operator
@@ -130,13 +214,22 @@ template <typename Base,
 class Unary :
 	public Expression <Unary <Base, Operator, Exec_Policy, Is_Operator>>
 {
+public:
+	using typename Expression<Unary>::value_type;
+	using typename Expression<Unary>::iterator;
+	using typename Expression<Unary>::const_iterator;
+	using typename Expression<Unary>::exec;
+
 protected:
-	const Base& expression;
+	vap::detail::operand_t<Base> expression;
 
 	Operator apply;
 
 public:
-	Unary(const Base& exp) : expression(exp)
+	Unary(const Base& exp) : Unary(exp, Operator()) {}
+
+	// Operators with state, e.g. the exponent of vap::scalar_power
+	Unary(const Base& exp, const Operator& op) : expression(exp), apply(op)
 	{
 		// Assert that the Base type must be derived from Expression
 		static_assert (
@@ -148,19 +241,25 @@ public:
 	void update(const std::size_t&) {}
 
 	iterator begin()
-	{ return make_transform_iterator(expression.begin(), apply); }
+	{ return iterators::unary_iterator<exec>::make(apply, expression.begin()); }
 
 	iterator end() 
-	{ return make_transform_iterator(expression.end(), apply); }
+	{ return iterators::unary_iterator<exec>::make(apply, expression.end()); }
 
 	const_iterator cbegin() const
-	{ return make_transform_iterator(expression.cbegin(), apply); }
+	{ return iterators::unary_iterator<exec>::make(apply, expression.cbegin()); }
 
 	const_iterator cend() const
-	{ return make_transform_iterator(expression.cend(), apply); }
+	{ return iterators::unary_iterator<exec>::make(apply, expression.cend()); }
+
+	const Base&		operand() const { return expression; }
+	const Operator& functor() const { return apply; }
 
 	std::size_t size()					   const { return expression.size(); }
 	value_type operator [] (std::size_t i) const { return apply(expression[i]); }
+
+	template <class Packet>
+	Packet packet(std::size_t i) const { return apply(expression.template packet<Packet>(i)); }
 };
 
 
@@ -168,6 +267,12 @@ template <typename Type>
 class Scalar :
 	public Expression <Scalar <Type>>
 {
+public:
+	using typename Expression<Scalar>::value_type;
+	using typename Expression<Scalar>::iterator;
+	using typename Expression<Scalar>::const_iterator;
+	using typename Expression<Scalar>::exec;
+
 protected:
 	// This MUST be a by-value variable. Otherwise rvalues
 	// will be invalidated when this class goes out of scope.
@@ -186,24 +291,42 @@ public:
 	Scalar(const Type& val) : value(val), m_size(0)
 	{ requirements(); }
 
-	template <typename E>
 	Scalar(const Type& val, const std::size_t size) : value(val), m_size(size) 
 	{ requirements(); }
 
 	iterator begin() 
-	{ return thrust::constant_iterator<value_type, std::size_t>(value, 0); }
+	{ return iterator(value, 0); }
 
 	iterator end() 
-	{ return thrust::constant_iterator<value_type, std::size_t>(value, m_size); }
+	{ return iterator(value, m_size); }
 
 	const_iterator cbegin() const
-	{ return thrust::constant_iterator<value_type, std::size_t>(value, 0); }
+	{ return iterator(value, 0); }
 
 	const_iterator cend()   const
-	{ return thrust::constant_iterator<value_type, std::size_t>(value, m_size); }
+	{ return iterator(value, m_size); }
 
 	std::size_t size()					   const { return m_size; }
 	value_type operator [] (std::size_t i) const { return value; }
+
+	template <class Packet>
+	Packet packet(std::size_t i) const { return Packet::broadcast(value); }
+};
+
+// A Scalar whose value Num / Den is known at compile time, created from vap::constant,
+// e.g. x ^ vap::constant<2>(). The rewrite pass in expressions/rewrite.h uses the value
+// to simplify the expression; otherwise it behaves like any Scalar.
+template <typename Type, long Num, long Den = 1>
+class Constant :
+	public Scalar <Type>
+{
+public:
+	static_assert(Den != 0, "Constant: Denominator must not be zero");
+
+	static const long numerator	  = Num;
+	static const long denominator = Den;
+
+	Constant(const std::size_t size = 0) : Scalar<Type>(static_cast<Type>(Num) / static_cast<Type>(Den), size) {}
 };
 	
 } // end namespace expressions
@@ -2,13 +2,13 @@
 
 #include <type_traits>
 
-#include <vap\config.h>
-#include <vap\execution_policy.h>
+#include <vap/config.h>
+#include <vap/execution_policy.h>
 
-#include <vap\iterators\iterators.h>
+#include <vap/iterators/iterators.h>
 
-#include <vap\detail\functional.h>
-#include <vap\expressions\expressions.h>
+#include <vap/detail/functional.h>
+#include <vap/expressions/expressions.h>
 
 namespace vap		{
 namespace operators {
@@ -19,117 +19,117 @@ namespace operators {
 	// Sum: TEMPLATE PARAMETERS
 	template <typename Left, 
 			  typename Right	   = Left,
-			  typename Functor     = vap::apply <vap::sum<typename Left::value_type>>,
+			  typename Functor     = vap::apply <vap::sum<vap::detail::promote_t<typename Left::value_type, typename Right::value_type>>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Sum: CLASS DEFINITION
 	struct Sum : public 
 		expressions::Binary <Left, Right, Functor, Exec_Policy, true>
-	{ Sum(const Left& lhs, const Right& rhs) : Binary(lhs, rhs) {} };
+	{ Sum(const Left& lhs, const Right& rhs) : Sum::Binary(lhs, rhs) {} };
 
 	// Difference: TEMPLATE PARAMETERS
 	template <typename Left,
 			  typename Right	   = Left,
-			  typename Functor     = vap::apply <vap::difference <typename Left::value_type>>,
+			  typename Functor     = vap::apply <vap::difference<vap::detail::promote_t<typename Left::value_type, typename Right::value_type>>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Difference: CLASS DEFINITION
 	struct Difference : public 
 		expressions::Binary <Left, Right, Functor, Exec_Policy, true>
-	{ Difference(const Left& lhs, const Right& rhs) : Binary(lhs, rhs) {} };
+	{ Difference(const Left& lhs, const Right& rhs) : Difference::Binary(lhs, rhs) {} };
 
 	// Product: TEMPLATE PARAMETERS
 	template <typename Left,
 			  typename Right	   = Left,
-			  typename Functor     = vap::apply <vap::product <typename Left::value_type>>,
+			  typename Functor     = vap::apply <vap::product<vap::detail::promote_t<typename Left::value_type, typename Right::value_type>>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Product: CLASS DEFINITION
 	struct Product : public 
 		expressions::Binary <Left, Right, Functor, Exec_Policy, true>
-	{ Product(const Left& lhs, const Right& rhs) : Binary(lhs, rhs) {} };
+	{ Product(const Left& lhs, const Right& rhs) : Product::Binary(lhs, rhs) {} };
 
 	// Quotient: TEMPLATE PARAMETERS
 	template <typename Left,
 			  typename Right	   = Left,
-			  typename Functor	   = vap::apply <vap::quotient <typename Left::value_type>>,
+			  typename Functor	   = vap::apply <vap::quotient<vap::detail::promote_t<typename Left::value_type, typename Right::value_type>>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Quotient: CLASS DEFINITION
 	struct Quotient : public 
 		expressions::Binary <Left, Right, Functor, Exec_Policy, true>
-	{ Quotient(const Left& lhs, const Right& rhs) : Binary(lhs, rhs) {} };
+	{ Quotient(const Left& lhs, const Right& rhs) : Quotient::Binary(lhs, rhs) {} };
 
 	// Power: TEMPLATE PARAMETERS
 	template <typename Left,
 			  typename Right	   = Left,
-			  typename Functor	   =  vap::apply <vap::power<typename Left::value_type>>,
+			  typename Functor	   =  vap::apply <vap::power<vap::detail::promote_t<typename Left::value_type, typename Right::value_type>>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Power: CLASS DEFINITION
 	struct Power : public 
 		expressions::Binary <Left, Right, Functor, Exec_Policy, true>
-	{ Power(const Left& lhs, const Right& rhs) : Binary(lhs, rhs) {} };
+	{ Power(const Left& lhs, const Right& rhs) : Power::Binary(lhs, rhs) {} };
 
 	/********************************/
 	/** Unary Expression Operators **/
 	/********************************/
 	// Sin: TEMPLATE PARAMETERS
 	template <typename Type,
-			  typename Functor	   = vap::sin <typename Type::value_type>,
+			  typename Functor	   = vap::sin <vap::detail::compute_t<typename Type::value_type>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Sin: CLASS DEFINITION
 	struct Sin : public 
 		expressions::Unary <Type, Functor, Exec_Policy, true>
-	{ Sin(const Type& value) : Unary(value) {} };
+	{ Sin(const Type& value) : Sin::Unary(value) {} };
 	
 	// Cos TEMPLATE PARAMETERS
 	template <typename Type,
-			  typename Functor	   = vap::cos <typename Type::value_type>,
+			  typename Functor	   = vap::cos <vap::detail::compute_t<typename Type::value_type>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Cos: CLASS DEFINITION
 	struct Cos : public 
 		expressions::Unary <Type, Functor, Exec_Policy, true>
-	{ Cos(const Type& value) : Unary(value) {} };
+	{ Cos(const Type& value) : Cos::Unary(value) {} };
 	
 	// Tan: TEMPLATE PARAMETERS
 	template <typename Type,
-			  typename Functor	   = vap::tan <typename Type::value_type>,
+			  typename Functor	   = vap::tan <vap::detail::compute_t<typename Type::value_type>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Tan: CLASS DEFINITION
 	struct Tan : public 
 		expressions::Unary <Type, Functor, Exec_Policy, true>
-	{ Tan(const Type& value) : Unary(value) {} };
+	{ Tan(const Type& value) : Tan::Unary(value) {} };
 	
 	// Log: TEMPLATE PARAMETERS
 	template <typename Type,
-			  typename Functor	   = vap::log <typename Type::value_type>,
+			  typename Functor	   = vap::log <vap::detail::compute_t<typename Type::value_type>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Log: CLASS DEFINITION
 	struct Log : public 
 		expressions::Unary <Type, Functor, Exec_Policy, true>
-	{ Log(const Type& value) : Unary(value) {} };
+	{ Log(const Type& value) : Log::Unary(value) {} };
 	
 	// Negate: TEMPLATE PARAMETERS
 	template <typename Type,
-			  typename Functor	   = vap::negate <typename Type::value_type>,
+			  typename Functor	   = vap::negate <vap::detail::compute_t<typename Type::value_type>>,
 			  typename Exec_Policy = absorption_policy>
 
 	// Negate: CLASS DEFINITION
 	struct Negate : public 
 		expressions::Unary <Type, Functor, Exec_Policy, true>
-	{ Negate(const Type& value) : Unary(value) {} };
+	{ Negate(const Type& value) : Negate::Unary(value) {} };
 
 	/*******************************/
 	/** Binary Operator Overloads **/
 	/*******************************/
 	template <typename Left, typename Right,
-			  typename LeftV  = vap::vectorize_t<Left>,
-			  typename RightV = vap::vectorize_t<Right>,
+			  typename LeftV  = vap::broadcast_t<Left, Right>,
+			  typename RightV = vap::broadcast_t<Right, Left>,
 			  typename Return = Sum<LeftV, RightV>>
 	const Return operator + (const Left& lhs, const Right& rhs)
 	{ 
@@ -137,29 +137,45 @@ namespace operators {
 					  vap::wrap_number<RightV>(rhs, lhs)); 
 	}
 	
-	template <typename Left, typename Right, 
-			  typename Return = Difference<vap::vectorize_t<Left>, 
-										   vap::vectorize_t<Right>>>
+	template <typename Left, typename Right,
+			  typename LeftV  = vap::broadcast_t<Left, Right>,
+			  typename RightV = vap::broadcast_t<Right, Left>,
+			  typename Return = Difference<LeftV, RightV>>
 	const Return operator - (const Left& lhs, const Right& rhs)
-	{ return Return(lhs, rhs); }
+	{ 
+		return Return(vap::wrap_number<LeftV>(lhs, rhs), 
+					  vap::wrap_number<RightV>(rhs, lhs)); 
+	}
 	
-	template <typename Left, typename Right, 
-			  typename Return = Product<vap::vectorize_t<Left>, 
-										vap::vectorize_t<Right>>>
+	template <typename Left, typename Right,
+			  typename LeftV  = vap::broadcast_t<Left, Right>,
+			  typename RightV = vap::broadcast_t<Right, Left>,
+			  typename Return = Product<LeftV, RightV>>
 	const Return operator * (const Left& lhs, const Right& rhs)
-	{ return Return(lhs, rhs); }
+	{ 
+		return Return(vap::wrap_number<LeftV>(lhs, rhs), 
+					  vap::wrap_number<RightV>(rhs, lhs)); 
+	}
 	
-	template <typename Left, typename Right, 
-			  typename Return = Quotient<vap::vectorize_t<Left>, 
-										 vap::vectorize_t<Right>>>
+	template <typename Left, typename Right,
+			  typename LeftV  = vap::broadcast_t<Left, Right>,
+			  typename RightV = vap::broadcast_t<Right, Left>,
+			  typename Return = Quotient<LeftV, RightV>>
 	const Return operator / (const Left& lhs, const Right& rhs)
-	{ return Return(lhs, rhs); }
+	{ 
+		return Return(vap::wrap_number<LeftV>(lhs, rhs), 
+					  vap::wrap_number<RightV>(rhs, lhs)); 
+	}
 	
-	template <typename Left, typename Right, 
-			  typename Return = Power<vap::vectorize_t<Left>, 
-									  vap::vectorize_t<Right>>>
+	template <typename Left, typename Right,
+			  typename LeftV  = vap::broadcast_t<Left, Right>,
+			  typename RightV = vap::broadcast_t<Right, Left>,
+			  typename Return = Power<LeftV, RightV>>
 	const Return operator ^ (const Left& lhs, const Right& rhs)
-	{ return Return(lhs, rhs); }
+	{ 
+		return Return(vap::wrap_number<LeftV>(lhs, rhs), 
+					  vap::wrap_number<RightV>(rhs, lhs)); 
+	}
 
 	/******************************/
 	/** Unary Operator Overloads **/
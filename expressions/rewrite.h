@@ -0,0 +1,520 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/functional.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/shared.h>
+
+#include <type_traits>
+#include <vector>
+
+namespace vap		  {
+namespace expressions {
+namespace rewriting	  {
+
+// Compile-time rewrite pass over expression types, applied before an expression is
+// evaluated into a vector or reduced. Node by node, from the leaves up:
+//	x * 1, 1 * x, x / 1, x + 0, 0 + x, x - 0, x ^ 1	 ->	 x	(1 and 0 are vap::constant)
+//	x ^ 0											 ->	 1
+//	x ^ constant<n>, x ^ constant<n, 2>				 ->	 multiplications, sqrt (constant_power)
+//	x ^ s, s a Scalar								 ->	 scalar_power
+//	subtrees of Scalars								 ->	 a single Scalar, computed once
+//	a * b + c, c + a * b							 ->	 fused_multiply_add (unless VAP_NO_FMA)
+// Note that x + 0 -> x keeps the sign of a negative zero x, and that fused_multiply_add
+// rounds once where a * b + c rounds twice.
+// The simplified tree then goes through the common sub-expression pass below, which
+// turns every sub-expression occurring more than once into a Shared node.
+
+enum class kind { other, sum, difference, product, quotient, power };
+
+template <class Op>
+struct kind_of : std::integral_constant<kind, kind::other> {};
+
+template <typename T>
+struct kind_of <vap::apply<vap::sum<T>>> : std::integral_constant<kind, kind::sum> {};
+
+template <typename T>
+struct kind_of <vap::apply<vap::difference<T>>> : std::integral_constant<kind, kind::difference> {};
+
+template <typename T>
+struct kind_of <vap::apply<vap::product<T>>> : std::integral_constant<kind, kind::product> {};
+
+template <typename T>
+struct kind_of <vap::apply<vap::quotient<T>>> : std::integral_constant<kind, kind::quotient> {};
+
+template <typename T, class Accuracy>
+struct kind_of <vap::apply<vap::power<T, Accuracy>>> : std::integral_constant<kind, kind::power> {};
+
+// Leaves whose value is the same for every element
+template <class E>
+struct is_scalar : std::false_type {};
+
+template <typename T>
+struct is_scalar <Scalar<T>> : std::true_type {};
+
+template <typename T, long Num, long Den>
+struct is_scalar <Constant<T, Num, Den>> : std::true_type {};
+
+// Leaves whose value is known at compile time
+template <class E>
+struct is_constant : std::false_type
+{
+	static const long numerator	  = 0;
+	static const long denominator = 0;
+};
+
+template <typename T, long Num, long Den>
+struct is_constant <Constant<T, Num, Den>> : std::true_type
+{
+	static const long numerator	  = Num;
+	static const long denominator = Den;
+};
+
+template <class E>
+struct is_zero : std::integral_constant<bool, is_constant<E>::value && is_constant<E>::numerator == 0> {};
+
+template <class E>
+struct is_one : std::integral_constant<bool, is_constant<E>::value && is_constant<E>::numerator == is_constant<E>::denominator> {};
+
+template <class E>
+struct is_product : std::false_type {};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct is_product <Binary<L, R, Op, Exec, IsOp>> : std::integral_constant<bool, kind_of<Op>::value == kind::product> {};
+
+/*=================*/
+/* Rewriting rules */
+/*=================*/
+enum class rule { keep, left, right, one, fold, constant_power, scalar_power, fma_left, fma_right };
+
+#ifdef VAP_NO_FMA
+static const bool fuse = false;
+#else
+static const bool fuse = true;
+#endif
+
+template <class Op, class L, class R>
+struct binary_rule
+{
+	static const kind k = kind_of<Op>::value;
+
+	static const rule value =
+		k == kind::product	  && is_one<R>::value  ? rule::left	 :
+		k == kind::product	  && is_one<L>::value  ? rule::right :
+		k == kind::quotient	  && is_one<R>::value  ? rule::left	 :
+		k == kind::sum		  && is_zero<R>::value ? rule::left	 :
+		k == kind::sum		  && is_zero<L>::value ? rule::right :
+		k == kind::difference && is_zero<R>::value ? rule::left	 :
+		k == kind::power	  && is_one<R>::value  ? rule::left	 :
+		k == kind::power	  && is_zero<R>::value ? rule::one	 :
+		k == kind::power	  && is_constant<R>::value && !is_scalar<L>::value &&
+			(is_constant<R>::denominator == 1 || is_constant<R>::denominator == 2) ? rule::constant_power :
+		is_scalar<L>::value	  && is_scalar<R>::value   ? rule::fold :
+		k == kind::power	  && is_scalar<R>::value   ? rule::scalar_power :
+		fuse && k == kind::sum && is_product<L>::value ? rule::fma_left	 :
+		fuse && k == kind::sum && is_product<R>::value ? rule::fma_right :
+		rule::keep;
+};
+
+template <rule Rule, class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary
+{
+	using type = Binary<L, R, Op, Exec, IsOp>;
+
+	static type apply(const L& l, const R& r) { return type(l, r); }
+};
+
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::left, Op, L, R, Exec, IsOp>
+{
+	using type = L;
+
+	static vap::detail::operand_t<type> apply(const L& l, const R&) { return l; }
+};
+
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::right, Op, L, R, Exec, IsOp>
+{
+	using type = R;
+
+	static vap::detail::operand_t<type> apply(const L&, const R& r) { return r; }
+};
+
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::one, Op, L, R, Exec, IsOp>
+{
+	using type = Constant<vap::detail::promote_t<typename L::value_type, typename R::value_type>, 1>;
+
+	static type apply(const L& l, const R&) { return type(l.size()); }
+};
+
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::fold, Op, L, R, Exec, IsOp>
+{
+	using type = Scalar<vap::detail::promote_t<typename L::value_type, typename R::value_type>>;
+
+	static type apply(const L& l, const R& r)
+	{
+		const Binary<L, R, Op, Exec, IsOp> node(l, r);
+		return type(node[0], node.size());
+	}
+};
+
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::constant_power, Op, L, R, Exec, IsOp>
+{
+	using functor = vap::constant_power<vap::detail::promote_t<typename L::value_type, typename R::value_type>, is_constant<R>::numerator, is_constant<R>::denominator>;
+	using type	  = Unary<L, functor, Exec, IsOp>;
+
+	static type apply(const L& l, const R&) { return type(l); }
+};
+
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::scalar_power, Op, L, R, Exec, IsOp>
+{
+	using functor = vap::scalar_power<vap::detail::promote_t<typename L::value_type, typename R::value_type>>;
+	using type	  = Unary<L, functor, Exec, IsOp>;
+
+	static type apply(const L& l, const R& r) { return type(l, functor(r[0])); }
+};
+
+// a * b + c, the product is on the left
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::fma_left, Op, L, R, Exec, IsOp>
+{
+	using A = std::decay_t<decltype(std::declval<L>().lhs())>;
+	using B = std::decay_t<decltype(std::declval<L>().rhs())>;
+
+	using functor = vap::apply_ternary<vap::fused_multiply_add<vap::detail::promote_t<typename L::value_type, typename R::value_type>>>;
+	using type	  = Ternary<A, B, R, functor, Exec, IsOp>;
+
+	static type apply(const L& l, const R& r) { return type(l.lhs(), l.rhs(), r); }
+};
+
+// c + a * b
+template <class Op, class L, class R, class Exec, bool IsOp>
+struct make_binary <rule::fma_right, Op, L, R, Exec, IsOp>
+{
+	using A = std::decay_t<decltype(std::declval<R>().lhs())>;
+	using B = std::decay_t<decltype(std::declval<R>().rhs())>;
+
+	using functor = vap::apply_ternary<vap::fused_multiply_add<vap::detail::promote_t<typename L::value_type, typename R::value_type>>>;
+	using type	  = Ternary<A, B, L, functor, Exec, IsOp>;
+
+	static type apply(const L& l, const R& r) { return type(r.lhs(), r.rhs(), l); }
+};
+
+/*=============*/
+/* Tree walker */
+/*=============*/
+// rewriter<E>::type is the rewritten type of E and rewriter<E>::apply(e) builds it.
+// Operator structs such as Sum are rewritten as the node they derive from, leaves
+// are kept as they are.
+template <class E, bool = std::is_same<E, typename E::Derived>::value>
+struct rewriter : rewriter<typename E::Derived>
+{
+	static decltype(auto) apply(const E& e)
+	{ return rewriter<typename E::Derived>::apply(e); }
+};
+
+template <class E>
+struct rewriter <E, true>
+{
+	using type = E;
+
+	static vap::detail::operand_t<type> apply(const E& e) { return e; }
+};
+
+template <typename T, long Num, long Den>
+struct rewriter <Constant<T, Num, Den>, false>
+{
+	using type = Constant<T, Num, Den>;
+
+	static type apply(const type& e) { return e; }
+};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct rewriter <Binary<L, R, Op, Exec, IsOp>, true>
+{
+	using left	= rewriter<L>;
+	using right = rewriter<R>;
+
+	using L2 = typename left::type;
+	using R2 = typename right::type;
+
+	using make = make_binary<binary_rule<Op, L2, R2>::value, Op, L2, R2, Exec, IsOp>;
+	using type = typename make::type;
+
+	static vap::detail::operand_t<type> apply(const Binary<L, R, Op, Exec, IsOp>& e)
+	{ return make::apply(left::apply(e.lhs()), right::apply(e.rhs())); }
+};
+
+template <typename T, class Op, class Exec, bool IsOp>
+struct rewriter <Unary<T, Op, Exec, IsOp>, true>
+{
+	using operand = rewriter<T>;
+
+	using T2   = typename operand::type;
+	using node = Unary<T2, Op, Exec, IsOp>;
+
+	// Functions of a Scalar are computed once
+	using type = std::conditional_t<is_scalar<T2>::value, Scalar<typename node::value_type>, node>;
+
+	static type apply(const Unary<T, Op, Exec, IsOp>& e)
+	{ return make(node(operand::apply(e.operand()), e.functor()), is_scalar<T2>()); }
+
+	static node make(const node& n, std::false_type) { return n; }
+	static type make(const node& n, std::true_type)	 { return type(n[0], n.size()); }
+};
+
+/*==============================*/
+/* Common sub-expression pass */
+/*==============================*/
+// Number of occurrences of the node type T in the expression type E
+template <class T, class E>
+struct occurrences : std::integral_constant<std::size_t, std::is_same<T, E>::value ? 1 : 0> {};
+
+template <class T, typename L, typename R, class Op, class Exec, bool IsOp>
+struct occurrences <T, Binary<L, R, Op, Exec, IsOp>> : std::integral_constant<std::size_t,
+	(std::is_same<T, Binary<L, R, Op, Exec, IsOp>>::value ? 1 : 0) +
+	occurrences<T, typename L::Derived>::value + occurrences<T, typename R::Derived>::value> {};
+
+template <class T, typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct occurrences <T, Ternary<A, B, C, Op, Exec, IsOp>> : std::integral_constant<std::size_t,
+	(std::is_same<T, Ternary<A, B, C, Op, Exec, IsOp>>::value ? 1 : 0) +
+	occurrences<T, typename A::Derived>::value + occurrences<T, typename B::Derived>::value +
+	occurrences<T, typename C::Derived>::value> {};
+
+template <class T, typename U, class Op, class Exec, bool IsOp>
+struct occurrences <T, Unary<U, Op, Exec, IsOp>> : std::integral_constant<std::size_t,
+	(std::is_same<T, Unary<U, Op, Exec, IsOp>>::value ? 1 : 0) + occurrences<T, typename U::Derived>::value> {};
+
+// Functors are stateless unless stated otherwise
+template <class Op>
+bool same_functor(const Op&, const Op&) { return true; }
+
+template <typename T>
+bool same_functor(const vap::scalar_power<T>& a, const vap::scalar_power<T>& b) { return a.y == b.y; }
+
+// Determines whether two expressions of the same type compute the same values: they
+// read the same vectors and scalars through the same operators. Unknown leaves are
+// never considered equal.
+template <class E>
+struct equality
+{
+	static bool apply(const E&, const E&) { return false; }
+};
+
+template <typename T, class Ctor, typename C, class Exec>
+struct equality <vector<T, Ctor, C, Exec>>
+{
+	static bool apply(const vector<T, Ctor, C, Exec>& a, const vector<T, Ctor, C, Exec>& b) { return &a == &b; }
+};
+
+template <typename T>
+struct equality <Scalar<T>>
+{
+	static bool apply(const Scalar<T>& a, const Scalar<T>& b) { return a[0] == b[0]; }
+};
+
+template <class E>
+bool equal(const E& a, const E& b)
+{
+	return equality<typename E::Derived>::apply(a, b);
+}
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct equality <Binary<L, R, Op, Exec, IsOp>>
+{
+	static bool apply(const Binary<L, R, Op, Exec, IsOp>& a, const Binary<L, R, Op, Exec, IsOp>& b)
+	{ return equal(a.lhs(), b.lhs()) && equal(a.rhs(), b.rhs()); }
+};
+
+template <typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct equality <Ternary<A, B, C, Op, Exec, IsOp>>
+{
+	static bool apply(const Ternary<A, B, C, Op, Exec, IsOp>& a, const Ternary<A, B, C, Op, Exec, IsOp>& b)
+	{ return equal(a.first(), b.first()) && equal(a.second(), b.second()) && equal(a.third(), b.third()); }
+};
+
+template <typename U, class Op, class Exec, bool IsOp>
+struct equality <Unary<U, Op, Exec, IsOp>>
+{
+	static bool apply(const Unary<U, Op, Exec, IsOp>& a, const Unary<U, Op, Exec, IsOp>& b)
+	{ return same_functor(a.functor(), b.functor()) && equal(a.operand(), b.operand()); }
+};
+
+// Hands out the ids of the Shared nodes. The tree is walked twice: collect records every
+// occurrence of a repeated node type, grouping the occurrences that are equal, then id_of
+// returns the id of the group, or 0 for an occurrence equal to no other.
+class registry
+{
+private:
+	struct entry
+	{
+		const void* type;
+		const void* node;
+		std::size_t id;
+		std::size_t uses;
+	};
+
+	std::vector<entry> entries;
+
+	template <class E>
+	static const void* tag()
+	{
+		static const char t = 0;
+		return &t;
+	}
+
+	template <class E>
+	entry* find(const E& e)
+	{
+		for (entry& x : entries)
+			if (x.type == tag<E>() && equal(*static_cast<const E*>(x.node), e))
+				return &x;
+
+		return nullptr;
+	}
+
+public:
+	template <class Node, class E>
+	void collect(const E& e)
+	{
+		if (entry* x = find(e)) ++x->uses;
+		else					entries.push_back(entry{ tag<E>(), &e, Shared<Node>::next_id(), 1 });
+	}
+
+	template <class E>
+	std::size_t id_of(const E& e)
+	{
+		const entry* x = find(e);
+		return x && x->uses > 1 ? x->id : 0;
+	}
+};
+
+// sharer<Root, E>::type is E with its repeated node types wrapped in Shared; Root is the
+// whole tree, in which the occurrences are counted
+template <class Root, class E>
+struct sharer
+{
+	using type = E;
+
+	static void collect(const E&, registry&) {}
+	static vap::detail::operand_t<type> apply(const E& e, registry&) { return e; }
+};
+
+template <class Root, class Node, class E>
+struct share_node
+{
+	static const bool repeated = occurrences<E, Root>::value > 1;
+
+	using type = std::conditional_t<repeated, Shared<Node>, Node>;
+
+	static void collect(const E&, registry&, std::false_type) {}
+	static void collect(const E& e, registry& r, std::true_type) { r.template collect<Node>(e); }
+
+	static type apply(const Node& n, const E&, registry&, std::false_type) { return n; }
+	static type apply(const Node& n, const E& e, registry& r, std::true_type) { return type(n, r.id_of(e)); }
+
+	static void collect(const E& e, registry& r)
+	{ collect(e, r, std::integral_constant<bool, repeated>()); }
+
+	static type apply(const Node& n, const E& e, registry& r)
+	{ return apply(n, e, r, std::integral_constant<bool, repeated>()); }
+};
+
+template <class Root, typename L, typename R, class Op, class Exec, bool IsOp>
+struct sharer <Root, Binary<L, R, Op, Exec, IsOp>>
+{
+	using E		= Binary<L, R, Op, Exec, IsOp>;
+	using left	= sharer<Root, L>;
+	using right = sharer<Root, R>;
+	using node	= Binary<typename left::type, typename right::type, Op, Exec, IsOp>;
+	using share = share_node<Root, node, E>;
+	using type	= typename share::type;
+
+	static void collect(const E& e, registry& r)
+	{
+		share::collect(e, r);
+		left::collect(e.lhs(), r);
+		right::collect(e.rhs(), r);
+	}
+
+	static type apply(const E& e, registry& r)
+	{ return share::apply(node(left::apply(e.lhs(), r), right::apply(e.rhs(), r)), e, r); }
+};
+
+template <class Root, typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct sharer <Root, Ternary<A, B, C, Op, Exec, IsOp>>
+{
+	using E		 = Ternary<A, B, C, Op, Exec, IsOp>;
+	using first	 = sharer<Root, A>;
+	using second = sharer<Root, B>;
+	using third	 = sharer<Root, C>;
+	using node	 = Ternary<typename first::type, typename second::type, typename third::type, Op, Exec, IsOp>;
+	using share	 = share_node<Root, node, E>;
+	using type	 = typename share::type;
+
+	static void collect(const E& e, registry& r)
+	{
+		share::collect(e, r);
+		first::collect(e.first(), r);
+		second::collect(e.second(), r);
+		third::collect(e.third(), r);
+	}
+
+	static type apply(const E& e, registry& r)
+	{ return share::apply(node(first::apply(e.first(), r), second::apply(e.second(), r), third::apply(e.third(), r)), e, r); }
+};
+
+template <class Root, typename U, class Op, class Exec, bool IsOp>
+struct sharer <Root, Unary<U, Op, Exec, IsOp>>
+{
+	using E		  = Unary<U, Op, Exec, IsOp>;
+	using operand = sharer<Root, U>;
+	using node	  = Unary<typename operand::type, Op, Exec, IsOp>;
+	using share	  = share_node<Root, node, E>;
+	using type	  = typename share::type;
+
+	static void collect(const E& e, registry& r)
+	{
+		share::collect(e, r);
+		operand::collect(e.operand(), r);
+	}
+
+	static type apply(const E& e, registry& r)
+	{ return share::apply(node(operand::apply(e.operand(), r), e.functor()), e, r); }
+};
+
+// Shares the repeated sub-expressions of a simplified expression s
+template <class S>
+decltype(auto) share(const S& s)
+{
+	registry shared;
+	sharer<S, S>::collect(s, shared);
+	return sharer<S, S>::apply(s, shared);
+}
+
+template <class E>
+using simplified_t = typename rewriter<E>::type;
+
+} // end namespace rewriting
+
+// Returns the rewritten form of the expression e, for immediate evaluation. Vectors are
+// referenced, so the result is valid as long as the vectors of e are.
+template <class E>
+decltype(auto) rewrite(const E& e)
+{
+	return rewriting::share(rewriting::rewriter<E>::apply(e));
+}
+
+template <class E>
+using rewrite_t = typename rewriting::sharer<rewriting::simplified_t<E>, rewriting::simplified_t<E>>::type;
+
+} // end namespace expressions
+
+using expressions::rewrite;
+
+} // end namespace vap
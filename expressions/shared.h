@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/alias.h>
+#include <vap/detail/epoch.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/expressions.h>
+
+#include <atomic>
+#include <cstddef>
+
+namespace vap		  {
+namespace expressions {
+
+// A sub-expression that occurs several times in an expression tree. The occurrences are
+// copies of the same Shared node and carry the same id: the first one to be evaluated at
+// index i (or for the packet starting at i) stores its value in a per-thread cache, the
+// others read it back. Created by the rewrite pass (see expressions/rewrite.h). A cached
+// value is only read back during the evaluation that computed it (see detail/epoch.h),
+// so a rewritten tree may be evaluated again once its operands have changed.
+// An id of 0 bypasses the cache, for a node whose type repeats but whose value does not.
+template <typename Base>
+class Shared :
+	public Expression <Shared <Base>>
+{
+public:
+	using typename Expression<Shared>::value_type;
+	using typename Expression<Shared>::iterator;
+	using typename Expression<Shared>::const_iterator;
+	using typename Expression<Shared>::exec;
+
+protected:
+	vap::detail::operand_t<Base> expression;
+	std::size_t					 id;
+
+	// Last values computed on this thread by Shared nodes of the same value type, in
+	// the slot of their id. The nodes of one evaluation get consecutive ids, so up to
+	// slots of them are interleaved without evicting each other.
+	static const std::size_t slots = 8;
+
+	template <typename Value>
+	struct cache
+	{
+		std::size_t epoch;
+		std::size_t id;
+		std::size_t index;
+		Value		value;
+	};
+
+	template <typename Value>
+	static cache<Value>& local(const std::size_t id)
+	{
+		static thread_local cache<Value> c[slots] = {};
+		return c[id % slots];
+	}
+
+public:
+	Shared(const Base& exp, const std::size_t identifier) : expression(exp), id(identifier) {}
+
+	// Ids handed out are never 0
+	static std::size_t next_id()
+	{
+		static std::atomic<std::size_t> counter(1);
+		return counter.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	iterator begin() { return expression.begin(); }
+	iterator end()	 { return expression.end(); }
+
+	const_iterator cbegin() const { return expression.cbegin(); }
+	const_iterator cend()	const { return expression.cend(); }
+
+	const Base& operand()	 const { return expression; }
+	std::size_t identifier() const { return id; }
+
+	std::size_t size() const { return expression.size(); }
+
+	value_type operator [] (std::size_t i) const
+	{
+		if (id == 0) return expression[i];
+
+		cache<value_type>& c	 = local<value_type>(id);
+		const std::size_t epoch = vap::detail::epoch();
+
+		if (c.epoch != epoch || c.id != id || c.index != i)
+		{
+			c.value = expression[i];
+			c.epoch = epoch;
+			c.id	= id;
+			c.index = i;
+		}
+
+		return c.value;
+	}
+
+	template <class Packet>
+	Packet packet(std::size_t i) const
+	{
+		if (id == 0) return expression.template packet<Packet>(i);
+
+		cache<Packet>& c	 = local<Packet>(id);
+		const std::size_t epoch = vap::detail::epoch();
+
+		if (c.epoch != epoch || c.id != id || c.index != i)
+		{
+			c.value = expression.template packet<Packet>(i);
+			c.epoch = epoch;
+			c.id	= id;
+			c.index = i;
+		}
+
+		return c.value;
+	}
+};
+
+template <typename T>
+struct expression_traits<Shared<T>>
+{
+	static const bool is_operator	= false;
+	static const bool packet_access = expression_traits<typename T::Derived>::packet_access;
+
+	// Every occurrence is counted: which one computes the value is only known at run time
+	// (see cost_of in expressions/cost.h)
+	static const std::size_t loads			 = expression_traits<typename T::Derived>::loads;
+	static const std::size_t bytes			 = expression_traits<typename T::Derived>::bytes;
+	static const std::size_t flops			 = expression_traits<typename T::Derived>::flops;
+	static const std::size_t transcendentals = expression_traits<typename T::Derived>::transcendentals;
+	static const std::size_t depth			 = expression_traits<typename T::Derived>::depth;
+
+	using exec			 = typename T::exec;
+	using value_type	 = typename T::value_type;
+	using iterator		 = typename T::iterator;
+	using const_iterator = typename T::const_iterator;
+};
+
+} // end namespace expressions
+
+namespace detail {
+
+template <typename T>
+struct aliasing <expressions::Shared<T>>
+{
+	template <class C>
+	using may_read = typename aliasing<typename T::Derived>::template may_read<C>;
+
+	template <class C>
+	static alias classify(const C& destination, const expressions::Shared<T>& e)
+	{ return aliasing<typename T::Derived>::classify(destination, e.operand()); }
+};
+
+} // end namespace detail
+} // end namespace vap
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/vector.h>
+#include <vap/fused.h>
+#include <vap/detail/constructors.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/operators.h>
+#include <vap/execution_policy.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace vap	 {
+namespace fields {
+
+// Leaf of field expressions: N components of T, each one stored in its own vector
+template <typename T, std::size_t N, class Constructor, class Exec>
+struct storage {};
+
+// Expression whose elements have N components, such as velocities or positions, stored
+// as a structure of arrays. Node is a binary, unary or cross_product node below; a
+// field is an expression of storage. Component k of a field expression is an ordinary
+// expression of vectors, so that the components are evaluated with packets.
+template <class Node>
+class expression
+{
+private:
+	Node node;
+
+public:
+	static const std::size_t components = Node::components;
+
+	// Type of the components, which also lets numbers be broadcast as in vap::operators
+	using value_type = typename std::decay_t<decltype(std::declval<const Node&>().component(0))>::value_type;
+
+	explicit expression(const Node& n) : node(n) {}
+
+	// Expression of component k of every element
+	auto component(const std::size_t k) const { return node.component(k); }
+
+	std::size_t size() const { return node.size(); }
+};
+
+template <class X>
+struct is_field : std::false_type {};
+
+template <class Node>
+struct is_field <expression<Node>> : std::true_type {};
+
+template <class X, bool = is_field<X>::value>
+struct components_of : std::integral_constant<std::size_t, 0> {};
+
+template <class X>
+struct components_of <X, true> : std::integral_constant<std::size_t, X::components> {};
+
+namespace detail {
+
+// Fields are referenced by the nodes, as vectors are by expression nodes; other field
+// expressions are held by value, and expressions of vectors and numbers as in Binary
+template <class X>
+struct operand
+{
+	using type = vap::detail::operand_t<X>;
+};
+
+template <class Node>
+struct operand <expression<Node>>
+{
+	using type = expression<Node>;
+};
+
+template <typename T, std::size_t N, class Constructor, class Exec>
+struct operand <expression<storage<T, N, Constructor, Exec>>>
+{
+	using type = const expression<storage<T, N, Constructor, Exec>>&;
+};
+
+template <class X>
+using operand_t = typename operand<X>::type;
+
+// Component k of a field, and the same expression or number for every component
+// otherwise: a per-element expression multiplies every component
+template <class Node>
+decltype(auto) part(const expression<Node>& f, const std::size_t k) { return f.component(k); }
+
+template <class X>
+const X& part(const X& x, const std::size_t) { return x; }
+
+template <class Node>
+std::size_t size_of(const expression<Node>& f) { return f.size(); }
+
+template <class X>
+std::size_t size_of(const X&) { return 0; }
+
+// Operations of the components, by the operators of vap::operators
+struct plus
+{
+	template <class A, class B>
+	auto operator () (const A& a, const B& b) const { return vap::operators::operator + (a, b); }
+};
+
+struct minus
+{
+	template <class A, class B>
+	auto operator () (const A& a, const B& b) const { return vap::operators::operator - (a, b); }
+};
+
+struct multiplies
+{
+	template <class A, class B>
+	auto operator () (const A& a, const B& b) const { return vap::operators::operator * (a, b); }
+};
+
+struct divides
+{
+	template <class A, class B>
+	auto operator () (const A& a, const B& b) const { return vap::operators::operator / (a, b); }
+};
+
+struct negate
+{
+	template <class A>
+	auto operator () (const A& a) const { return vap::operators::operator - (a); }
+};
+
+// Sum of the products of the components 0 to K of a and b
+template <std::size_t K>
+struct products
+{
+	template <class A, class B>
+	static auto apply(const A& a, const B& b)
+	{ return vap::operators::operator + (products<K - 1>::apply(a, b), vap::operators::operator * (a.component(K), b.component(K))); }
+};
+
+template <>
+struct products <0>
+{
+	template <class A, class B>
+	static auto apply(const A& a, const B& b) { return vap::operators::operator * (a.component(0), b.component(0)); }
+};
+
+} // end namespace detail
+
+/*=======*/
+/* Nodes */
+/*=======*/
+template <class L, class R, class Op>
+class binary
+{
+private:
+	detail::operand_t<L> lhs;
+	detail::operand_t<R> rhs;
+	std::size_t			 n;
+
+public:
+	static_assert(
+		components_of<L>::value == 0 || components_of<R>::value == 0 || components_of<L>::value == components_of<R>::value,
+		"fields::binary: fields of different numbers of components");
+
+	static const std::size_t components = std::max(components_of<L>::value, components_of<R>::value);
+
+	binary(const L& l, const R& r) : lhs(l), rhs(r), n(std::max(detail::size_of(l), detail::size_of(r)))
+	{ assert(detail::size_of(l) == 0 || detail::size_of(r) == 0 || detail::size_of(l) == detail::size_of(r)); }
+
+	auto component(const std::size_t k) const { return Op()(detail::part(lhs, k), detail::part(rhs, k)); }
+
+	std::size_t size() const { return n; }
+};
+
+template <class E, class Op>
+class unary
+{
+private:
+	detail::operand_t<E> operand;
+
+public:
+	static const std::size_t components = E::components;
+
+	explicit unary(const E& e) : operand(e) {}
+
+	auto component(const std::size_t k) const { return Op()(operand.component(k)); }
+
+	std::size_t size() const { return operand.size(); }
+};
+
+// Component k of a x b is a[k + 1] b[k + 2] - a[k + 2] b[k + 1], indices modulo 3
+template <class A, class B>
+class cross_product
+{
+private:
+	detail::operand_t<A> a;
+	detail::operand_t<B> b;
+
+public:
+	static const std::size_t components = 3;
+
+	cross_product(const A& x, const B& y) : a(x), b(y) { assert(x.size() == y.size()); }
+
+	auto component(const std::size_t k) const
+	{
+		const std::size_t i = (k + 1) % 3, j = (k + 2) % 3;
+		return vap::operators::operator - (vap::operators::operator * (a.component(i), b.component(j)),
+										   vap::operators::operator * (a.component(j), b.component(i)));
+	}
+
+	std::size_t size() const { return a.size(); }
+};
+
+/*========*/
+/* Fields */
+/*========*/
+// Assigning a field expression evaluates all of its components in a single loop with
+// fused::evaluate, with the constructor policy of the components, and through
+// temporaries when a component reads another component of the destination
+// (u = cross(u, w)).
+template <typename T, std::size_t N, class Constructor, class Exec>
+class expression <storage<T, N, Constructor, Exec>>
+{
+public:
+	using component_type = vap::vector<T, Constructor, std::vector<T>, Exec>;
+	using value_type	 = T;
+
+	static const std::size_t components = N;
+
+	static_assert(N > 0 && N <= 10, "vap::field: 1 to 10 components supported, see fused::evaluate");
+
+private:
+	std::array<component_type, N> parts;
+
+	template <class F, std::size_t... K>
+	void assign_from(const F& f, std::index_sequence<K...>)
+	{
+		vap::fused::evaluate(std::tie(parts[K]...), std::forward_as_tuple(f.component(K)...));
+	}
+
+	template <class F>
+	void assign_from(const F& f)
+	{
+		static_assert(F::components == N, "vap::field: fields of different numbers of components");
+		assign_from(f, std::make_index_sequence<N>());
+	}
+
+public:
+	expression() {}
+
+	explicit expression(const std::size_t n)
+	{
+		for (auto& p : parts) p.resize(n);
+	}
+
+	expression(const expression&) = default;
+	expression(expression&&)	  = default;
+
+	template <class Node>
+	expression(const expression<Node>& f) { assign_from(f); }
+
+	expression& operator = (const expression& f)
+	{
+		if (this != &f) parts = f.parts;
+		return *this;
+	}
+
+	expression& operator = (expression&&) = default;
+
+	template <class Node>
+	expression& operator = (const expression<Node>& f)
+	{
+		assign_from(f);
+		return *this;
+	}
+
+	// f += g, f *= dot(u, v), f /= 2, ...: updates every component in one pass
+	template <class X>
+	expression& operator += (const X& x)
+	{
+		assign_from(expression<binary<expression, X, detail::plus>>(binary<expression, X, detail::plus>(*this, x)));
+		return *this;
+	}
+
+	template <class X>
+	expression& operator -= (const X& x)
+	{
+		assign_from(expression<binary<expression, X, detail::minus>>(binary<expression, X, detail::minus>(*this, x)));
+		return *this;
+	}
+
+	template <class X>
+	expression& operator *= (const X& x)
+	{
+		assign_from(expression<binary<expression, X, detail::multiplies>>(binary<expression, X, detail::multiplies>(*this, x)));
+		return *this;
+	}
+
+	template <class X>
+	expression& operator /= (const X& x)
+	{
+		assign_from(expression<binary<expression, X, detail::divides>>(binary<expression, X, detail::divides>(*this, x)));
+		return *this;
+	}
+
+	// Vector of component k of every element
+	const component_type& component(const std::size_t k) const { return parts[k]; }
+	component_type&		  component(const std::size_t k)	   { return parts[k]; }
+
+	const component_type& operator [] (const std::size_t k) const { return parts[k]; }
+	component_type&		  operator [] (const std::size_t k)		  { return parts[k]; }
+
+	std::size_t size() const { return parts[0].size(); }
+
+	void resize(const std::size_t n)
+	{
+		for (auto& p : parts) p.resize(n);
+	}
+};
+
+/*===========*/
+/* Operators */
+/*===========*/
+// The other operand is a field of as many components, an expression of vectors, which
+// is combined with every component, or a number
+template <class L, class R>
+expression<binary<expression<L>, expression<R>, detail::plus>> operator + (const expression<L>& lhs, const expression<R>& rhs)
+{ return expression<binary<expression<L>, expression<R>, detail::plus>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<expression<L>, R, detail::plus>> operator + (const expression<L>& lhs, const R& rhs)
+{ return expression<binary<expression<L>, R, detail::plus>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<L, expression<R>, detail::plus>> operator + (const L& lhs, const expression<R>& rhs)
+{ return expression<binary<L, expression<R>, detail::plus>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<expression<L>, expression<R>, detail::minus>> operator - (const expression<L>& lhs, const expression<R>& rhs)
+{ return expression<binary<expression<L>, expression<R>, detail::minus>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<expression<L>, R, detail::minus>> operator - (const expression<L>& lhs, const R& rhs)
+{ return expression<binary<expression<L>, R, detail::minus>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<L, expression<R>, detail::minus>> operator - (const L& lhs, const expression<R>& rhs)
+{ return expression<binary<L, expression<R>, detail::minus>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<expression<L>, expression<R>, detail::multiplies>> operator * (const expression<L>& lhs, const expression<R>& rhs)
+{ return expression<binary<expression<L>, expression<R>, detail::multiplies>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<expression<L>, R, detail::multiplies>> operator * (const expression<L>& lhs, const R& rhs)
+{ return expression<binary<expression<L>, R, detail::multiplies>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<L, expression<R>, detail::multiplies>> operator * (const L& lhs, const expression<R>& rhs)
+{ return expression<binary<L, expression<R>, detail::multiplies>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<expression<L>, expression<R>, detail::divides>> operator / (const expression<L>& lhs, const expression<R>& rhs)
+{ return expression<binary<expression<L>, expression<R>, detail::divides>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<expression<L>, R, detail::divides>> operator / (const expression<L>& lhs, const R& rhs)
+{ return expression<binary<expression<L>, R, detail::divides>>({ lhs, rhs }); }
+
+template <class L, class R>
+expression<binary<L, expression<R>, detail::divides>> operator / (const L& lhs, const expression<R>& rhs)
+{ return expression<binary<L, expression<R>, detail::divides>>({ lhs, rhs }); }
+
+template <class E>
+expression<unary<expression<E>, detail::negate>> operator - (const expression<E>& e)
+{ return expression<unary<expression<E>, detail::negate>>(unary<expression<E>, detail::negate>(e)); }
+
+/*=====================*/
+/* Per-element products */
+/*=====================*/
+// Expression of the dot product of the elements of a and b: a[0] b[0] + a[1] b[1] + ...,
+// evaluated with fused multiply-adds by the rewrite pass
+template <class A, class B>
+auto dot(const expression<A>& a, const expression<B>& b)
+{
+	static_assert(expression<A>::components == expression<B>::components, "fields::dot: fields of different numbers of components");
+	assert(a.size() == b.size());
+
+	return detail::products<expression<A>::components - 1>::apply(a, b);
+}
+
+// Expression of the Euclidean norm of the elements of a, without scaling
+template <class A>
+auto norm(const expression<A>& a)
+{
+	return vap::operators::operator ^ (dot(a, a), vap::constant<1, 2>());
+}
+
+// Field expression of the cross product of the elements of a and b
+template <class A, class B>
+expression<cross_product<expression<A>, expression<B>>> cross(const expression<A>& a, const expression<B>& b)
+{
+	static_assert(
+		expression<A>::components == 3 && expression<B>::components == 3,
+		"fields::cross: fields of 3 components expected");
+
+	return expression<cross_product<expression<A>, expression<B>>>({ a, b });
+}
+
+} // end namespace fields
+
+// Field of n elements of N components each, stored as N vectors of n elements:
+//
+//	vap::field<double, 3> x(n), v(n), a(n);
+//	x += dt * v;							// one loop, three components
+//	vap::vector<double, ...> k = 0.5 * dot(v, v);
+//	a = cross(v, b) / norm(v);
+//
+// Every component is a vap::vector<T, Constructor, std::vector<T>, Exec>, available as
+// x[k], and the operators work component by component with the operators of
+// vap::operators, so that one loop evaluates all the components with packets.
+template <typename T, std::size_t N, class Constructor = constructors::SIMD, class Exec = serial_execution>
+using field = fields::expression<fields::storage<T, N, Constructor, Exec>>;
+
+} // end namespace vap
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/alias.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/rewrite.h>
+#include <vap/simd/evaluate.h>
+
+#include <boost/iterator/zip_iterator.hpp>
+#include <boost/tuple/tuple.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace vap   {
+namespace fused {
+namespace detail {
+
+// Expands f(...) for every element of a pack, in order
+using expand = int[];
+
+template <bool... B>
+struct all : std::is_same<std::integer_sequence<bool, true, B...>, std::integer_sequence<bool, B..., true>> {};
+
+using vap::detail::container_t;
+
+// The destination containers of a fused evaluation, seen as a single container of
+// tuples. Element i is a tuple of references, so c[i] = e[i] writes every output.
+template <class... Cs>
+class destination
+{
+private:
+	std::tuple<Cs&...> containers;
+
+	template <std::size_t... K>
+	auto at(const std::size_t i, std::index_sequence<K...>) { return boost::tie(std::get<K>(containers)[i]...); }
+
+	template <std::size_t... K>
+	auto first(std::index_sequence<K...>) { return boost::make_zip_iterator(boost::make_tuple(std::get<K>(containers).begin()...)); }
+
+public:
+	explicit destination(Cs&... c) : containers(c...) {}
+
+	std::size_t size() const { return std::get<0>(containers).size(); }
+
+	auto operator [] (const std::size_t i) { return at(i, std::index_sequence_for<Cs...>()); }
+	auto begin()						   { return first(std::index_sequence_for<Cs...>()); }
+
+	template <std::size_t K>
+	auto& get() { return std::get<K>(containers); }
+};
+
+// The rewritten expressions of a fused evaluation, seen as a single expression of
+// tuples. Vectors are referenced, as in expression nodes.
+template <class... Es>
+class source
+{
+private:
+	std::tuple<vap::detail::operand_t<Es>...> expressions;
+
+	template <std::size_t... K>
+	auto at(const std::size_t i, std::index_sequence<K...>) const { return value_type(std::get<K>(expressions)[i]...); }
+
+	template <std::size_t... K>
+	auto first(std::index_sequence<K...>) const { return boost::make_zip_iterator(boost::make_tuple(std::get<K>(expressions).cbegin()...)); }
+
+	template <std::size_t... K>
+	auto last(std::index_sequence<K...>) const { return boost::make_zip_iterator(boost::make_tuple(std::get<K>(expressions).cend()...)); }
+
+public:
+	using value_type = boost::tuple<typename Es::value_type...>;
+
+	explicit source(const Es&... e) : expressions(e...) {}
+
+	std::size_t size() const { return std::get<0>(expressions).size(); }
+
+	value_type operator [] (const std::size_t i) const { return at(i, std::index_sequence_for<Es...>()); }
+
+	auto cbegin() const { return first(std::index_sequence_for<Es...>()); }
+	auto cend()	  const { return last(std::index_sequence_for<Es...>()); }
+
+	template <std::size_t K>
+	const auto& get() const { return std::get<K>(expressions); }
+};
+
+// Output k may read its own destination at the index being written, but no other
+// destination: the outputs are written one after the other within a packet
+inline bool conflicts(const vap::detail::alias a, const std::size_t j, const std::size_t k)
+{ return a == vap::detail::alias::partial || (a == vap::detail::alias::exact && j != k); }
+
+template <class C, class... Es, std::size_t... K>
+bool conflicts(const C& c, const std::size_t j, const std::tuple<Es...>& e, std::index_sequence<K...>)
+{
+	bool result = false;
+	(void) expand{ 0, (result = result || conflicts(vap::detail::classify(c, std::get<K>(e)), j, K), 0)... };
+	return result;
+}
+
+template <class V>
+void resize(V& v, const std::size_t n)
+{
+	if (v.size() < n) v.resize(n);
+}
+
+template <class... Vs, class... Es, std::size_t... K>
+void evaluate(std::tuple<Vs&...>& outputs, const std::tuple<Es...>& e, std::index_sequence<K...> indices)
+{
+	const std::size_t n = std::get<0>(e).size();
+	for (const std::size_t size : { std::get<K>(e).size()... })
+		assert(size == n), (void) size;
+
+	const source<vap::expressions::rewrite_t<typename std::decay_t<Es>::Derived>...> s(vap::rewrite(std::get<K>(e).derived())...);
+
+	bool temporaries = false;
+	(void) expand{ 0, (temporaries = temporaries || conflicts(static_cast<const container_t<Vs>&>(std::get<K>(outputs)), K, e, indices), 0)... };
+
+	if (!temporaries)
+	{
+		(void) expand{ 0, (resize(std::get<K>(outputs), n), 0)... };
+
+		destination<container_t<Vs>...> d(static_cast<container_t<Vs>&>(std::get<K>(outputs))...);
+		std::get<0>(outputs).assignment(d, s);
+		return;
+	}
+
+	std::tuple<container_t<Vs>...> results{ container_t<Vs>(n)... };
+
+	destination<container_t<Vs>...> d(std::get<K>(results)...);
+	std::get<0>(outputs).assignment(d, s);
+
+	(void) expand{ 0, (static_cast<container_t<Vs>&>(std::get<K>(outputs)) = std::move(std::get<K>(results)), 0)... };
+}
+
+} // end namespace detail
+
+// Evaluates several expressions of the same size into their destination vectors in a
+// single loop, so that the leaves they have in common are loaded once per element:
+//
+//	vap::fused::evaluate(std::tie(r1, r2), std::make_tuple(a * x + b, sin(x) * y));
+//
+// The loop is run by the constructor policy of the first destination (Loop, STL, SIMD,
+// Parallel, ...). As with operator =, each expression is rewritten first, destinations
+// smaller than the expressions are resized, and every expression reads the values the
+// destinations had before the call: when an expression reads another destination, or
+// other elements of its own, the outputs are evaluated into temporaries first.
+// Up to 10 outputs, the size of a boost::tuple.
+template <class... Vs, class... Es>
+void evaluate(std::tuple<Vs&...> outputs, const std::tuple<Es...>& expressions)
+{
+	static_assert(sizeof...(Vs) == sizeof...(Es), "fused::evaluate: one expression per destination expected");
+	static_assert(sizeof...(Vs) > 0 && sizeof...(Vs) <= 10, "fused::evaluate: 1 to 10 outputs supported");
+	static_assert(
+		detail::all<vap::is_expression<std::decay_t<Es>>::value...>::value,
+		"fused::evaluate: expressions expected");
+
+	detail::evaluate(outputs, expressions, std::index_sequence_for<Vs...>());
+}
+
+} // end namespace fused
+
+namespace simd	 {
+namespace detail {
+
+template <class... Cs, class... Es, isa I>
+struct use_packets <fused::detail::destination<Cs...>, fused::detail::source<Es...>, I>
+{
+	static const bool value = fused::detail::all<use_packets<Cs, Es, I>::value...>::value;
+};
+
+// Every step covers the widest packet among the outputs, and as many packets of each
+// output as fit in it, output after output
+template <class... Cs, class... Es>
+struct packet_loop <fused::detail::destination<Cs...>, fused::detail::source<Es...>>
+{
+	using C = fused::detail::destination<Cs...>;
+	using E = fused::detail::source<Es...>;
+
+	template <isa I, std::size_t K>
+	static void step(C& c, const E& e, const std::size_t i, const std::size_t width)
+	{
+		using Packet = packet<typename std::tuple_element_t<K, std::tuple<Es...>>::value_type, I>;
+
+		auto* out = c.template get<K>().data();
+
+		for (std::size_t j = i; j < i + width; j += Packet::width)
+			vap::simd::store(e.template get<K>().template packet<Packet>(j), out + j);
+	}
+
+	template <isa I, std::size_t... K>
+	static void run(C& c, const E& e, const std::size_t first, const std::size_t last, std::index_sequence<K...>)
+	{
+		const std::size_t width = std::max({ packet<typename Es::value_type, I>::width... });
+
+		std::size_t i = first;
+		for (; i + width <= last; i += width)
+			(void) fused::detail::expand{ 0, (step<I, K>(c, e, i, width), 0)... };
+
+		evaluate_scalar(c, e, i, last);
+	}
+
+	template <isa I>
+	static void run(C& c, const E& e, const std::size_t first, const std::size_t last)
+	{ run<I>(c, e, first, last, std::index_sequence_for<Es...>()); }
+};
+
+} // end namespace detail
+} // end namespace simd
+} // end namespace vap
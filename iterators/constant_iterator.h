@@ -1,6 +1,6 @@
 #pragma once
 
-#include <vap\config.h>
+#include <vap/config.h>
 
 #include <iterator>
 
@@ -16,7 +16,7 @@ namespace vap 		{
 namespace iterators {
 
 template <typename Type>
-class constant_iterator : std::iterator<std::forward_iterator_tag, Type>
+class constant_iterator
 {
 public:
 	using difference_type	= std::size_t;
@@ -26,16 +26,24 @@ public:
 	using iterator_category = std::forward_iterator_tag;
 
 	ANY_SYSTEM
-	constant_iterator(const Type& val) : value(val) {}
+	constant_iterator(const Type& val, const std::size_t index = 0) : value(val), position(index) {}
 
 	ANY_SYSTEM
-	constant_iterator& operator ++() { return *this; }
+	constant_iterator& operator ++() { ++position; return *this; }
 
 	ANY_SYSTEM
-	Type operator *() { return value; }
-	
+	Type operator *() const { return value; }
+
+	// Iterators compare by position, as thrust::constant_iterator
+	ANY_SYSTEM
+	bool operator == (const constant_iterator& other) const { return position == other.position; }
+
+	ANY_SYSTEM
+	bool operator != (const constant_iterator& other) const { return position != other.position; }
+
 private:
-	Type value;
+	Type		value;
+	std::size_t position;
 };
 
 template <typename Type>
@@ -1,19 +1,31 @@
 #pragma once
 
-#include <vap\config.h>
-#include <vap\execution_policy.h>
-#include <vap\iterators\constant_iterator.h>
+#include <vap/config.h>
+#include <vap/execution_policy.h>
+#include <vap/iterators/constant_iterator.h>
 
-#include <boost\iterator\transform_iterator.hpp>
-#include <boost\iterator\zip_iterator.hpp>
-#include <boost\tuple\tuple.hpp>
+#include <boost/iterator/transform_iterator.hpp>
+#include <boost/iterator/zip_iterator.hpp>
+#include <boost/tuple/tuple.hpp>
+
+#ifdef VAP_USING_THRUST
+#include <thrust/iterator/transform_iterator.h>
+#include <thrust/iterator/constant_iterator.h>
+#include <thrust/iterator/zip_iterator.h>
+#include <thrust/tuple.h>
+#endif
 
 namespace vap		{
 namespace iterators {
 
+// The iterator types of the expressions under each execution policy. make builds one
+// from the functor and the iterators of the operands.
 template <typename T>
 struct binary_iterator {};
 
+template <typename T>
+struct ternary_iterator {};
+
 template <typename T>
 struct unary_iterator {};
 
@@ -28,6 +40,24 @@ struct binary_iterator <serial_execution>
 										   boost::zip_iterator<
 										   boost::tuple<LeftIterator, Right_Iterator>> , typename
 										   UnaryFunc::result_type>;
+
+	template <class UnaryFunc, class LeftIterator, class RightIterator>
+	static type<UnaryFunc, LeftIterator, RightIterator> make(const UnaryFunc& f, const LeftIterator& l, const RightIterator& r)
+	{ return type<UnaryFunc, LeftIterator, RightIterator>(boost::make_zip_iterator(boost::make_tuple(l, r)), f); }
+};
+
+template <>
+struct ternary_iterator <serial_execution>
+{
+	template <class UnaryFunc, class FirstIterator, class SecondIterator, class ThirdIterator>
+	using type = boost::transform_iterator<UnaryFunc,
+										   boost::zip_iterator<
+										   boost::tuple<FirstIterator, SecondIterator, ThirdIterator>>, typename
+										   UnaryFunc::result_type>;
+
+	template <class UnaryFunc, class FirstIterator, class SecondIterator, class ThirdIterator>
+	static type<UnaryFunc, FirstIterator, SecondIterator, ThirdIterator> make(const UnaryFunc& f, const FirstIterator& x, const SecondIterator& y, const ThirdIterator& z)
+	{ return type<UnaryFunc, FirstIterator, SecondIterator, ThirdIterator>(boost::make_zip_iterator(boost::make_tuple(x, y, z)), f); }
 };
 
 template <>
@@ -37,15 +67,16 @@ struct unary_iterator <serial_execution>
 	using type = boost::transform_iterator<UnaryFunc,
 										   Iterator, typename 
 										   UnaryFunc::result_type>;
+
+	template <class UnaryFunc, class Iterator>
+	static type<UnaryFunc, Iterator> make(const UnaryFunc& f, const Iterator& i)
+	{ return type<UnaryFunc, Iterator>(i, f); }
 };
 
 #ifdef VAP_USING_THRUST
 
-#include <thrust\iterator\transform_iterator.h>
-#include <thrust\iterator\constant_iterator.h>
-#include <thrust\iterator\zip_iterator.h>
-#include <thrust\tuple.h>
-
+// The thrust iterators are usable from every thrust system (CUDA, OMP, TBB, CPP);
+// the system itself is chosen by the vector's constructor policy.
 template <>
 struct binary_iterator <parallel_execution>
 {
@@ -54,6 +85,24 @@ struct binary_iterator <parallel_execution>
 											thrust::zip_iterator<
 											thrust::tuple<LeftIterator, RightIterator>>, typename
 											UnaryFunc::result_type>;
+
+	template <class UnaryFunc, class LeftIterator, class RightIterator>
+	static type<UnaryFunc, LeftIterator, RightIterator> make(const UnaryFunc& f, const LeftIterator& l, const RightIterator& r)
+	{ return type<UnaryFunc, LeftIterator, RightIterator>(thrust::make_zip_iterator(thrust::make_tuple(l, r)), f); }
+};
+
+template <>
+struct ternary_iterator <parallel_execution>
+{
+	template <class UnaryFunc, class FirstIterator, class SecondIterator, class ThirdIterator>
+	using type = thrust::transform_iterator<UnaryFunc,
+											thrust::zip_iterator<
+											thrust::tuple<FirstIterator, SecondIterator, ThirdIterator>>, typename
+											UnaryFunc::result_type>;
+
+	template <class UnaryFunc, class FirstIterator, class SecondIterator, class ThirdIterator>
+	static type<UnaryFunc, FirstIterator, SecondIterator, ThirdIterator> make(const UnaryFunc& f, const FirstIterator& x, const SecondIterator& y, const ThirdIterator& z)
+	{ return type<UnaryFunc, FirstIterator, SecondIterator, ThirdIterator>(thrust::make_zip_iterator(thrust::make_tuple(x, y, z)), f); }
 };
 
 template <>
@@ -63,6 +112,10 @@ struct unary_iterator <parallel_execution>
 	using type = thrust::transform_iterator<UnaryFunc,
 											Iterator, typename 
 											UnaryFunc::result_type>;
+
+	template <class UnaryFunc, class Iterator>
+	static type<UnaryFunc, Iterator> make(const UnaryFunc& f, const Iterator& i)
+	{ return type<UnaryFunc, Iterator>(i, f); }
 };
 
 template <>
@@ -74,6 +127,17 @@ struct scalar_iterator <absorption_policy>
 
 #else 
 
+// Without thrust, parallel evaluation happens on the library's thread pool through
+// Expression::operator[], so the serial iterators are sufficient.
+template <>
+struct binary_iterator <parallel_execution> : binary_iterator <serial_execution> {};
+
+template <>
+struct ternary_iterator <parallel_execution> : ternary_iterator <serial_execution> {};
+
+template <>
+struct unary_iterator <parallel_execution> : unary_iterator <serial_execution> {};
+
 template <>
 struct scalar_iterator <absorption_policy>
 {
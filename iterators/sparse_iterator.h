@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vap/config.h>
+
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace vap		{
+namespace iterators {
+
+// Random-access iterator over the dense elements of a sparse vector (sparse.h): zero
+// outside of the sorted indices of the non-zeros. Stepping forward follows the
+// non-zeros, so that a sequential pass costs O(1) per element.
+template <typename Type>
+class sparse_iterator :
+	public boost::iterator_facade<sparse_iterator<Type>, const Type, boost::random_access_traversal_tag, Type>
+{
+private:
+	friend class boost::iterator_core_access;
+
+	const std::size_t* indices;
+	const Type*		   values;
+	std::size_t		   count;
+	std::size_t		   position;
+	std::size_t		   next;		// first non-zero at or after position
+
+	void seek() { next = std::lower_bound(indices, indices + count, position) - indices; }
+
+	Type dereference() const { return next < count && indices[next] == position ? values[next] : Type(0); }
+
+	bool equal(const sparse_iterator& other) const { return position == other.position; }
+
+	void increment()
+	{
+		++position;
+		if (next < count && indices[next] < position) ++next;
+	}
+
+	void decrement()
+	{
+		--position;
+		if (next > 0 && indices[next - 1] >= position) --next;
+	}
+
+	void advance(const std::ptrdiff_t n)
+	{
+		position += n;
+		seek();
+	}
+
+	std::ptrdiff_t distance_to(const sparse_iterator& other) const { return std::ptrdiff_t(other.position) - std::ptrdiff_t(position); }
+
+public:
+	sparse_iterator() : indices(nullptr), values(nullptr), count(0), position(0), next(0) {}
+
+	sparse_iterator(const std::size_t* i, const Type* v, const std::size_t n, const std::size_t p) :
+		indices(i), values(v), count(n), position(p)
+	{ seek(); }
+};
+
+} // end namespace iterators
+
+using iterators::sparse_iterator;
+
+} // end namespace vap
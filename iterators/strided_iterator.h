@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vap/config.h>
+
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <cstddef>
+#include <type_traits>
+
+namespace vap		{
+namespace iterators {
+
+// Random-access iterator over elements stride apart, the iterator of a view (view.h).
+// It holds the first element and an index, so that the end of a view is not formed by
+// stepping a pointer past the end of the underlying array.
+template <typename Type>
+class strided_iterator :
+	public boost::iterator_facade<strided_iterator<Type>, Type, boost::random_access_traversal_tag>
+{
+private:
+	friend class boost::iterator_core_access;
+
+	Type*		   first;
+	std::ptrdiff_t stride;
+	std::ptrdiff_t position;
+
+	Type& dereference() const { return first[position * stride]; }
+
+	bool equal(const strided_iterator& other) const { return position == other.position; }
+
+	void increment() { ++position; }
+	void decrement() { --position; }
+
+	void advance(const std::ptrdiff_t n) { position += n; }
+
+	std::ptrdiff_t distance_to(const strided_iterator& other) const { return other.position - position; }
+
+public:
+	strided_iterator() : first(nullptr), stride(1), position(0) {}
+	strided_iterator(Type* p, const std::ptrdiff_t step, const std::ptrdiff_t i = 0) : first(p), stride(step), position(i) {}
+
+	// A mutable iterator converts to a const one
+	template <typename Other,
+			  typename = std::enable_if_t<std::is_convertible<Other*, Type*>::value>>
+	strided_iterator(const strided_iterator<Other>& other) : first(other.base()), stride(other.step()), position(other.index()) {}
+
+	Type*		   base()  const { return first; }
+	std::ptrdiff_t step()  const { return stride; }
+	std::ptrdiff_t index() const { return position; }
+};
+
+} // end namespace iterators
+
+using iterators::strided_iterator;
+
+} // end namespace vap
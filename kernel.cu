@@ -1,194 +1,130 @@
 // Expression Template Operators.cpp : Defines the entry point for the console application.
+// Builds with nvcc for CUDA, or with the host compiler (-x c++) for the CPU backends:
+// -DTHRUST_DEVICE_SYSTEM=THRUST_DEVICE_SYSTEM_OMP (or _TBB, _CPP).
 
-#include "cuda_runtime.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <vector>
+
+#include <thrust/device_vector.h>
+#include <thrust/transform.h>
 
-#include <Stopwatch.h>
-#include <RuntimeTest.h>
-#include <Algebra\Vector_Operators.h>
+#if THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_CUDA
+#include "cuda_runtime.h"
+#endif
 
-#include <thrust\device_vector.h>
-#include "DeviceOperators.h"
+#include <vap/vector.h>
+#include <vap/benchmark/harness.h>
 
-#include <vap\vector.h>
+namespace bench = vap::benchmark;
 
-thrust::device_vector<double> vap_thrust_result;
-thrust::device_vector<double> thrust_std_result;
-std::vector<double> vap_loop_result;
-std::vector<double> vap_stl_result;
-std::vector<double> std_result;
-std::vector<double> loop_result;
+// Thrust system matching the configured device system
+#if THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_OMP
+using System = vap::systems::omp;
+#elif THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_TBB
+using System = vap::systems::tbb;
+#elif THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_CPP
+using System = vap::systems::cpp;
+#else
+using System = vap::systems::device;
+#endif
 
-const double pi = 3.14159265358979323846;
-const double pi2 = pi*pi;
+using Thrust_Ctor = vap::constructors::Thrust_System<System>;
 
 using std::endl;
 
-#define DURATION(timer) timer.nanoseconds().to_seconds()
+// cos(y) * x + y - x, written by hand as a thrust functor
+struct Mixed
+{
+	__host__ __device__
+	double operator () (const double x, const double y) const { return cos(y) * x + y - x; }
+};
+
+// Two loads and a store of doubles, 3 flops and a cosine per element
+bench::work cost() { return { 3 * sizeof(double), 3, 1 }; }
 
-template <typename V, typename Out>
-double test(const V* _x, const V* _y, Out* output)
+template <typename V>
+void setup(const std::size_t N, V& x, V& y)
 {
-	using namespace vector_operators::vector;
-	using namespace thrust_operators::vector;
-	using namespace vap::operators;
+	std::vector<double> hx(N), hy(N);
+	for (std::size_t i = 0; i < N; ++i)
+	{
+		hx[i] = 2.1 + 1e-6 * i;
+		hy[i] = 2 - 1e-7 * i;
+	}
 
-	Stopwatch timer;
+	x.resize(N);
+	y.resize(N);
+	thrust::copy(hx.begin(), hx.end(), x.begin());
+	thrust::copy(hy.begin(), hy.end(), y.begin());
+}
 
-	const std::size_t N = _x->size();
-	const V& x = *_x;
-	const V& y = *_y;
+// Waits for the device, so that the timings cover the whole evaluation
+void synchronize()
+{
+#if THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_CUDA
+	cudaDeviceSynchronize();
+#endif
+}
 
-	timer.start();
-	const V result;// = cos(y)*x + y - x;
-	timer.stop();
+template <typename V>
+std::vector<double> host(const V& v)
+{
+	std::vector<double> result(v.size());
+	thrust::copy(v.begin(), v.end(), result.begin());
+	return result;
+}
+
+double difference(const std::vector<double>& a, const std::vector<double>& b)
+{
+	double error = 0;
+	for (std::size_t i = 0; i < a.size(); ++i)
+		error = std::max(error, std::fabs(a[i] - b[i]));
 
-	*output = result;
-	return DURATION(timer);
+	return error;
 }
 
-template <typename V, typename Out>
-double test_Loop(const V* _x, const V* _y, Out* output)
+void runTests(const bench::options& o, bench::report& report)
 {
-	using T = typename V::value_type;
+	using DVec	= thrust::device_vector<double>;
+	using EDVec = vap::vector<double, Thrust_Ctor, DVec, vap::parallel_execution>;
 
-	Stopwatch timer;
+	double largest = 0;
 
-	const std::size_t N = _x->size();
-	const V& x = *_x;
-	const V& y = *_y;
+	for (const std::size_t N : bench::default_sizes())
+	{
+		DVec x, y;
+		setup(N, x, y);
 
-	timer.start();
-	T* result = new T[N];
-	for (unsigned int j = 0; j < N; j++)
-		result[j] = cos(y[j]) * x[j] + y[j] - x[j];
+		const bench::statistics hand = bench::measure([&] {
+			DVec result(N);
+			thrust::transform(x.begin(), x.end(), y.begin(), result.begin(), Mixed());
+			synchronize();
+		}, o);
 
-	timer.stop();
+		report.add({ "mixed", "thrust", N, cost(), hand });
 
-	output->resize(N);
-	std::copy(result, result + N, output->begin());
+		EDVec ex, ey;
+		setup(N, ex, ey);
 
-	delete[] result;
-	return DURATION(timer);
-}
+		const bench::statistics time = bench::measure([&] {
+			using namespace vap::operators;
+			const EDVec result = cos(ey) * ex + ey - ex;
+			synchronize();
+		}, o);
 
-template <typename V>
-void setup(const std::size_t N, V* x, V* y)
-{
-	using T = typename V::value_type;
+		report.add({ "mixed", "Thrust_System", N, cost(), time });
 
-	x->resize(N);
-	y->resize(N);
+		DVec reference(N);
+		thrust::transform(x.begin(), x.end(), y.begin(), reference.begin(), Mixed());
 
-	x->assign(N, -316376.1);
-	y->assign(N, 362178);
-}
+		using namespace vap::operators;
+		const EDVec result = cos(ey) * ex + ey - ex;
+		largest = std::max(largest, difference(host(result), host(reference)));
+	}
 
-void runTests()
-{
-	typedef double T;
-
-	typedef std::vector<T> Vec;
-	typedef thrust::device_vector<T> DVec;
-
-	std::vector<std::size_t> sizes = {
-		static_cast<std::size_t>(1e1),
-		static_cast<std::size_t>(1e2),
-		static_cast<std::size_t>(1e3),
-		static_cast<std::size_t>(1e4),
-		static_cast<std::size_t>(1e5),
-		static_cast<std::size_t>(2e5),
-		static_cast<std::size_t>(3e5),
-		static_cast<std::size_t>(4e5),
-		static_cast<std::size_t>(5e5),
-		static_cast<std::size_t>(6e5),
-		static_cast<std::size_t>(7e5),
-		static_cast<std::size_t>(1e6),
-		static_cast<std::size_t>(2e6),
-		static_cast<std::size_t>(3e6),/*
-		static_cast<std::size_t>(4e6),
-		static_cast<std::size_t>(5e6),
-		static_cast<std::size_t>(1e7),
-		static_cast<std::size_t>(2e7),
-		static_cast<std::size_t>(3e7),*/
-	};
-
-	Vec x, y;
-	DVec d_x, d_y;
-	vap::vector<T> c_x, c_y;
-	vap::vector<T, vap::constructors::STL> stl_x, stl_y;
-	vap::vector<T, vap::constructors::Thrust, DVec, vap::parallel_execution> ed_x, ed_y;
-
-	RuntimeTest<double> vap_loop(sizes), vap_stl(sizes), vap_thrust(sizes), thrust_std(sizes), std(sizes);
-
-	vap_loop.storeSetup(setup<decltype(c_x)>, &c_x, &c_y);
-	vap_loop.storeTest("Operators_vap_Loop_times.txt", test<decltype(c_x), Vec>, &c_x, &c_y, &vap_loop_result);
-	vap_loop.runAll(10);
-	vap_loop.save();
-
-	//vap_stl.storeSetup(setup<decltype(stl_x)>, &stl_x, &stl_y);
-	//vap_stl.storeTest("Operators_vap_STL_times.txt", test<decltype(stl_x), Vec>, &stl_x, &stl_y, &vap_stl_result);
-	//vap_stl.runAll(10);
-	//vap_stl.save();
-
-	thrust_std.storeSetup(setup<decltype(d_x)>, &d_x, &d_y);
-	thrust_std.storeTest("Operators_Thrust_Std_times.txt", test<decltype(d_x), DVec>, &d_x, &d_y, &thrust_std_result);
-	thrust_std.runAll(10);
-	thrust_std.save();
-
-	vap_thrust.storeSetup(setup<decltype(ed_x)>, &ed_x, &ed_y);
-	vap_thrust.storeTest("Operators_vap_Thrust_times.txt", test<decltype(ed_x), DVec>, &ed_x, &ed_y, &vap_thrust_result);
-	vap_thrust.runAll(10);
-	vap_thrust.save();
-
-	std.storeSetup(setup<Vec>, &x, &y);
-	std.storeTest("Operators_STD_times.txt", test<Vec, Vec>, &x, &y, &std_result);
-	std.storeTest("Operators_Loop_times.txt", test_Loop<Vec, Vec>, &x, &y, &loop_result);
-	std.runAll(10);
-	std.save();
-
-	Vec vap_thrust_host(vap_thrust_result.size());
-	Vec thrust_std_host(vap_thrust_result.size());
-
-	thrust::copy(vap_thrust_result.begin(), vap_thrust_result.end(), vap_thrust_host.begin());
-	thrust::copy(thrust_std_result.begin(), thrust_std_result.end(), thrust_std_host.begin());
-
-	std::cout << "Equality of Answers:"
-		<< endl
-		<< "loop_result == vap_loop_result: "
-		<< std::to_string(loop_result == vap_loop_result)
-		<< endl
-
-		/*<< "loop_result == vap_stl_result: "
-		<< std::to_string(loop_result == vap_stl_result)
-		<< endl*/
-
-		<< "loop_result == thrust_std_host: "
-		<< std::to_string(loop_result == thrust_std_host)
-		<< endl
-
-		<< "loop_result == vap_thrust_host: "
-		<< std::to_string(loop_result == vap_thrust_host)
-		<< endl
-
-		<< "loop_result == std_result: "
-		<< std::to_string(loop_result == std_result)
-		<< endl << endl;
-
-	std::cout << "STD: "		<< std_result[900]		  << endl
-			  << "Loop: "		<< loop_result[900]		  << endl
-			  << "Thrust STD: " << thrust_std_host[900]   << endl
-			  << "vap Thrust: " << vap_thrust_host[900]   << endl
-			  //<< "vap STL: "	<< vap_stl_result[900]    << endl
-			  << "vap Loop: "	<< vap_loop_result[900]   << endl << endl;
-
-	std::cout << "Result vector sizes:"		<< endl;
-	std::cout << "loop_result size: "		<< loop_result.size() << endl;
-	std::cout << "std_result size: "		<< std_result.size() << endl;
-	std::cout << "vap_loop_result size: " << vap_loop_result.size() << endl;
-	std::cout << "thrust_std_host size: " << thrust_std_host.size() << endl;
-	std::cout << "vap_thrust_result size: " << vap_thrust_host.size() << endl;
-	//std::cout << "vap_stl_result size: "	<< vap_stl_result.size() << endl;
+	std::cout << "Largest difference with thrust::transform: " << largest << endl << endl;
 }
 
 template <typename Result>
@@ -207,12 +143,14 @@ int main()
 	using namespace vap::operators;
 	//using namespace vap::operators::unary;
 
+#if THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_CUDA
 	cudaFree(0);
+#endif
 	using T		= double;
 	using Vec	= std::vector<T>;
 	using DVec	= thrust::device_vector<T>;
 	using EVec  = vap::vector<T, vap::constructors::STL, Vec, vap::serial_execution>;
-	using EDVec = vap::vector<T, vap::constructors::Thrust, DVec, vap::parallel_execution>;
+	using EDVec = vap::vector<T, Thrust_Ctor, DVec, vap::parallel_execution>;
 
 	const std::size_t N = 3;
 
@@ -233,7 +171,14 @@ int main()
 
 	std::cout << "Sum = " << result[0] << std::endl;
 
-	//runTests();
+	bench::options o;
+	bench::report  report;
+
+	runTests(o, report);
+
+	report.table(std::cout);
+	report.save_csv("vap_thrust_benchmark.csv");
+	report.save_json("vap_thrust_benchmark.json");
 	return 0;
 }
 
@@ -1,187 +1,193 @@
 // Expression Template Operators.cpp : Defines the entry point for the console application.
-//
-
+// Benchmark suite: times each expression below with every constructor policy and with a
+// hand-written loop, over the size sweep of benchmark::default_sizes. Hardware counters
+// are reported next to the times where perf_event_open is available.
+// Usage: main [--warmup N] [--repetitions N] [--csv path] [--json path]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
-#include <Stopwatch.h>
-#include <RuntimeTest.h>
-#include <Algebra\Vector_Operators.h>
-
-#include "iterators.h"
-#include "vector.h"
-#include "operators.h"
-#include "expressions.h"
+#include <vap/vector.h>
+#include <vap/benchmark/harness.h>
 
-std::vector<double> vap_loop_result;
-std::vector<double> vap_stl_result;
-std::vector<double> std_result;
-std::vector<double> loop_result;
+namespace bench = vap::benchmark;
 
 const double pi = 3.14159265358979323846;
 const double pi2 = pi*pi;
 
 using std::endl;
 
-#define DURATION(timer) timer.nanoseconds().to_seconds()
+// - (2 + pi2 * x * (1 - x)) * cos(pi * y), the published comparison
+struct Poisson
+{
+	static const char* name() { return "poisson"; }
+
+	template <typename V>
+	static auto expression(const V& x, const V& y)
+	{
+		using namespace vap::operators;
+		return - (2 + pi2 * x * (1 - x)) * cos(pi * y);
+	}
+
+	static double element(const double x, const double y) { return - (2 + pi2 * x * (1 - x)) * std::cos(pi * y); }
+};
 
-template <typename V, typename Out>
-double test(const V* _x, const V* _y, Out* output)
+// cos(y) * x + y - x, the thrust comparison of kernel.cu
+struct Mixed
 {
-	using namespace vector_operators::vector;
-	using namespace vap::operators::binary;
-	using namespace vap::operators::unary;
+	static const char* name() { return "mixed"; }
 
-	Stopwatch timer;
+	template <typename V>
+	static auto expression(const V& x, const V& y)
+	{
+		using namespace vap::operators;
+		return cos(y) * x + y - x;
+	}
 
-	const std::size_t N = _x->size();
-	const V& x = *_x;
-	const V& y = *_y;
+	static double element(const double x, const double y) { return std::cos(y) * x + y - x; }
+};
 
-	V v_1(N), v_2(N), v_pi(N), v_pi2(N);
-	v_1.assign(N, 1);
-	v_2.assign(N, 2);
-	v_pi.assign(N, pi);
-	v_pi2.assign(N, pi2);
+// Cost per element of the expression the policies evaluate, after rewriting
+template <class Benchmark>
+vap::cost cost()
+{
+	const vap::vector<double> x(1), y(1);
+	return vap::cost_of(vap::rewrite(Benchmark::expression(x, y)));
+}
+
+template <typename V>
+void setup(const std::size_t N, V& x, V& y)
+{
+	x.resize(N);
+	y.resize(N);
+
+	// Varying values keep the cosine off its fast paths
+	std::vector<double>& xs = x;
+	std::vector<double>& ys = y;
+	for (std::size_t i = 0; i < N; ++i)
+	{
+		xs[i] = 2.1 + 1e-6 * i;
+		ys[i] = 2 - 1e-7 * i;
+	}
+}
 
-	timer.start();
-	const V result = - (v_2 + v_pi2 * x * (v_1 - x)) * cos (v_pi * y);
-	timer.stop();
+// Largest difference with the hand-written loop
+template <typename V>
+double difference(const V& result, const std::vector<double>& reference)
+{
+	double error = 0;
+	for (std::size_t i = 0; i < reference.size(); ++i)
+		error = std::max(error, std::fabs(result[i] - reference[i]));
 
-	*output = result;
-	return DURATION(timer);
+	return error;
 }
 
-template <typename V, typename Out>
-double test_Loop(const V* _x, const V* _y, Out* output)
+template <class Benchmark>
+std::vector<double> test_Loop(const std::size_t N, const bench::options& o, bench::report& report)
 {
-	typedef V::value_type T;
-	Stopwatch timer;
+	std::vector<double> x(N), y(N), output;
+	for (std::size_t i = 0; i < N; ++i)
+	{
+		x[i] = 2.1 + 1e-6 * i;
+		y[i] = 2 - 1e-7 * i;
+	}
 
-	const std::size_t N = _x->size();
-	const V& x = *_x;
-	const V& y = *_y;
+	bench::counts events;
+	const bench::statistics time = bench::measure([&] {
+		std::unique_ptr<double[]> result(new double[N]);
+		for (std::size_t j = 0; j < N; ++j)
+			result[j] = Benchmark::element(x[j], y[j]);
 
-	timer.start();
-	T* result = new T[N];
-	for (unsigned int j = 0; j < N; j++)
-		result[j] = - (2 + pi2 * x[j] * (1 - x[j])) * cos (pi * y[j]);
+		bench::escape(result.get());
+	}, o, events);
 
-	timer.stop();
+	report.add({ Benchmark::name(), "hand loop", N, bench::work_of(cost<Benchmark>()), time, events });
 
-	output->resize(N);
-	std::copy(result, result + N, output->begin());
+	output.resize(N);
+	for (std::size_t j = 0; j < N; ++j)
+		output[j] = Benchmark::element(x[j], y[j]);
 
-	delete[] result;
-	return DURATION(timer);
+	return output;
 }
 
-template <typename V>
-void setup(const std::size_t N, V* x, V* y)
+template <class Benchmark, class Ctor>
+double test(const char* variant, const std::size_t N, const bench::options& o, bench::report& report, const std::vector<double>& reference)
 {
-	typedef V::value_type T;
+	using V = vap::vector<double, Ctor>;
+
+	V x, y;
+	setup(N, x, y);
 
-	x->resize(N);
-	y->resize(N);
+	bench::counts events;
+	const bench::statistics time = bench::measure([&] {
+		const V result = Benchmark::expression(x, y);
+		bench::escape(&result[0]);
+	}, o, events);
 
-	x->assign(N, 2.1);
-	y->assign(N, 2);
+	report.add({ Benchmark::name(), variant, N, bench::work_of(cost<Benchmark>()), time, events });
+
+	return difference(V(Benchmark::expression(x, y)), reference);
 }
 
-void runTests()
+template <class Benchmark>
+void runTests(const std::vector<std::size_t>& sizes, const bench::options& o, bench::report& report)
 {
-	typedef double T;
-
-	typedef std::vector<T> Vec;
-
-	std::vector<std::size_t> sizes = {
-		static_cast<std::size_t>(1e4),
-		static_cast<std::size_t>(1e5),
-		static_cast<std::size_t>(2e5),
-		static_cast<std::size_t>(3e5),
-		static_cast<std::size_t>(4e5),
-		static_cast<std::size_t>(5e5),
-		static_cast<std::size_t>(6e5),
-		static_cast<std::size_t>(7e5),
-		static_cast<std::size_t>(1e6),
-		static_cast<std::size_t>(2e6),
-		static_cast<std::size_t>(3e6),
-		static_cast<std::size_t>(4e6),
-		static_cast<std::size_t>(5e6),
-	};
-
-	const std::size_t N = static_cast<std::size_t>(1e6);
-
-	std::vector<T> x, y;
-	vap::vector<T> c_x, c_y;
-	vap::vector<T, vap::constructors::STL> stl_x, stl_y;
-
-	RuntimeTest<double> vap_loop(sizes), vap_stl(sizes), vap_thrust(sizes), std(sizes);
-
-	vap_loop.storeSetup(setup<vap::vector<T>>, &c_x, &c_y);
-	vap_loop.storeTest("Operators_vap_Loop_times.txt", test<vap::vector<T>, Vec>, &c_x, &c_y, &vap_loop_result);
-	vap_loop.runAll(10);
-	vap_loop.save();
-
-	vap_stl.storeSetup(setup<vap::vector<T, vap::constructors::STL>>, &stl_x, &stl_y);
-	vap_stl.storeTest("Operators_vap_STL_times.txt", test<vap::vector<T, vap::constructors::STL>, Vec>, &stl_x, &stl_y, &vap_stl_result);
-	vap_stl.runAll(10);
-	vap_stl.save();
-			
-	/*vap_thrust.storeSetup(setup<vap::vector<T, vap::constructors::STL>>, &stl_x, &stl_y);
-	vap_thrust.storeTest("Operators_vap_STL_times.txt", test<vap::vector<T, vap::constructors::STL>, Vec>, &stl_x, &stl_y, &vap_stl_result);
-	vap_thrust.runAll(10);
-	vap_thrust.save();*/
-
-	std.storeSetup(setup<std::vector<T>>, &x, &y);
-	std.storeTest("Operators_STD_times.txt", test<std::vector<T>, Vec>, &x, &y, &std_result);
-	std.storeTest("Operators_Loop_times.txt", test_Loop<std::vector<T>, Vec>, &x, &y, &loop_result);
-	std.runAll(10);
-	std.save();
-
-	std::cout << "Equality of Answers:"
-			  << endl
-			  << "loop_result == vap_loop_result: " 
-			  <<  std::to_string(loop_result == vap_loop_result) 
-			  << endl
-
-			  << "loop_result == vap_stl_result: " 
-			  <<  std::to_string(loop_result == vap_stl_result) 
-			  << endl
-
-			  << "loop_result == std_result: " 
-			  <<  std::to_string(loop_result == std_result) 
-			  << endl;
-
-	std::cout << "STD: "		<< std_result[900]			<< endl
-			  << "Loop: "		<< loop_result[900]			<< endl
-			  << "vap STL: "	<< vap_stl_result[900]	<< endl
-			  << "vap Loop: " << vap_loop_result[900]	<< endl;
-
-	std::cout << "Result vector sizes:"		<< endl;
-	std::cout << "loop_result size: "		<< loop_result.size()		<< endl;
-	std::cout << "std_result size: "		<< std_result.size()		<< endl;
-	std::cout << "vap_loop_result size: " << vap_loop_result.size() << endl;
-	std::cout << "vap_stl_result size: "	<< vap_stl_result.size()	<< endl;
+	double loop = 0, stl = 0, simd = 0, parallel = 0;
+
+	for (const std::size_t N : sizes)
+	{
+		const std::vector<double> reference = test_Loop<Benchmark>(N, o, report);
+
+		loop	 = std::max(loop,	  test<Benchmark, vap::constructors::Loop>("Loop", N, o, report, reference));
+		stl		 = std::max(stl,	  test<Benchmark, vap::constructors::STL>("STL", N, o, report, reference));
+		simd	 = std::max(simd,	  test<Benchmark, vap::constructors::SIMD>("SIMD", N, o, report, reference));
+		parallel = std::max(parallel, test<Benchmark, vap::constructors::Parallel>("Parallel", N, o, report, reference));
+	}
+
+	std::cout << "Largest difference with the hand loop (" << Benchmark::name() << "):" << endl
+			  << "vap Loop: "	  << loop	  << endl
+			  << "vap STL: "	  << stl	  << endl
+			  << "vap SIMD: "	  << simd	  << endl
+			  << "vap Parallel: " << parallel << endl << endl;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-	using namespace vap::operators::binary;
-	//using namespace vap::operators::unary;
+	bench::options o;
+	std::string csv  = "vap_benchmark.csv";
+	std::string json = "vap_benchmark.json";
+
+	for (int k = 1; k + 1 < argc; k += 2)
+	{
+		if		(std::strcmp(argv[k], "--warmup")	   == 0) o.warmup	   = std::strtoul(argv[k + 1], nullptr, 10);
+		else if (std::strcmp(argv[k], "--repetitions") == 0) o.repetitions = std::strtoul(argv[k + 1], nullptr, 10);
+		else if (std::strcmp(argv[k], "--csv")		   == 0) csv		   = argv[k + 1];
+		else if (std::strcmp(argv[k], "--json")		   == 0) json		   = argv[k + 1];
+	}
+
+	const std::vector<std::size_t> sizes = bench::default_sizes();
+	const bench::machine roofs = bench::measure_machine();
 
-	typedef double T;
-	typedef vap::vector<T> Vec;
-	const std::size_t N = 3;
+	std::cout << "Roofs: " << roofs.gb_per_second << " GB/s, " << roofs.gflop_per_second << " GFLOP/s" << endl;
+	std::cout << Poisson::name() << ": " << cost<Poisson>() << endl;
+	std::cout << Mixed::name()	 << ": " << cost<Mixed>()	<< endl << endl;
 
-	std::vector<T> x, y;
+	bench::report report;
+	report.compare_with(roofs);
 
-	vap::vector<T, vap::constructors::STL> c_x(N), c_y(N), c_z(N);
-	c_x.assign(N, 3);
-	c_y.assign(N, -1);
-	c_z.assign(N, 4);
+	runTests<Poisson>(sizes, o, report);
+	runTests<Mixed>(sizes, o, report);
 
-	runTests();
-	system("pause");
+	report.table(std::cout);
+	report.save_csv(csv);
+	report.save_json(json);
+
+	std::cout << endl << "Results written to " << csv << " and " << json << endl;
 	return 0;
 }
-
@@ -0,0 +1,465 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/constructors.h>
+#include <vap/detail/traits.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace vap	 {
+namespace memory {
+
+// How a mapped container opens its file
+// read:	an existing file, read-only; writing the elements is undefined behaviour
+// write:	a new file, or an existing one truncated, of the given number of elements
+// update:	an existing file, read-write
+enum class access { read, write, update };
+
+// Access pattern hints for a range of a mapped container (madvise, PrefetchVirtualMemory)
+// sequential: read ahead aggressively
+// willneed:   start reading the range now
+// dontneed:   the range will not be used soon. Its pages are unmapped from the process,
+//			   but stay in the page cache; see mapped::release to evict them.
+enum class advice { normal, sequential, random, willneed, dontneed };
+
+namespace detail {
+
+#if defined(_WIN32)
+using file_handle = HANDLE;
+static const file_handle no_file = INVALID_HANDLE_VALUE;
+#else
+using file_handle = int;
+static const file_handle no_file = -1;
+#endif
+
+[[noreturn]] inline void fail(const char* what)
+{
+#if defined(_WIN32)
+	throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+#else
+	throw std::system_error(errno, std::generic_category(), what);
+#endif
+}
+
+inline file_handle open_file(const std::string& path, const access mode)
+{
+#if defined(_WIN32)
+	const DWORD rights	= mode == access::read ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+	const DWORD create	= mode == access::write ? CREATE_ALWAYS : OPEN_EXISTING;
+	const file_handle f = CreateFileA(path.c_str(), rights, FILE_SHARE_READ, nullptr, create, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+#else
+	const int flags		= mode == access::read ? O_RDONLY : mode == access::write ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR;
+	const file_handle f = ::open(path.c_str(), flags, 0644);
+#endif
+
+	if (f == no_file) fail("vap::memory::mapped: cannot open file");
+	return f;
+}
+
+inline void close_file(const file_handle f)
+{
+#if defined(_WIN32)
+	if (f != no_file) CloseHandle(f);
+#else
+	if (f != no_file) ::close(f);
+#endif
+}
+
+inline std::size_t file_size(const file_handle f)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(f, &size)) fail("vap::memory::mapped: cannot read file size");
+	return static_cast<std::size_t>(size.QuadPart);
+#else
+	struct stat s;
+	if (fstat(f, &s) != 0) fail("vap::memory::mapped: cannot read file size");
+	return static_cast<std::size_t>(s.st_size);
+#endif
+}
+
+inline void set_file_size(const file_handle f, const std::size_t bytes)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	size.QuadPart = static_cast<LONGLONG>(bytes);
+	if (!SetFilePointerEx(f, size, nullptr, FILE_BEGIN) || !SetEndOfFile(f)) fail("vap::memory::mapped: cannot resize file");
+#else
+	if (ftruncate(f, static_cast<off_t>(bytes)) != 0) fail("vap::memory::mapped: cannot resize file");
+#endif
+}
+
+// Maps bytes of the file f, or anonymous memory when f is no_file
+inline void* map(const file_handle f, const std::size_t bytes, const bool writable)
+{
+	if (bytes == 0) return nullptr;
+
+#if defined(_WIN32)
+	if (f == no_file)
+	{
+		void* p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (!p) fail("vap::memory::mapped: cannot allocate memory");
+		return p;
+	}
+
+	const ULARGE_INTEGER size = { { static_cast<DWORD>(static_cast<unsigned long long>(bytes) & 0xFFFFFFFFull),
+									static_cast<DWORD>(static_cast<unsigned long long>(bytes) >> 32) } };
+
+	const HANDLE mapping = CreateFileMappingA(f, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, size.HighPart, size.LowPart, nullptr);
+	if (!mapping) fail("vap::memory::mapped: cannot map file");
+
+	void* p = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, bytes);
+	CloseHandle(mapping);
+
+	if (!p) fail("vap::memory::mapped: cannot map file");
+	return p;
+#else
+	const int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+	const int flags		 = f == no_file ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED;
+
+	void* p = mmap(nullptr, bytes, protection, flags, f, 0);
+	if (p == MAP_FAILED) fail("vap::memory::mapped: cannot map file");
+	return p;
+#endif
+}
+
+inline void unmap(void* p, const std::size_t bytes, const bool anonymous)
+{
+	if (!p) return;
+
+#if defined(_WIN32)
+	(void) bytes;
+	if (anonymous) VirtualFree(p, 0, MEM_RELEASE);
+	else		   UnmapViewOfFile(p);
+#else
+	(void) anonymous;
+	munmap(p, bytes);
+#endif
+}
+
+inline std::size_t page_size()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// Applies a hint to the pages overlapping [p, p + bytes)
+inline void advise(void* p, const std::size_t bytes, const advice hint)
+{
+	if (!p || bytes == 0) return;
+
+	const std::size_t page	= page_size();
+	const std::size_t first = reinterpret_cast<std::size_t>(p) / page * page;
+	const std::size_t last	= reinterpret_cast<std::size_t>(p) + bytes;
+
+#if defined(_WIN32)
+	if (hint != advice::willneed) return;
+
+	WIN32_MEMORY_RANGE_ENTRY range = { reinterpret_cast<void*>(first), last - first };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	const int flags = hint == advice::sequential ? MADV_SEQUENTIAL :
+					  hint == advice::random	 ? MADV_RANDOM	   :
+					  hint == advice::willneed	 ? MADV_WILLNEED   :
+					  hint == advice::dontneed	 ? MADV_DONTNEED   : MADV_NORMAL;
+
+	madvise(reinterpret_cast<void*>(first), last - first, flags);
+#endif
+}
+
+// Starts writing the dirty pages of [p, p + bytes) back to the file
+inline void flush(void* p, const std::size_t bytes, const bool wait)
+{
+	if (!p || bytes == 0) return;
+
+	const std::size_t page	= page_size();
+	const std::size_t first = reinterpret_cast<std::size_t>(p) / page * page;
+	const std::size_t last	= reinterpret_cast<std::size_t>(p) + bytes;
+
+#if defined(_WIN32)
+	(void) wait;
+	FlushViewOfFile(reinterpret_cast<void*>(first), last - first);
+#else
+	msync(reinterpret_cast<void*>(first), last - first, wait ? MS_SYNC : MS_ASYNC);
+#endif
+}
+
+// Evicts the clean pages of [offset, offset + bytes) of the file f from the page cache.
+// Dirty pages are kept, so the range must have been written back with a synchronous flush.
+inline void drop(const file_handle f, const std::size_t offset, const std::size_t bytes)
+{
+#if defined(_WIN32)
+	(void) f; (void) offset; (void) bytes;
+#else
+	if (f != no_file && bytes > 0)
+		posix_fadvise(f, static_cast<off_t>(offset), static_cast<off_t>(bytes), POSIX_FADV_DONTNEED);
+#endif
+}
+
+} // end namespace detail
+
+// Container whose elements live in a memory-mapped file, for data larger than memory.
+// It plugs into the Container parameter of vap::vector:
+//
+//	using M = vap::vector<double, vap::constructors::Streaming<>, vap::memory::mapped<double>>;
+//
+//	const M x(vap::memory::mapped<double>("x.bin", vap::memory::access::read));
+//	const M y(vap::memory::mapped<double>("y.bin", vap::memory::access::read));
+//	M r(vap::memory::mapped<double>("r.bin", vap::memory::access::write, x.size()));
+//	r = x * y + 1.0;
+//
+// Files are mapped with the sequential hint, so the kernel reads ahead. Pages that were
+// read stay in the page cache until memory runs short. constructors::Streaming evaluates
+// chunk by chunk and releases each chunk of a mapped destination before moving on: it is
+// written back synchronously and evicted from the page cache, so the result streams into
+// its file instead of filling the cache. The file holds the raw elements, without a header.
+// Containers that are not bound to a file (default, sized or copied) are anonymous
+// mappings. Assigning to a container bound to a file copies the elements into the file.
+template <typename T>
+class mapped
+{
+	static_assert(std::is_trivially_copyable<T>::value, "vap::memory::mapped: elements must be trivially copyable");
+
+private:
+	T*					elements;
+	std::size_t			count;
+	detail::file_handle file;
+	bool				writable;
+
+	std::size_t bytes() const { return count * sizeof(T); }
+
+	void unmap()
+	{
+		detail::unmap(elements, bytes(), file == detail::no_file);
+		elements = nullptr;
+	}
+
+	void close()
+	{
+		unmap();
+		detail::close_file(file);
+
+		file  = detail::no_file;
+		count = 0;
+	}
+
+	// Anonymous mapping of n elements holding a copy of the first n elements of source
+	void replace(const T* source, const std::size_t source_count, const std::size_t n)
+	{
+		T* copy = static_cast<T*>(detail::map(detail::no_file, n * sizeof(T), true));
+		if (n > 0 && source_count > 0) std::memcpy(copy, source, std::min(n, source_count) * sizeof(T));
+
+		unmap();
+		elements = copy;
+		count	 = n;
+	}
+
+	void copy_from(const mapped& other)
+	{
+		if (file == detail::no_file)
+		{
+			replace(other.elements, other.count, other.count);
+			return;
+		}
+
+		resize(other.count);
+		if (count > 0) std::memcpy(elements, other.elements, bytes());
+	}
+
+public:
+	using value_type	 = T;
+	using size_type		 = std::size_t;
+	using reference		 = T&;
+	using const_reference = const T&;
+	using iterator		 = T*;
+	using const_iterator = const T*;
+
+	mapped() : elements(nullptr), count(0), file(detail::no_file), writable(true) {}
+
+	// n value-initialized elements in anonymous memory
+	explicit mapped(const std::size_t n) : mapped() { replace(nullptr, 0, n); }
+
+	mapped(const std::size_t n, const T& value) : mapped(n) { std::fill(begin(), end(), value); }
+
+	// Maps the file at path. n is the number of elements of a file opened for writing;
+	// files opened for reading or updating keep their size.
+	mapped(const std::string& path, const access mode, const std::size_t n = 0) :
+		elements(nullptr), count(0), file(detail::open_file(path, mode)), writable(mode != access::read)
+	{
+		try
+		{
+			if (mode == access::write) detail::set_file_size(file, n * sizeof(T));
+
+			count	 = detail::file_size(file) / sizeof(T);
+			elements = static_cast<T*>(detail::map(file, bytes(), writable));
+
+			advise(advice::sequential);
+		}
+		catch (...)
+		{
+			close();
+			throw;
+		}
+	}
+
+	mapped(const mapped& other) : mapped() { replace(other.elements, other.count, other.count); }
+
+	mapped(mapped&& other) noexcept :
+		elements(other.elements), count(other.count), file(other.file), writable(other.writable)
+	{
+		other.elements = nullptr;
+		other.count	   = 0;
+		other.file	   = detail::no_file;
+	}
+
+	mapped& operator = (const mapped& other)
+	{
+		if (this != &other) copy_from(other);
+		return *this;
+	}
+
+	mapped& operator = (mapped&& other)
+	{
+		if (this == &other) return *this;
+
+		if (file != detail::no_file)
+		{
+			copy_from(other);
+			return *this;
+		}
+
+		close();
+		std::swap(elements, other.elements);
+		std::swap(count, other.count);
+		std::swap(file, other.file);
+		std::swap(writable, other.writable);
+		return *this;
+	}
+
+	~mapped() { close(); }
+
+	T*		 data()		  { return elements; }
+	const T* data() const { return elements; }
+
+	iterator begin() { return elements; }
+	iterator end()	 { return elements + count; }
+
+	const_iterator begin()	const { return elements; }
+	const_iterator end()	const { return elements + count; }
+	const_iterator cbegin() const { return elements; }
+	const_iterator cend()	const { return elements + count; }
+
+	T&		 operator [] (const std::size_t i)		 { return elements[i]; }
+	const T& operator [] (const std::size_t i) const { return elements[i]; }
+
+	std::size_t size()	const { return count; }
+	bool		empty() const { return count == 0; }
+
+	// Whether the elements are backed by a file
+	bool is_file() const { return file != detail::no_file; }
+
+	void assign(const std::size_t n, const T& value)
+	{
+		resize(n);
+		std::fill(begin(), end(), value);
+	}
+
+	// New elements are value-initialized; a file opened for writing or updating grows or
+	// shrinks with the container
+	void resize(const std::size_t n)
+	{
+		if (n == count) return;
+
+		if (file == detail::no_file)
+		{
+			replace(elements, count, n);
+			return;
+		}
+
+		if (!writable) throw std::logic_error("vap::memory::mapped: cannot resize a read-only file");
+
+		flush(true);
+		unmap();
+
+		detail::set_file_size(file, n * sizeof(T));
+		count	 = n;
+		elements = static_cast<T*>(detail::map(file, bytes(), true));
+
+		advise(advice::sequential);
+	}
+
+	// Applies an access hint to elements [first, last)
+	void advise(const std::size_t first, const std::size_t last, const advice hint)
+	{
+		if (first < last) detail::advise(elements + first, (last - first) * sizeof(T), hint);
+	}
+
+	void advise(const advice hint) { advise(0, count, hint); }
+
+	// Writes elements [first, last) back to the file, waiting for the write to complete
+	// or not
+	void flush(const std::size_t first, const std::size_t last, const bool wait = false)
+	{
+		if (file != detail::no_file && writable && first < last)
+			detail::flush(elements + first, (last - first) * sizeof(T), wait);
+	}
+
+	void flush(const bool wait = true) { flush(0, count, wait); }
+
+	// Writes elements [first, last) back to the file and evicts their pages from the
+	// process and from the page cache (posix_fadvise; only written back on Windows)
+	void release(const std::size_t first, const std::size_t last)
+	{
+		if (file == detail::no_file || first >= last) return;
+
+		flush(first, last, true);
+		advise(first, last, advice::dontneed);
+		detail::drop(file, first * sizeof(T), (last - first) * sizeof(T));
+	}
+};
+
+} // end namespace memory
+
+namespace detail {
+
+template <typename T>
+struct is_contiguous <memory::mapped<T>> : std::true_type {};
+
+// A chunk written into a file is written back to it, and its pages evicted, as soon as
+// it has been evaluated
+template <typename T>
+struct stream_hooks <memory::mapped<T>>
+{
+	static void written(memory::mapped<T>& c, const std::size_t first, const std::size_t last)
+	{
+		c.release(first, last);
+	}
+};
+
+} // end namespace detail
+} // end namespace vap
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/expressions.h>
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vap	   {
+namespace pipeline {
+namespace detail {
+
+using expand = int[];
+
+// Number of chunks in flight: one being read, one being evaluated and one being written
+static const std::size_t depth = 3;
+
+enum class state { empty, loaded, computed };
+
+// The vectors of one chunk. The expression is built on the inputs of the slot and
+// evaluated into its output, so every chunk reuses the same storage.
+template <class V, std::size_t Inputs>
+struct slot
+{
+	std::array<V, Inputs> inputs;
+	V					  output;
+	std::size_t			  count;
+	state				  status;
+
+	slot() : count(0), status(state::empty) {}
+};
+
+template <class V>
+typename V::value_type* data(V& v)
+{
+	return static_cast<vap::detail::container_t<V>&>(v).data();
+}
+
+// Shared by the three stages; a stage that throws stops the others
+class control
+{
+private:
+	std::mutex				mutex;
+	std::condition_variable changed;
+	std::exception_ptr		error;
+	bool					stopped;
+
+public:
+	control() : stopped(false) {}
+
+	// Waits until the slot reaches the given state; returns false if the pipeline stopped
+	template <class Slot>
+	bool wait(Slot& s, const state expected)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&] { return stopped || s.status == expected; });
+		return !stopped;
+	}
+
+	template <class Slot>
+	void set(Slot& s, const state next)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			s.status = next;
+		}
+		changed.notify_all();
+	}
+
+	void fail(std::exception_ptr e)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error) error = e;
+			stopped = true;
+		}
+		changed.notify_all();
+	}
+
+	void rethrow()
+	{
+		if (error) std::rethrow_exception(error);
+	}
+};
+
+template <class Stage>
+void guarded(control& c, Stage&& stage)
+{
+	try
+	{
+		stage();
+	}
+	catch (...)
+	{
+		c.fail(std::current_exception());
+	}
+}
+
+// Reads from source until n elements are read or the source returns 0, as for a
+// socket, which may return fewer elements than it will eventually give
+template <typename T, class Source>
+std::size_t fill(Source& source, T* first, const std::size_t n)
+{
+	std::size_t count = 0;
+
+	while (count < n)
+	{
+		const std::size_t read = source(first + count, n - count);
+		if (read == 0) break;
+
+		count += read;
+	}
+
+	return count;
+}
+
+template <class Slot, class Sources, std::size_t... K>
+std::size_t read(Slot& s, Sources& sources, const std::size_t chunk, std::index_sequence<K...>)
+{
+	(void) expand{ 0, (std::get<K>(s.inputs).resize(chunk), 0)... };
+
+	const std::size_t counts[] = { fill(std::get<K>(sources), data(std::get<K>(s.inputs)), chunk)... };
+	const std::size_t count	   = counts[0];
+
+	if (std::any_of(std::begin(counts), std::end(counts), [count](const std::size_t c) { return c != count; }))
+		throw std::runtime_error("vap::pipeline::run: a source ended before the others");
+
+	(void) expand{ 0, (std::get<K>(s.inputs).resize(count), 0)... };
+
+	return count;
+}
+
+template <class Slot, class Make, std::size_t... K>
+void compute(Slot& s, Make& make, std::index_sequence<K...>)
+{
+	s.output = make(std::get<K>(s.inputs)...);
+}
+
+} // end namespace detail
+
+// Streams data through an expression in chunks of chunk elements. Reading, evaluating
+// and writing run on three threads, each on a different chunk, so that the throughput
+// approaches the slowest of the three instead of their sum:
+//
+//	std::ifstream fx("x.bin", std::ios::binary), fy("y.bin", std::ios::binary);
+//	std::ofstream fr("r.bin", std::ios::binary);
+//
+//	vap::pipeline::run<V>(1 << 16,
+//		[](const V& x, const V& y) { return x * y + 1.0; },
+//		[&](const double* r, std::size_t n) { fr.write((const char*) r, n * sizeof(double)); },
+//		[&](double* x, std::size_t n) { return std::size_t(fx.read((char*) x, n * sizeof(double)).gcount()) / sizeof(double); },
+//		[&](double* y, std::size_t n) { return std::size_t(fy.read((char*) y, n * sizeof(double)).gcount()) / sizeof(double); });
+//
+// Each source fills up to n elements and returns how many it read. Sources are called
+// again until the chunk is full, so they may return fewer elements than asked for, and
+// the stream ends when they return 0. Sources must end together: one that ends before
+// the others stops the pipeline with std::runtime_error. make builds the expression on one
+// vector of type V per source, which holds the current chunk of that source, and the
+// expression is evaluated with the constructor policy of V into a vector whose
+// elements are passed to sink. V must store its elements contiguously.
+// Returns the number of elements written; an exception thrown by a stage stops the
+// pipeline and is rethrown.
+template <class V, class Make, class Sink, class... Sources>
+std::size_t run(const std::size_t chunk, Make make, Sink sink, Sources... sources)
+{
+	static_assert(sizeof...(Sources) > 0, "pipeline::run: at least one source expected");
+
+	using slot	  = detail::slot<V, sizeof...(Sources)>;
+	using indices = std::index_sequence_for<Sources...>;
+
+	std::vector<slot>			  slots(detail::depth);
+	std::tuple<Sources...>		  inputs(std::move(sources)...);
+	detail::control				  control;
+	std::size_t					  written = 0;
+
+	std::thread reader([&] {
+		detail::guarded(control, [&] {
+			for (std::size_t k = 0;; ++k)
+			{
+				slot& s = slots[k % detail::depth];
+				if (!control.wait(s, detail::state::empty)) return;
+
+				s.count = detail::read(s, inputs, chunk, indices());
+				control.set(s, detail::state::loaded);
+
+				if (s.count == 0) return;
+			}
+		});
+	});
+
+	std::thread writer([&] {
+		detail::guarded(control, [&] {
+			for (std::size_t k = 0;; ++k)
+			{
+				slot& s = slots[k % detail::depth];
+				if (!control.wait(s, detail::state::computed)) return;
+				if (s.count == 0) return;
+
+				sink(static_cast<const typename V::value_type*>(detail::data(s.output)), s.count);
+				written += s.count;
+
+				control.set(s, detail::state::empty);
+			}
+		});
+	});
+
+	detail::guarded(control, [&] {
+		for (std::size_t k = 0;; ++k)
+		{
+			slot& s = slots[k % detail::depth];
+			if (!control.wait(s, detail::state::loaded)) return;
+
+			if (s.count > 0) detail::compute(s, make, indices());
+			control.set(s, detail::state::computed);
+
+			if (s.count == 0) return;
+		}
+	});
+
+	reader.join();
+	writer.join();
+
+	control.rethrow();
+	return written;
+}
+
+} // end namespace pipeline
+} // end namespace vap
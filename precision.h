@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/traits.h>
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace vap	 {
+namespace detail {
+
+inline std::uint32_t bits_of(const float f)
+{
+	std::uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+	return x;
+}
+
+inline float float_of(const std::uint32_t x)
+{
+	float f;
+	std::memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+// IEEE binary16, rounded to nearest even
+inline std::uint16_t to_half(const float f)
+{
+	const std::uint32_t x		  = bits_of(f);
+	const std::uint32_t sign	  = (x >> 16) & 0x8000;
+	const std::uint32_t magnitude = x & 0x7fffffff;
+
+	// Infinities, and NaNs kept quiet
+	if (magnitude >= 0x7f800000)
+		return static_cast<std::uint16_t>(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 | ((magnitude >> 13) & 0x3ff) : 0));
+
+	// From half-way between 65504, the largest half, and 65536
+	if (magnitude >= 0x477ff000)
+		return static_cast<std::uint16_t>(sign | 0x7c00);
+
+	// Below 2^-14, multiples of 2^-24: adding 0.5 leaves them in the low bits of the
+	// mantissa, rounded by the FPU
+	if (magnitude < 0x38800000)
+		return static_cast<std::uint16_t>(sign | (bits_of(float_of(magnitude) + 0.5f) - 0x3f000000));
+
+	// Rebias the exponent from 127 to 15 and round the mantissa from 23 to 10 bits
+	const std::uint32_t odd = (magnitude >> 13) & 1;
+	return static_cast<std::uint16_t>(sign | ((magnitude - (112u << 23) + 0xfff + odd) >> 13));
+}
+
+inline float from_half(const std::uint16_t h)
+{
+	const std::uint32_t sign	 = std::uint32_t(h & 0x8000) << 16;
+	const std::uint32_t exponent = (h >> 10) & 0x1f;
+	const std::uint32_t mantissa = h & 0x3ff;
+
+	if (exponent == 0x1f) return float_of(sign | 0x7f800000 | (mantissa << 13));
+	if (exponent != 0)	  return float_of(sign | ((exponent + 112) << 23) | (mantissa << 13));
+
+	// Zeros and subnormals, multiples of 2^-24
+	return float_of(sign | bits_of(mantissa * 5.9604644775390625e-8f));
+}
+
+// The upper half of a float, rounded to nearest even
+inline std::uint16_t to_bfloat16(const float f)
+{
+	const std::uint32_t x = bits_of(f);
+
+	if ((x & 0x7fffffff) > 0x7f800000)
+		return static_cast<std::uint16_t>((x >> 16) | 0x40);
+
+	return static_cast<std::uint16_t>((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+}
+
+inline float from_bfloat16(const std::uint16_t b)
+{
+	return float_of(std::uint32_t(b) << 16);
+}
+
+} // end namespace detail
+
+// Storage types for vectors: 16-bit numbers, converted in software to float when they
+// are read and back when they are written. Expressions compute in float (see
+// detail::compute_type), so vap::vector<vap::half> halves the memory traffic of a
+// float vector at the cost of precision:
+//
+//	vap::vector<vap::half, vap::constructors::SIMD> x(n), y(n);
+//	vap::vector<vap::half, vap::constructors::SIMD> r = x * y + 1;	// float arithmetic
+//
+// half is IEEE binary16: 11 significant bits, up to 65504.
+class half
+{
+private:
+	std::uint16_t value;
+
+public:
+	half() = default;
+	half(const float x) : value(detail::to_half(x)) {}
+
+	operator float() const { return detail::from_half(value); }
+
+	std::uint16_t bits() const { return value; }
+
+	static half from_bits(const std::uint16_t b)
+	{
+		half h;
+		h.value = b;
+		return h;
+	}
+};
+
+// bfloat16 keeps the range of float with 8 significant bits
+class bfloat16
+{
+private:
+	std::uint16_t value;
+
+public:
+	bfloat16() = default;
+	bfloat16(const float x) : value(detail::to_bfloat16(x)) {}
+
+	operator float() const { return detail::from_bfloat16(value); }
+
+	std::uint16_t bits() const { return value; }
+
+	static bfloat16 from_bits(const std::uint16_t b)
+	{
+		bfloat16 h;
+		h.value = b;
+		return h;
+	}
+};
+
+namespace detail {
+
+template <>
+struct compute_type <half>
+{
+	using type = float;
+};
+
+template <>
+struct compute_type <bfloat16>
+{
+	using type = float;
+};
+
+template <> struct is_storage <half>	 : std::true_type {};
+template <> struct is_storage <bfloat16> : std::true_type {};
+
+} // end namespace detail
+} // end namespace vap
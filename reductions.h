@@ -0,0 +1,280 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/traits.h>
+#include <vap/detail/thread_pool.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/rewrite.h>
+#include <vap/execution_policy.h>
+#include <vap/simd/reduce.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace vap		 {
+namespace reductions {
+
+using expressions::rewrite_t;
+
+// Order in which the partial results of a reduction are combined.
+// unordered:	  chunks are combined as the threads finish them. The rounding of
+//				  floating point sums may change from one run to the next.
+// deterministic: the range is cut into blocks of a fixed size that are combined in
+//				  index order, so the result does not depend on the number of threads
+//				  (it may still differ between instruction sets, see VAP_SIMD).
+struct unordered {};
+struct deterministic {};
+
+// Define VAP_DETERMINISTIC_REDUCTIONS to make every reduction deterministic by default
+#ifdef VAP_DETERMINISTIC_REDUCTIONS
+using default_order = deterministic;
+#else
+using default_order = unordered;
+#endif
+
+namespace detail {
+
+// Number of elements per partial result of a deterministic reduction
+static const std::size_t block = 1 << 14;
+
+/*=====================*/
+/* Combining operations */
+/*=====================*/
+template <typename T>
+struct plus
+{
+	static T identity() { return T(0); }
+
+	T operator () (const T& x, const T& y) const { return x + y; }
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const { return x + y; }
+};
+
+// NaN terms are skipped by minimum and maximum (y is the incoming term)
+template <typename T>
+struct minimum
+{
+	static T identity()
+	{ return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(); }
+
+	T operator () (const T& x, const T& y) const { return y < x ? y : x; }
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const { return Packet::min(y, x); }
+};
+
+template <typename T>
+struct maximum
+{
+	static T identity()
+	{ return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(); }
+
+	T operator () (const T& x, const T& y) const { return x < y ? y : x; }
+
+	template <class Packet>
+	simd::enable_if_packet_t<Packet> operator () (const Packet& x, const Packet& y) const { return Packet::max(y, x); }
+};
+
+/*=======================*/
+/* Terms of a reduction */
+/*=======================*/
+// e[i], in the type T the reduction accumulates in
+template <class E, typename T = vap::detail::compute_t<typename E::value_type>>
+struct terms
+{
+	using value_type = T;
+
+	static const bool packet_access = expressions::packs_into<E, T>::value;
+
+	const E& e;
+
+	std::size_t size()					   const { return e.size(); }
+	value_type operator [] (std::size_t i) const { return static_cast<T>(e[i]); }
+
+	template <class Packet>
+	Packet packet(std::size_t i) const { return e.template packet<Packet>(i); }
+};
+
+// e[i] * e[i], evaluating e once per element
+template <class E, typename T = vap::detail::compute_t<typename E::value_type>>
+struct squares
+{
+	using value_type = T;
+
+	static const bool packet_access = expressions::packs_into<E, T>::value;
+
+	const E& e;
+
+	std::size_t size() const { return e.size(); }
+
+	value_type operator [] (std::size_t i) const
+	{
+		const value_type x = static_cast<T>(e[i]);
+		return x * x;
+	}
+
+	template <class Packet>
+	Packet packet(std::size_t i) const
+	{
+		const Packet x = e.template packet<Packet>(i);
+		return x * x;
+	}
+};
+
+// l[i] * r[i], computed in the promoted type of both like l * r
+template <class L, class R, typename T = vap::detail::promote_t<typename L::value_type, typename R::value_type>>
+struct products
+{
+	using value_type = T;
+
+	static const bool packet_access = expressions::packs_into<L, T>::value && expressions::packs_into<R, T>::value;
+
+	const L& l;
+	const R& r;
+
+	std::size_t size()					   const { return l.size(); }
+	value_type operator [] (std::size_t i) const { return static_cast<T>(l[i]) * static_cast<T>(r[i]); }
+
+	template <class Packet>
+	Packet packet(std::size_t i) const { return l.template packet<Packet>(i) * r.template packet<Packet>(i); }
+};
+
+/*=================*/
+/* Execution paths */
+/*=================*/
+template <class Exec>
+using is_parallel = std::is_same<Exec, parallel_execution>;
+
+// Serial and absorbing expressions are reduced on the calling thread
+template <class Op, class Terms>
+typename Terms::value_type run(const Op& op, const Terms& t, unordered, std::false_type)
+{
+	return simd::reduce(op, t, 0, t.size());
+}
+
+template <class Op, class Terms>
+typename Terms::value_type run(const Op& op, const Terms& t, unordered, std::true_type)
+{
+	using T = typename Terms::value_type;
+
+	T		   result = Op::identity();
+	std::mutex mutex;
+
+	vap::detail::parallel_for(0, t.size(), vap::detail::parallel_grain, [&](const std::size_t first, const std::size_t last) {
+		const T partial = simd::reduce(op, t, first, last);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		result = op(result, partial);
+	});
+
+	return result;
+}
+
+// Blocks are reduced independently and their results combined in order, whether the
+// blocks were distributed among the threads or not
+template <class Op, class Terms, class Parallel>
+typename Terms::value_type run(const Op& op, const Terms& t, deterministic, Parallel)
+{
+	using T = typename Terms::value_type;
+
+	const std::size_t n		 = t.size();
+	const std::size_t blocks = (n + block - 1) / block;
+
+	std::vector<T> partials(blocks);
+
+	const auto reduce_blocks = [&](const std::size_t first, const std::size_t last) {
+		for (std::size_t k = first; k < last; ++k)
+			partials[k] = simd::reduce(op, t, k * block, std::min(n, (k + 1) * block));
+	};
+
+	if (Parallel::value) vap::detail::parallel_for(0, blocks, 1, reduce_blocks);
+	else				 reduce_blocks(0, blocks);
+
+	T result = Op::identity();
+	for (const T& partial : partials)
+		result = op(result, partial);
+
+	return result;
+}
+
+template <class Op, class Exec, class Terms, class Order>
+typename Terms::value_type reduce(const Terms& t, Order order)
+{
+	return run(Op(), t, order, is_parallel<Exec>());
+}
+
+} // end namespace detail
+
+// The reductions below consume an expression in a single pass without materializing
+// it. They run on the thread pool when the expression has a parallel_execution policy,
+// on the calling thread otherwise, and use SIMD packets whenever the expression can
+// be evaluated with packets (see simd::evaluate).
+
+// Sum of the elements of e. Sums, dot products and norms accumulate in and return the
+// compute type of the elements (see detail::compute_type), so reducing a vector of
+// half does not round every partial sum to half.
+template <class E, class Order = default_order>
+vap::detail::compute_t<typename E::value_type> sum(const expressions::Expression<E>& e, Order order = Order())
+{
+	using T = vap::detail::compute_t<typename E::value_type>;
+	const auto& r = vap::rewrite(e.derived());
+	return detail::reduce<detail::plus<T>, typename E::exec>(detail::terms<rewrite_t<E>, T>{ r }, order);
+}
+
+// Sum of the products of the elements of lhs and rhs
+template <class L, class R, class Order = default_order>
+vap::detail::promote_t<typename L::value_type, typename R::value_type> dot(const expressions::Expression<L>& lhs, const expressions::Expression<R>& rhs, Order order = Order())
+{
+	static_assert(
+		vap::compatible_execs<typename L::exec, typename R::exec>::value,
+		"dot: Incompatible execution policies selected");
+
+	assert(lhs.size() == rhs.size());
+
+	using T	   = vap::detail::promote_t<typename L::value_type, typename R::value_type>;
+	using Exec = typename vap::get_strongest_exec<typename L::exec, typename R::exec>::type;
+
+	const auto& l = vap::rewrite(lhs.derived());
+	const auto& r = vap::rewrite(rhs.derived());
+	return detail::reduce<detail::plus<T>, Exec>(detail::products<rewrite_t<L>, rewrite_t<R>>{ l, r }, order);
+}
+
+// Euclidean norm of e, without scaling: the sum of squares may overflow for elements
+// larger than the square root of the largest value_type
+template <class E, class Order = default_order>
+auto norm(const expressions::Expression<E>& e, Order order = Order()) -> decltype(std::sqrt(vap::detail::compute_t<typename E::value_type>()))
+{
+	using T = vap::detail::compute_t<typename E::value_type>;
+	const auto& r = vap::rewrite(e.derived());
+	return std::sqrt(detail::reduce<detail::plus<T>, typename E::exec>(detail::squares<rewrite_t<E>>{ r }, order));
+}
+
+// Smallest element of e, ignoring NaNs. Returns infinity (or the largest value) when e is empty.
+// min and max are exact, so they do not take an Order, and compare in the compute type.
+template <class E>
+typename E::value_type min(const expressions::Expression<E>& e)
+{
+	using T = vap::detail::compute_t<typename E::value_type>;
+	const auto& r = vap::rewrite(e.derived());
+	return static_cast<typename E::value_type>(
+		detail::reduce<detail::minimum<T>, typename E::exec>(detail::terms<rewrite_t<E>, T>{ r }, unordered()));
+}
+
+// Largest element of e, ignoring NaNs. Returns -infinity (or the lowest value) when e is empty.
+template <class E>
+typename E::value_type max(const expressions::Expression<E>& e)
+{
+	using T = vap::detail::compute_t<typename E::value_type>;
+	const auto& r = vap::rewrite(e.derived());
+	return static_cast<typename E::value_type>(
+		detail::reduce<detail::maximum<T>, typename E::exec>(detail::terms<rewrite_t<E>, T>{ r }, unordered()));
+}
+
+} // end namespace reductions
+} // end namespace vap
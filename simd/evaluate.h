@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/epoch.h>
+#include <vap/detail/traits.h>
+#include <vap/simd/packet.h>
+
+#include <type_traits>
+
+namespace vap  {
+namespace simd {
+namespace detail {
+
+// Determines whether the expression E can be evaluated with packets of type T into
+// container C: every leaf must be contiguous and C must store T directly.
+template <class C, class E, isa I>
+struct use_packets
+{
+	using value_type = typename E::value_type;
+
+	static const bool value = has_packet<value_type, I>::value &&
+							  vap::expressions::expression_traits<typename E::Derived>::packet_access &&
+							  vap::detail::is_contiguous<C>::value &&
+							  std::is_convertible<value_type, typename C::value_type>::value;
+};
+
+// Element-wise evaluation, also used for the tail of the packet loop
+template <class C, class E>
+void evaluate_scalar(C& c, const E& e, const std::size_t first, const std::size_t last)
+{
+	for (std::size_t i = first; i < last; ++i)
+		c[i] = e[i];
+}
+
+template <isa I, bool Packets>
+struct kernel
+{
+	template <class C, class E>
+	static void run(C& c, const E& e, const std::size_t first, const std::size_t last)
+	{ evaluate_scalar(c, e, first, last); }
+};
+
+// The loop body is shared by every instruction set. It is inlined into the kernels
+// below, which are compiled for their instruction set. Destinations that are not a
+// single container (see fused.h) specialize it along with use_packets.
+template <class C, class E>
+struct packet_loop
+{
+	template <isa I>
+	static void run(C& c, const E& e, const std::size_t first, const std::size_t last)
+	{
+		using Packet = packet<typename E::value_type, I>;
+
+		auto* out = c.data();
+
+		std::size_t i = first;
+		for (; i + Packet::width <= last; i += Packet::width)
+			vap::simd::store(e.template packet<Packet>(i), out + i);
+
+		evaluate_scalar(c, e, i, last);
+	}
+};
+
+#ifdef VAP_SIMD_AVX2
+template <>
+struct kernel <isa::avx2, true>
+{
+	template <class C, class E>
+	VAP_TARGET_AVX2
+	static void run(C& c, const E& e, const std::size_t first, const std::size_t last)
+	{ packet_loop<C, E>::template run<isa::avx2>(c, e, first, last); }
+};
+#endif
+
+#ifdef VAP_SIMD_AVX512
+template <>
+struct kernel <isa::avx512, true>
+{
+	template <class C, class E>
+	VAP_TARGET_AVX512
+	static void run(C& c, const E& e, const std::size_t first, const std::size_t last)
+	{ packet_loop<C, E>::template run<isa::avx512>(c, e, first, last); }
+};
+#endif
+
+} // end namespace detail
+
+// Evaluates e[first, last) into c[first, last) with the widest packets supported by the
+// CPU, followed by an element-wise tail loop. Falls back to element-wise evaluation
+// when the expression or container cannot be vectorized.
+template <class C, class E>
+void evaluate(C& c, const E& e, const std::size_t first, const std::size_t last)
+{
+	// Values cached by shared sub-expressions are not carried over from an earlier call
+	vap::detail::next_epoch();
+
+	switch (active())
+	{
+#	ifdef VAP_SIMD_AVX512
+	case isa::avx512:
+		detail::kernel<isa::avx512, detail::use_packets<C, E, isa::avx512>::value>::run(c, e, first, last);
+		return;
+#	endif
+
+#	ifdef VAP_SIMD_AVX2
+	case isa::avx2:
+		detail::kernel<isa::avx2, detail::use_packets<C, E, isa::avx2>::value>::run(c, e, first, last);
+		return;
+#	endif
+
+	default:
+		detail::evaluate_scalar(c, e, first, last);
+		return;
+	}
+}
+
+} // end namespace simd
+} // end namespace vap
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/simd/packet.h>
+
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// The kernels below pass packets and masks by value. They are only ever inlined into
+// the evaluation loops compiled for the packet's instruction set (packets are disabled
+// in unoptimized builds, see simd/packet.h), so GCC's warning that
+// such values change the ABI outside of those loops does not apply.
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC diagnostic push
+#	pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace vap	   {
+namespace accuracy {
+
+// Accuracy tiers of the transcendental functors when evaluated on packets of doubles.
+// Errors are measured against a correctly rounded result; the element-wise path
+// (Expression::operator[] and the tail of the packet loop) always calls the C library.
+//
+//			  precise							fast
+// sin, cos	  <= 1 ulp							<= 2.5 ulp for |x| < 2^19, NaN beyond
+// tan		  <= 2.5 ulp						<= 4 ulp for |x| < 2^19, NaN beyond
+// log		  <= 1 ulp							<= 1 ulp for normal x > 0, unspecified otherwise
+// pow		  <= 3 ulp							<= 2 + 2 |y log(x)| ulp for normal x > 0, unspecified otherwise
+//
+// The precise tier evaluates the lanes of a packet with the C library whenever one of
+// them lies outside the domain of the polynomial approximations (huge or non-finite
+// arguments, subnormals, negative bases, overflow), so its special values match libm.
+// Packets of floats are always evaluated lane by lane with the C library.
+struct precise {};
+struct fast {};
+
+// Define VAP_FAST_MATH to make the fast tier the default of vap::sin, vap::cos, ...
+#ifdef VAP_FAST_MATH
+using default_tier = fast;
+#else
+using default_tier = precise;
+#endif
+
+} // end namespace accuracy
+
+namespace simd	 {
+namespace detail {
+
+// Polynomial evaluation with Horner's scheme, highest degree first
+template <class P, std::size_t N>
+P polynomial(const P& x, const double (&c)[N])
+{
+	P y = P::broadcast(c[0]);
+
+	for (std::size_t k = 1; k < N; ++k)
+		y = P::fma(y, x, P::broadcast(c[k]));
+
+	return y;
+}
+
+// Same as polynomial, with an implicit leading coefficient of 1
+template <class P, std::size_t N>
+P monic_polynomial(const P& x, const double (&c)[N])
+{
+	P y = x + P::broadcast(c[0]);
+
+	for (std::size_t k = 1; k < N; ++k)
+		y = P::fma(y, x, P::broadcast(c[k]));
+
+	return y;
+}
+
+// Coefficients of the sin and cos kernels from fdlibm (k_sin.c, k_cos.c), and of
+// the log and exp approximations from Cephes (log.c, exp.c)
+struct constants
+{
+	// sin(x) = x + S1 x^3 + x^5 S(x^2)
+	static double sin_leading() { return -1.66666666666666324348E-1; }
+
+	static const double (&sin())[5]
+	{
+		static const double c[5] = {
+			 1.58969099521155010221E-10, -2.50507602534068634195E-8, 2.75573137070700676789E-6,
+			-1.98412698298579493134E-4,	  8.33333333332248946124E-3 };
+		return c;
+	}
+
+	// cos(x) = 1 - x^2 / 2 + x^4 C(x^2)
+	static const double (&cos())[6]
+	{
+		static const double c[6] = {
+			-1.13596475577881948265E-11, 2.08757232129817482790E-9, -2.75573143513906633035E-7,
+			 2.48015872894767294178E-5, -1.38888888888741095749E-3,	 4.16666666666666019037E-2 };
+		return c;
+	}
+
+	static const double (&log_p())[6]
+	{
+		static const double c[6] = {
+			1.01875663804580931796E-4, 4.97494994976747001425E-1, 4.70579119878881725854E0,
+			1.44989225341610930846E1,  1.79368678507819816313E1,  7.70838733755885391666E0 };
+		return c;
+	}
+
+	static const double (&log_q())[5]
+	{
+		static const double c[5] = {
+			1.12873587189167450590E1, 4.52279145837532221105E1, 8.29875266912776603211E1,
+			7.11544750618563894466E1, 2.31251620126765340583E1 };
+		return c;
+	}
+
+	static const double (&exp_p())[3]
+	{
+		static const double c[3] = {
+			1.26177193074810590878E-4, 3.02994407707441961300E-2, 9.99999999999999999910E-1 };
+		return c;
+	}
+
+	static const double (&exp_q())[4]
+	{
+		static const double c[4] = {
+			3.00198505138664455042E-6, 2.52448340349684104192E-3,
+			2.27265548208155028766E-1, 2.00000000000000000009E0 };
+		return c;
+	}
+};
+
+// Largest argument handled by the Cody-Waite reduction below
+const double trig_limit = 524288.0; // 2^19
+
+// Largest |y| for which the precise pow stays on the packet path
+const double pow_limit = 16.0;
+
+// Reduces x to r = hi + lo in [-pi/4, pi/4] with x = q pi/2 + r. pi/2 is split into
+// parts of 33 bits so that the products q * part are exact for |q| < 2^20. The fast
+// tier drops the rounding error of the reduction (lo = 0).
+template <class P>
+P reduce_half_pi(const P& x, P& q, P& lo, const bool extended)
+{
+	q = P::round(x * P::broadcast(6.36619772367581382433E-1));
+
+	// x - q * pio2_1 is exact, q * pio2_2 is exact
+	const P r1	 = P::fma(q, P::broadcast(-1.57079632673412561417E0), x);
+	const P t	 = q * P::broadcast(6.07710050630396597660E-11);
+	const P tail = P::fma(q, P::broadcast(-2.02226624871116645580E-21), q * P::broadcast(-8.47842766036889956997E-32));
+	const P r2	 = r1 - t;
+
+	if (!extended)
+	{
+		lo = P::broadcast(0.0);
+		return r2 + tail;
+	}
+
+	// Rounding error of r1 - t, then renormalize hi + lo
+	const P error = ((r1 - r2) - t) + tail;
+	const P hi	  = r2 + error;
+
+	lo = error - (hi - r2);
+	return hi;
+}
+
+// sin(x + y) and cos(x + y) for |x + y| <= pi/4 and |y| < ulp(x) (fdlibm k_sin.c, k_cos.c)
+template <class P>
+void sincos_kernel(const P& x, const P& y, P& s, P& c)
+{
+	const P one = P::broadcast(1.0);
+	const P z	= x * x;
+	const P v	= z * x;
+	const P hz	= z * P::broadcast(0.5);
+
+	const P rs = polynomial(z, constants::sin());
+	s = x - ((z * (y * P::broadcast(0.5) - v * rs) - y) - v * P::broadcast(constants::sin_leading()));
+
+	// The rounding error of 1 - z / 2 is added back in
+	const P rc = z * polynomial(z, constants::cos());
+	const P w  = one - hz;
+	c = w + (((one - w) - hz) + (z * rc - x * y));
+}
+
+// Quadrant q mod 4 of the reduction, as 0, 1, 2 or 3
+template <class P>
+P quadrant(const P& q)
+{
+	return q - P::broadcast(4.0) * P::floor(q * P::broadcast(0.25));
+}
+
+// a in the odd quadrants, b in the even ones. Masks are raw vector types, so they are
+// kept inside the helper rather than returned from it.
+template <class P>
+P select_odd(const P& quad, const P& a, const P& b)
+{
+	return P::select(P::eq(quad - P::broadcast(2.0) * P::floor(quad * P::broadcast(0.5)), P::broadcast(1.0)), a, b);
+}
+
+template <class P>
+P sin_kernel(const P& x, const bool extended)
+{
+	P q, lo, s, c;
+	const P hi = reduce_half_pi(x, q, lo, extended);
+	sincos_kernel(hi, lo, s, c);
+
+	const P quad = quadrant(q);
+	const P base = select_odd(quad, c, s);
+
+	// Negative in quadrants 2 and 3
+	return P::select(P::le(P::broadcast(2.0), quad), -base, base);
+}
+
+template <class P>
+P cos_kernel(const P& x, const bool extended)
+{
+	P q, lo, s, c;
+	const P hi = reduce_half_pi(x, q, lo, extended);
+	sincos_kernel(hi, lo, s, c);
+
+	const P quad = quadrant(q);
+	const P base = select_odd(quad, s, c);
+
+	// Negative in quadrants 1 and 2
+	return P::select(P::lt(P::abs(quad - P::broadcast(1.5)), P::broadcast(1.0)), -base, base);
+}
+
+template <class P>
+P tan_kernel(const P& x, const bool extended)
+{
+	P q, lo, s, c;
+	const P hi = reduce_half_pi(x, q, lo, extended);
+	sincos_kernel(hi, lo, s, c);
+
+	// tan(r + pi/2) = -cos(r) / sin(r)
+	return select_odd(quadrant(q), -c / s, s / c);
+}
+
+// log(x) = e ln(2) + log(1 + f), as the unevaluated sum hi + lo when extended is set
+template <class P>
+void log_kernel(const P& x, P& hi, P& lo, const bool extended)
+{
+	// ln(2) = C1 - C2, C1 has only 9 significant bits so e * C1 is exact
+	const P C1 = P::broadcast(6.93359375E-1);
+	const P C2 = P::broadcast(2.121944400546905827679E-4);
+
+	P e;
+	const P m = P::frexp(x, e);
+
+	// Keep 1 + f in [sqrt(1/2), sqrt(2))
+	const typename P::mask_type small = P::lt(m, P::broadcast(7.07106781186547524401E-1));
+
+	e = P::select(small, e - P::broadcast(1.0), e);
+	const P f = P::select(small, m + m, m) - P::broadcast(1.0);
+
+	const P z = f * f;
+	const P r = f * (z * polynomial(f, constants::log_p()) / monic_polynomial(f, constants::log_q()));
+
+	if (!extended)
+	{
+		// Cephes: ((r - e C2) - z / 2 + f) + e C1
+		const P y = P::fma(z, P::broadcast(-0.5), P::fma(e, -C2, r));
+		hi = P::fma(e, C1, f + y);
+		lo = P::broadcast(0.0);
+		return;
+	}
+
+	// Same sum carried in double-double: z is split exactly with an fma, and the
+	// large terms f - z_hi / 2 and e C1 are added with error-free transformations
+	const P z_lo  = P::fma(f, f, -z);
+	const P small_terms = P::fma(z_lo, P::broadcast(-0.5), P::fma(e, -C2, r));
+
+	const P half_z = z * P::broadcast(-0.5);
+	const P s1	   = f + half_z;
+	const P e1	   = (f - s1) + half_z;
+
+	const P a  = e * C1;
+	const P s2 = a + s1;
+	const P bb = s2 - a;
+	const P e2 = (a - (s2 - bb)) + (s1 - bb);
+
+	const P tail = e1 + e2 + small_terms;
+
+	hi = s2 + tail;
+	lo = tail - (hi - s2);
+}
+
+// exp(hi + lo) for |hi| < 708
+template <class P>
+P exp_kernel(const P& hi, const P& lo)
+{
+	// ln(2) = C1 + C2, n * C1 is exact
+	const P n = P::round(hi * P::broadcast(1.4426950408889634073599));
+
+	P r = P::fma(n, P::broadcast(-6.93145751953125E-1), hi);
+	r	= P::fma(n, P::broadcast(-1.42860682030941723212E-6), r) + lo;
+
+	// Cephes: exp(r) = 1 + 2 r P(r^2) / (Q(r^2) - r P(r^2))
+	const P rr = r * r;
+	const P p  = r * polynomial(rr, constants::exp_p());
+	const P y  = P::fma(P::broadcast(2.0), p / (polynomial(rr, constants::exp_q()) - p), P::broadcast(1.0));
+
+	return P::ldexp(y, n);
+}
+
+/*=======================*/
+/* Tier implementations */
+/*=======================*/
+// The fast tier skips the range check of the precise one: arguments beyond the
+// reduction are mapped to NaN rather than to a meaningless value
+template <class P>
+P beyond_trig_limit(const P& x, const P& y)
+{
+	return P::select(P::le(P::abs(x), P::broadcast(trig_limit)), y, P::broadcast(std::numeric_limits<double>::quiet_NaN()));
+}
+
+template <class P>
+P sin(const P& x, accuracy::fast, std::true_type) { return beyond_trig_limit(x, sin_kernel(x, false)); }
+
+template <class P>
+P cos(const P& x, accuracy::fast, std::true_type) { return beyond_trig_limit(x, cos_kernel(x, false)); }
+
+template <class P>
+P tan(const P& x, accuracy::fast, std::true_type) { return beyond_trig_limit(x, tan_kernel(x, false)); }
+
+template <class P>
+P log(const P& x, accuracy::fast, std::true_type)
+{
+	P hi, lo;
+	log_kernel(x, hi, lo, false);
+	return hi;
+}
+
+template <class P>
+P pow(const P& x, const P& y, accuracy::fast, std::true_type)
+{
+	P hi, lo;
+	log_kernel(x, hi, lo, false);
+	return exp_kernel(y * hi, P::broadcast(0.0));
+}
+
+template <class P>
+P sin(const P& x, accuracy::precise, std::true_type)
+{
+	if (!P::all(P::le(P::abs(x), P::broadcast(trig_limit))))
+		return map(x, [](const double v) { return std::sin(v); });
+
+	return sin_kernel(x, true);
+}
+
+template <class P>
+P cos(const P& x, accuracy::precise, std::true_type)
+{
+	if (!P::all(P::le(P::abs(x), P::broadcast(trig_limit))))
+		return map(x, [](const double v) { return std::cos(v); });
+
+	return cos_kernel(x, true);
+}
+
+template <class P>
+P tan(const P& x, accuracy::precise, std::true_type)
+{
+	if (!P::all(P::le(P::abs(x), P::broadcast(trig_limit))))
+		return map(x, [](const double v) { return std::tan(v); });
+
+	return tan_kernel(x, true);
+}
+
+// Determines whether every lane of x is a positive normal number
+template <class P>
+bool all_normal(const P& x)
+{
+	return P::all(P::mask_and(P::le(P::broadcast(DBL_MIN), x), P::le(x, P::broadcast(DBL_MAX))));
+}
+
+template <class P>
+P log(const P& x, accuracy::precise, std::true_type)
+{
+	if (!all_normal(x))
+		return map(x, [](const double v) { return std::log(v); });
+
+	P hi, lo;
+	log_kernel(x, hi, lo, false);
+	return hi;
+}
+
+template <class P>
+P pow(const P& x, const P& y, accuracy::precise, std::true_type)
+{
+	const auto fallback = [&x, &y]() {
+		return map(x, y, [](const double a, const double b) { return std::pow(a, b); });
+	};
+
+	// The error of the log kernel is scaled by y, so large exponents are left to the C library
+	if (!all_normal(x) || !P::all(P::le(P::abs(y), P::broadcast(pow_limit))))
+		return fallback();
+
+	// y log(x) in double-double, so that the error of the exponent stays below an ulp
+	P hi, lo;
+	log_kernel(x, hi, lo, true);
+
+	const P product = y * hi;
+	const P error	= P::fma(y, hi, -product) + y * lo;
+
+	// Overflow and underflow are left to the C library
+	if (!P::all(P::lt(P::abs(product), P::broadcast(708.0))))
+		return fallback();
+
+	return exp_kernel(product, error);
+}
+
+// Packets of other types than double are evaluated lane by lane
+template <class P, class Tier>
+P sin(const P& x, Tier, std::false_type)
+{ return map(x, [](const typename P::value_type v) { return std::sin(v); }); }
+
+template <class P, class Tier>
+P cos(const P& x, Tier, std::false_type)
+{ return map(x, [](const typename P::value_type v) { return std::cos(v); }); }
+
+template <class P, class Tier>
+P tan(const P& x, Tier, std::false_type)
+{ return map(x, [](const typename P::value_type v) { return std::tan(v); }); }
+
+template <class P, class Tier>
+P log(const P& x, Tier, std::false_type)
+{ return map(x, [](const typename P::value_type v) { return std::log(v); }); }
+
+template <class P, class Tier>
+P pow(const P& x, const P& y, Tier, std::false_type)
+{ return map(x, y, [](const typename P::value_type a, const typename P::value_type b) { return std::pow(a, b); }); }
+
+template <class P>
+using is_double = std::is_same<typename P::value_type, double>;
+
+} // end namespace detail
+
+// Packet versions of the transcendental functions for the given accuracy tier
+template <class P, class Tier = accuracy::default_tier>
+P sin(const P& x, Tier tier = Tier()) { return detail::sin(x, tier, detail::is_double<P>()); }
+
+template <class P, class Tier = accuracy::default_tier>
+P cos(const P& x, Tier tier = Tier()) { return detail::cos(x, tier, detail::is_double<P>()); }
+
+template <class P, class Tier = accuracy::default_tier>
+P tan(const P& x, Tier tier = Tier()) { return detail::tan(x, tier, detail::is_double<P>()); }
+
+template <class P, class Tier = accuracy::default_tier>
+P log(const P& x, Tier tier = Tier()) { return detail::log(x, tier, detail::is_double<P>()); }
+
+template <class P, class Tier = accuracy::default_tier>
+P pow(const P& x, const P& y, Tier tier = Tier()) { return detail::pow(x, y, tier, detail::is_double<P>()); }
+
+} // end namespace simd
+} // end namespace vap
+
+#if defined(__GNUC__) && !defined(__clang__)
+#	pragma GCC diagnostic pop
+#endif
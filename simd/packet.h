@@ -0,0 +1,498 @@
+#pragma once
+
+#include <vap/config.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#	include <intrin.h>
+#	include <immintrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	include <immintrin.h>
+#endif
+
+// Compile-time availability of the SIMD instruction sets.
+// MSVC accepts every intrinsic regardless of /arch, and GCC/Clang compile the packet
+// types below with per-function target attributes, so both instruction sets are
+// available to the runtime dispatcher on x86. Define VAP_NO_SIMD to disable them.
+// GCC and Clang only inline the expression tree into the kernels when optimizing; in
+// unoptimized builds packets would be passed between functions compiled for different
+// instruction sets, which disagree on how to pass them, so these evaluate element-wise.
+#ifndef VAP_NO_SIMD
+#	if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#		define VAP_SIMD_AVX2
+#		if _MSC_VER >= 1911
+#			define VAP_SIMD_AVX512
+#		endif
+#	elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__OPTIMIZE__)
+#		define VAP_SIMD_AVX2
+#		define VAP_SIMD_AVX512
+#	endif
+#endif
+
+// Marks an evaluation kernel compiled for the given instruction set. flatten inlines
+// the whole expression tree into the kernel so that no packet crosses a call boundary.
+#if defined(__GNUC__)
+#	define VAP_TARGET_AVX2	  __attribute__((target("avx2,fma"), flatten))
+#	define VAP_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma"), flatten))
+#else
+#	define VAP_TARGET_AVX2
+#	define VAP_TARGET_AVX512
+#endif
+
+namespace vap  {
+namespace simd {
+
+// Instruction sets known to the packet evaluator, from narrowest to widest
+enum class isa { scalar = 0, avx2 = 1, avx512 = 2 };
+
+// A packet holds width consecutive elements of type T in a single SIMD register.
+// Only the specializations below exist; everything else is evaluated element-wise.
+template <typename T, isa I>
+struct packet;
+
+template <typename Check>
+struct is_packet : std::false_type {};
+
+template <typename T, isa I>
+struct is_packet <packet<T, I>> : std::true_type {};
+
+// Restricts functor overloads to packet arguments
+template <typename Packet>
+using enable_if_packet_t = std::enable_if_t<is_packet<Packet>::value, Packet>;
+
+// Determines whether packet<T, I> has been defined for this compiler
+template <typename T, isa I>
+struct has_packet : std::false_type {};
+
+namespace detail {
+
+// Applies f to each lane of a packet through memory. Used by functors that have no
+// SIMD implementation so that they still compose with packet evaluation.
+template <class Packet, class Function>
+Packet map(const Packet& x, Function f)
+{
+	using T = typename Packet::value_type;
+
+	T lanes[Packet::width];
+	x.store(lanes);
+
+	for (std::size_t k = 0; k < Packet::width; ++k)
+		lanes[k] = f(lanes[k]);
+
+	return Packet::load(lanes);
+}
+
+template <class Packet, class Function>
+Packet map(const Packet& x, const Packet& y, Function f)
+{
+	using T = typename Packet::value_type;
+
+	T left[Packet::width], right[Packet::width];
+	x.store(left);
+	y.store(right);
+
+	for (std::size_t k = 0; k < Packet::width; ++k)
+		left[k] = f(left[k], right[k]);
+
+	return Packet::load(left);
+}
+
+// Loads and stores of packets from and to elements of another type, such as float
+// elements in a double expression, or the storage types of precision.h. The elements
+// are converted one by one, through memory.
+template <class Packet, typename U>
+Packet load(const U* p, std::false_type)
+{
+	typename Packet::value_type lanes[Packet::width];
+
+	for (std::size_t k = 0; k < Packet::width; ++k)
+		lanes[k] = static_cast<typename Packet::value_type>(p[k]);
+
+	return Packet::load(lanes);
+}
+
+template <class Packet, typename U>
+Packet load(const U* p, std::true_type) { return Packet::load(p); }
+
+template <class Packet, typename U>
+void store(const Packet& x, U* p, std::false_type)
+{
+	typename Packet::value_type lanes[Packet::width];
+	x.store(lanes);
+
+	for (std::size_t k = 0; k < Packet::width; ++k)
+		p[k] = static_cast<U>(lanes[k]);
+}
+
+template <class Packet, typename U>
+void store(const Packet& x, U* p, std::true_type) { x.store(p); }
+
+} // end namespace detail
+
+using detail::map;
+
+// Loads Packet::width elements of any type convertible to the packet's
+template <class Packet, typename U>
+Packet load(const U* p) { return detail::load<Packet>(p, std::is_same<U, typename Packet::value_type>()); }
+
+// Stores a packet into Packet::width elements of any type it converts to
+template <class Packet, typename U>
+void store(const Packet& x, U* p) { detail::store(x, p, std::is_same<U, typename Packet::value_type>()); }
+
+/*==========*/
+/* AVX2/FMA */
+/*==========*/
+#ifdef VAP_SIMD_AVX2
+
+#if defined(__clang__)
+#	pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#	pragma GCC push_options
+#	pragma GCC target("avx2,fma")
+#endif
+
+template <>
+struct packet <double, isa::avx2>
+{
+	using value_type = double;
+	using native	 = __m256d;
+	using mask_type	 = __m256d;
+
+	static const std::size_t width = 4;
+
+	native v;
+
+	packet() {}
+	packet(const native& n) : v(n) {}
+
+	static packet broadcast(const double x)  { return _mm256_set1_pd(x); }
+	static packet load(const double* p)		 { return _mm256_loadu_pd(p); }
+	void store(double* p)			   const { _mm256_storeu_pd(p, v); }
+
+	// Lane-wise arithmetic
+	static packet fma(const packet& a, const packet& b, const packet& c) { return _mm256_fmadd_pd(a.v, b.v, c.v); }
+	static packet min(const packet& a, const packet& b)					 { return _mm256_min_pd(a.v, b.v); }
+	static packet max(const packet& a, const packet& b)					 { return _mm256_max_pd(a.v, b.v); }
+	static packet sqrt(const packet& x)	 { return _mm256_sqrt_pd(x.v); }
+	static packet abs(const packet& x)	 { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x.v); }
+	static packet round(const packet& x) { return _mm256_round_pd(x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	static packet floor(const packet& x) { return _mm256_round_pd(x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+	// Comparisons produce a mask_type; NaN lanes compare false
+	static mask_type lt(const packet& a, const packet& b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ); }
+	static mask_type le(const packet& a, const packet& b) { return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ); }
+	static mask_type eq(const packet& a, const packet& b) { return _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ); }
+
+	static mask_type mask_and(const mask_type& a, const mask_type& b) { return _mm256_and_pd(a, b); }
+	static bool		 any(const mask_type& m) { return _mm256_movemask_pd(m) != 0; }
+	static bool		 all(const mask_type& m) { return _mm256_movemask_pd(m) == 0xF; }
+
+	// Lanes of a where m is set, lanes of b elsewhere
+	static packet select(const mask_type& m, const packet& a, const packet& b) { return _mm256_blendv_pd(b.v, a.v, m); }
+
+	// x = m * 2^e with m in [0.5, 1), for positive normal x
+	static packet frexp(const packet& x, packet& e)
+	{
+		const __m256d magic = _mm256_set1_pd(4503599627370496.0); // 2^52
+		const __m256i bits	= _mm256_castpd_si256(x.v);
+
+		const __m256i exponent = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(magic));
+		e = _mm256_sub_pd(_mm256_castsi256_pd(exponent), _mm256_set1_pd(4503599627370496.0 + 1022.0));
+
+		const __m256i mantissa = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)),
+												 _mm256_set1_epi64x(0x3FE0000000000000LL));
+		return _mm256_castsi256_pd(mantissa);
+	}
+
+	// x * 2^n for integral n, as long as 2^n is a normal number
+	static packet ldexp(const packet& x, const packet& n)
+	{
+		const __m256d biased = _mm256_add_pd(n.v, _mm256_set1_pd(4503599627370496.0 + 1023.0));
+		return _mm256_mul_pd(x.v, _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(biased), 52)));
+	}
+};
+
+inline packet<double, isa::avx2> operator + (const packet<double, isa::avx2>& x, const packet<double, isa::avx2>& y)
+{ return _mm256_add_pd(x.v, y.v); }
+inline packet<double, isa::avx2> operator - (const packet<double, isa::avx2>& x, const packet<double, isa::avx2>& y)
+{ return _mm256_sub_pd(x.v, y.v); }
+inline packet<double, isa::avx2> operator * (const packet<double, isa::avx2>& x, const packet<double, isa::avx2>& y)
+{ return _mm256_mul_pd(x.v, y.v); }
+inline packet<double, isa::avx2> operator / (const packet<double, isa::avx2>& x, const packet<double, isa::avx2>& y)
+{ return _mm256_div_pd(x.v, y.v); }
+inline packet<double, isa::avx2> operator - (const packet<double, isa::avx2>& x)
+{ return _mm256_xor_pd(x.v, _mm256_set1_pd(-0.0)); }
+
+template <>
+struct packet <float, isa::avx2>
+{
+	using value_type = float;
+	using native	 = __m256;
+	using mask_type	 = __m256;
+
+	static const std::size_t width = 8;
+
+	native v;
+
+	packet() {}
+	packet(const native& n) : v(n) {}
+
+	static packet broadcast(const float x)  { return _mm256_set1_ps(x); }
+	static packet load(const float* p)		{ return _mm256_loadu_ps(p); }
+	void store(float* p)			  const { _mm256_storeu_ps(p, v); }
+
+	static packet fma(const packet& a, const packet& b, const packet& c) { return _mm256_fmadd_ps(a.v, b.v, c.v); }
+	static packet min(const packet& a, const packet& b)					 { return _mm256_min_ps(a.v, b.v); }
+	static packet max(const packet& a, const packet& b)					 { return _mm256_max_ps(a.v, b.v); }
+	static packet sqrt(const packet& x)	 { return _mm256_sqrt_ps(x.v); }
+	static packet abs(const packet& x)	 { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x.v); }
+	static packet round(const packet& x) { return _mm256_round_ps(x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	static packet floor(const packet& x) { return _mm256_round_ps(x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+	static mask_type lt(const packet& a, const packet& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+	static mask_type le(const packet& a, const packet& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+	static mask_type eq(const packet& a, const packet& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+
+	static mask_type mask_and(const mask_type& a, const mask_type& b) { return _mm256_and_ps(a, b); }
+	static bool		 any(const mask_type& m) { return _mm256_movemask_ps(m) != 0; }
+	static bool		 all(const mask_type& m) { return _mm256_movemask_ps(m) == 0xFF; }
+
+	static packet select(const mask_type& m, const packet& a, const packet& b) { return _mm256_blendv_ps(b.v, a.v, m); }
+};
+
+inline packet<float, isa::avx2> operator + (const packet<float, isa::avx2>& x, const packet<float, isa::avx2>& y)
+{ return _mm256_add_ps(x.v, y.v); }
+inline packet<float, isa::avx2> operator - (const packet<float, isa::avx2>& x, const packet<float, isa::avx2>& y)
+{ return _mm256_sub_ps(x.v, y.v); }
+inline packet<float, isa::avx2> operator * (const packet<float, isa::avx2>& x, const packet<float, isa::avx2>& y)
+{ return _mm256_mul_ps(x.v, y.v); }
+inline packet<float, isa::avx2> operator / (const packet<float, isa::avx2>& x, const packet<float, isa::avx2>& y)
+{ return _mm256_div_ps(x.v, y.v); }
+inline packet<float, isa::avx2> operator - (const packet<float, isa::avx2>& x)
+{ return _mm256_xor_ps(x.v, _mm256_set1_ps(-0.0f)); }
+
+#if defined(__clang__)
+#	pragma clang attribute pop
+#elif defined(__GNUC__)
+#	pragma GCC pop_options
+#endif
+
+template <> struct has_packet <double, isa::avx2> : std::true_type {};
+template <> struct has_packet <float,  isa::avx2> : std::true_type {};
+
+#endif
+
+/*==========*/
+/* AVX-512F */
+/*==========*/
+#ifdef VAP_SIMD_AVX512
+
+#if defined(__clang__)
+#	pragma clang attribute push (__attribute__((target("avx512f,avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#	pragma GCC push_options
+#	pragma GCC target("avx512f,avx2,fma")
+#endif
+
+template <>
+struct packet <double, isa::avx512>
+{
+	using value_type = double;
+	using native	 = __m512d;
+	using mask_type	 = __mmask8;
+
+	static const std::size_t width = 8;
+
+	native v;
+
+	packet() {}
+	packet(const native& n) : v(n) {}
+
+	static packet broadcast(const double x)  { return _mm512_set1_pd(x); }
+	static packet load(const double* p)		 { return _mm512_loadu_pd(p); }
+	void store(double* p)			   const { _mm512_storeu_pd(p, v); }
+
+	static packet fma(const packet& a, const packet& b, const packet& c) { return _mm512_fmadd_pd(a.v, b.v, c.v); }
+	static packet min(const packet& a, const packet& b)					 { return _mm512_min_pd(a.v, b.v); }
+	static packet max(const packet& a, const packet& b)					 { return _mm512_max_pd(a.v, b.v); }
+	static packet sqrt(const packet& x)	 { return _mm512_sqrt_pd(x.v); }
+	static packet abs(const packet& x)	 { return _mm512_abs_pd(x.v); }
+	static packet round(const packet& x) { return _mm512_roundscale_pd(x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	static packet floor(const packet& x) { return _mm512_roundscale_pd(x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+	static mask_type lt(const packet& a, const packet& b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ); }
+	static mask_type le(const packet& a, const packet& b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LE_OQ); }
+	static mask_type eq(const packet& a, const packet& b) { return _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ); }
+
+	static mask_type mask_and(const mask_type& a, const mask_type& b) { return static_cast<mask_type>(a & b); }
+	static bool		 any(const mask_type& m) { return m != 0; }
+	static bool		 all(const mask_type& m) { return m == 0xFF; }
+
+	static packet select(const mask_type& m, const packet& a, const packet& b) { return _mm512_mask_blend_pd(m, b.v, a.v); }
+
+	static packet frexp(const packet& x, packet& e)
+	{
+		e = _mm512_add_pd(_mm512_getexp_pd(x.v), _mm512_set1_pd(1.0));
+		return _mm512_getmant_pd(x.v, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_src);
+	}
+
+	static packet ldexp(const packet& x, const packet& n) { return _mm512_scalef_pd(x.v, n.v); }
+};
+
+inline packet<double, isa::avx512> operator + (const packet<double, isa::avx512>& x, const packet<double, isa::avx512>& y)
+{ return _mm512_add_pd(x.v, y.v); }
+inline packet<double, isa::avx512> operator - (const packet<double, isa::avx512>& x, const packet<double, isa::avx512>& y)
+{ return _mm512_sub_pd(x.v, y.v); }
+inline packet<double, isa::avx512> operator * (const packet<double, isa::avx512>& x, const packet<double, isa::avx512>& y)
+{ return _mm512_mul_pd(x.v, y.v); }
+inline packet<double, isa::avx512> operator / (const packet<double, isa::avx512>& x, const packet<double, isa::avx512>& y)
+{ return _mm512_div_pd(x.v, y.v); }
+inline packet<double, isa::avx512> operator - (const packet<double, isa::avx512>& x)
+{ return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(x.v), _mm512_set1_epi64(0x8000000000000000LL))); }
+
+template <>
+struct packet <float, isa::avx512>
+{
+	using value_type = float;
+	using native	 = __m512;
+	using mask_type	 = __mmask16;
+
+	static const std::size_t width = 16;
+
+	native v;
+
+	packet() {}
+	packet(const native& n) : v(n) {}
+
+	static packet broadcast(const float x)  { return _mm512_set1_ps(x); }
+	static packet load(const float* p)		{ return _mm512_loadu_ps(p); }
+	void store(float* p)			  const { _mm512_storeu_ps(p, v); }
+
+	static packet fma(const packet& a, const packet& b, const packet& c) { return _mm512_fmadd_ps(a.v, b.v, c.v); }
+	static packet min(const packet& a, const packet& b)					 { return _mm512_min_ps(a.v, b.v); }
+	static packet max(const packet& a, const packet& b)					 { return _mm512_max_ps(a.v, b.v); }
+	static packet sqrt(const packet& x)	 { return _mm512_sqrt_ps(x.v); }
+	static packet abs(const packet& x)	 { return _mm512_abs_ps(x.v); }
+	static packet round(const packet& x) { return _mm512_roundscale_ps(x.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	static packet floor(const packet& x) { return _mm512_roundscale_ps(x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+	static mask_type lt(const packet& a, const packet& b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+	static mask_type le(const packet& a, const packet& b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+	static mask_type eq(const packet& a, const packet& b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ); }
+
+	static mask_type mask_and(const mask_type& a, const mask_type& b) { return static_cast<mask_type>(a & b); }
+	static bool		 any(const mask_type& m) { return m != 0; }
+	static bool		 all(const mask_type& m) { return m == 0xFFFF; }
+
+	static packet select(const mask_type& m, const packet& a, const packet& b) { return _mm512_mask_blend_ps(m, b.v, a.v); }
+};
+
+inline packet<float, isa::avx512> operator + (const packet<float, isa::avx512>& x, const packet<float, isa::avx512>& y)
+{ return _mm512_add_ps(x.v, y.v); }
+inline packet<float, isa::avx512> operator - (const packet<float, isa::avx512>& x, const packet<float, isa::avx512>& y)
+{ return _mm512_sub_ps(x.v, y.v); }
+inline packet<float, isa::avx512> operator * (const packet<float, isa::avx512>& x, const packet<float, isa::avx512>& y)
+{ return _mm512_mul_ps(x.v, y.v); }
+inline packet<float, isa::avx512> operator / (const packet<float, isa::avx512>& x, const packet<float, isa::avx512>& y)
+{ return _mm512_div_ps(x.v, y.v); }
+inline packet<float, isa::avx512> operator - (const packet<float, isa::avx512>& x)
+{ return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(x.v), _mm512_set1_epi32(static_cast<int>(0x80000000)))); }
+
+#if defined(__clang__)
+#	pragma clang attribute pop
+#elif defined(__GNUC__)
+#	pragma GCC pop_options
+#endif
+
+template <> struct has_packet <double, isa::avx512> : std::true_type {};
+template <> struct has_packet <float,  isa::avx512> : std::true_type {};
+
+#endif
+
+/*===================*/
+/* Runtime Detection */
+/*===================*/
+// Widest instruction set supported by both the CPU and the operating system
+inline isa detect()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7) return isa::scalar;
+
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool fma	   = (info[2] & (1 << 12)) != 0;
+	if (!osxsave) return isa::scalar;
+
+	// The OS must save the YMM (and ZMM) state on context switches
+	const unsigned long long xcr0 = _xgetbv(0);
+	const bool ymm = (xcr0 & 0x06) == 0x06;
+	const bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+	__cpuidex(info, 7, 0);
+	const bool avx2	   = (info[1] & (1 << 5))  != 0;
+	const bool avx512f = (info[1] & (1 << 16)) != 0;
+
+	if (avx512f && zmm)		  return isa::avx512;
+	if (avx2 && fma && ymm)   return isa::avx2;
+	return isa::scalar;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f"))								 return isa::avx512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return isa::avx2;
+	return isa::scalar;
+#else
+	return isa::scalar;
+#endif
+}
+
+// Widest instruction set compiled into this binary
+inline isa compiled()
+{
+#if defined(VAP_SIMD_AVX512)
+	return isa::avx512;
+#elif defined(VAP_SIMD_AVX2)
+	return isa::avx2;
+#else
+	return isa::scalar;
+#endif
+}
+
+namespace detail {
+
+inline isa select()
+{
+	isa best = detect() < compiled() ? detect() : compiled();
+
+	// VAP_SIMD=scalar|avx2|avx512 can lower the instruction set, e.g. for benchmarking
+	if (const char* env = std::getenv("VAP_SIMD"))
+	{
+		isa requested = best;
+
+		if		(std::strcmp(env, "scalar") == 0) requested = isa::scalar;
+		else if (std::strcmp(env, "avx2")	== 0) requested = isa::avx2;
+		else if (std::strcmp(env, "avx512") == 0) requested = isa::avx512;
+
+		if (requested < best) best = requested;
+	}
+
+	return best;
+}
+
+} // end namespace detail
+
+// Instruction set used by the evaluator; detected once per process
+inline isa active()
+{
+	static const isa selected = detail::select();
+	return selected;
+}
+
+} // end namespace simd
+} // end namespace vap
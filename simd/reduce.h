@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/epoch.h>
+#include <vap/simd/packet.h>
+
+namespace vap  {
+namespace simd {
+namespace detail {
+
+// Determines whether the terms of a reduction can be evaluated with packets of type T
+template <class Terms, isa I>
+struct reduce_packets
+{
+	static const bool value = has_packet<typename Terms::value_type, I>::value && Terms::packet_access;
+};
+
+// Element-wise reduction, also used for the tail of the packet loop
+template <class Op, class Terms>
+typename Terms::value_type reduce_scalar(const Op& op, const Terms& terms, typename Terms::value_type result,
+										 const std::size_t first, const std::size_t last)
+{
+	for (std::size_t i = first; i < last; ++i)
+		result = op(result, terms[i]);
+
+	return result;
+}
+
+template <isa I, bool Packets>
+struct reduce_kernel
+{
+	template <class Op, class Terms>
+	static typename Terms::value_type run(const Op& op, const Terms& terms, const std::size_t first, const std::size_t last)
+	{ return reduce_scalar(op, terms, Op::identity(), first, last); }
+};
+
+// Four independent accumulators hide the latency of the combining operation. The
+// order of the operations only depends on first and last, so the result of a given
+// range is reproducible for a given instruction set.
+template <isa I, class Op, class Terms>
+typename Terms::value_type reduce_loop(const Op& op, const Terms& terms, const std::size_t first, const std::size_t last)
+{
+	using T		 = typename Terms::value_type;
+	using Packet = packet<T, I>;
+
+	const std::size_t width = Packet::width;
+
+	Packet a0 = Packet::broadcast(Op::identity());
+	Packet a1 = a0, a2 = a0, a3 = a0;
+
+	std::size_t i = first;
+	for (; i + 4 * width <= last; i += 4 * width)
+	{
+		a0 = op(a0, terms.template packet<Packet>(i));
+		a1 = op(a1, terms.template packet<Packet>(i + width));
+		a2 = op(a2, terms.template packet<Packet>(i + 2 * width));
+		a3 = op(a3, terms.template packet<Packet>(i + 3 * width));
+	}
+
+	for (; i + width <= last; i += width)
+		a0 = op(a0, terms.template packet<Packet>(i));
+
+	T lanes[Packet::width];
+	op(op(a0, a1), op(a2, a3)).store(lanes);
+
+	T result = Op::identity();
+	for (std::size_t k = 0; k < width; ++k)
+		result = op(result, lanes[k]);
+
+	return reduce_scalar(op, terms, result, i, last);
+}
+
+#ifdef VAP_SIMD_AVX2
+template <>
+struct reduce_kernel <isa::avx2, true>
+{
+	template <class Op, class Terms>
+	VAP_TARGET_AVX2
+	static typename Terms::value_type run(const Op& op, const Terms& terms, const std::size_t first, const std::size_t last)
+	{ return reduce_loop<isa::avx2>(op, terms, first, last); }
+};
+#endif
+
+#ifdef VAP_SIMD_AVX512
+template <>
+struct reduce_kernel <isa::avx512, true>
+{
+	template <class Op, class Terms>
+	VAP_TARGET_AVX512
+	static typename Terms::value_type run(const Op& op, const Terms& terms, const std::size_t first, const std::size_t last)
+	{ return reduce_loop<isa::avx512>(op, terms, first, last); }
+};
+#endif
+
+} // end namespace detail
+
+// Combines terms[first, last) with op, starting from Op::identity(). Terms provides
+// value_type, packet_access, operator [] and packet<Packet>(i) like an expression.
+template <class Op, class Terms>
+typename Terms::value_type reduce(const Op& op, const Terms& terms, const std::size_t first, const std::size_t last)
+{
+	// Values cached by shared sub-expressions are not carried over from an earlier call
+	vap::detail::next_epoch();
+
+	switch (active())
+	{
+#	ifdef VAP_SIMD_AVX512
+	case isa::avx512:
+		return detail::reduce_kernel<isa::avx512, detail::reduce_packets<Terms, isa::avx512>::value>::run(op, terms, first, last);
+#	endif
+
+#	ifdef VAP_SIMD_AVX2
+	case isa::avx2:
+		return detail::reduce_kernel<isa::avx2, detail::reduce_packets<Terms, isa::avx2>::value>::run(op, terms, first, last);
+#	endif
+
+	default:
+		return detail::reduce_scalar(op, terms, Op::identity(), first, last);
+	}
+}
+
+} // end namespace simd
+} // end namespace vap
@@ -0,0 +1,727 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/alias.h>
+#include <vap/detail/functional.h>
+#include <vap/detail/thread_pool.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/operators.h>
+#include <vap/expressions/rewrite.h>
+#include <vap/iterators/sparse_iterator.h>
+#include <vap/simd/evaluate.h>
+#include <vap/simd/packet.h>
+
+#include <boost/iterator/permutation_iterator.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vap		  {
+namespace expressions {
+
+// Vector of n elements of which only the non-zeros are stored, as sorted indices and
+// their values. It is a leaf of expressions like a vector, and expressions of sparse
+// vectors are evaluated in a time proportional to their number of non-zeros:
+//
+//	vap::sparse_vector<double> s = a * x;			// a sparse: only the non-zeros of a
+//	vap::sparse_vector<double> t = a + 2 * b;		// a, b sparse: merge of the indices
+//	vap::vector<double, ...>   r = a + x;			// dense x: r = x, then the non-zeros of a
+//
+// An expression is sparse when it is zero wherever its sparse leaves are: products with
+// a sparse operand, quotients of a sparse numerator, sums and differences of sparse
+// operands, and negations, sines and tangents of those. Zeros multiplied by infinities
+// or divided by zeros are taken as zeros. Only sparse expressions can be assigned to a
+// sparse_vector. Vectors evaluate the others with the sparse leaves taken as zero, then
+// evaluate the expression again at the indices of the non-zeros (see sparse_evaluation
+// below), so an expression is never evaluated element by element on a sparse leaf.
+template <typename T, class Exec = serial_execution>
+class sparse_vector :
+	public Expression<sparse_vector<T, Exec>>
+{
+public:
+	using typename Expression<sparse_vector>::value_type;
+	using typename Expression<sparse_vector>::iterator;
+	using typename Expression<sparse_vector>::const_iterator;
+	using typename Expression<sparse_vector>::exec;
+
+private:
+	std::size_t				 n;
+	std::vector<std::size_t> nonzero;
+	std::vector<T>			 entries;
+
+	template <class E>
+	void assign_from(const E& e);
+
+	using scalar = Scalar<vap::detail::compute_t<T>>;
+
+public:
+	sparse_vector() : n(0) {}
+
+	explicit sparse_vector(const std::size_t size) : n(size) {}
+
+	// indices must be increasing and smaller than size
+	sparse_vector(const std::size_t size, std::vector<std::size_t> indices, std::vector<T> values) :
+		n(size), nonzero(std::move(indices)), entries(std::move(values))
+	{
+		assert(nonzero.size() == entries.size());
+		assert(std::adjacent_find(nonzero.begin(), nonzero.end(), std::greater_equal<std::size_t>()) == nonzero.end());
+		assert(nonzero.empty() || nonzero.back() < n);
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	sparse_vector(const Expression<E>& e) : n(0)
+	{ assign_from(e.derived()); }
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	sparse_vector& operator = (const Expression<E>& e)
+	{
+		assign_from(e.derived());
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	sparse_vector& operator += (const Expression<E>& e)
+	{
+		assign_from(operators::Sum<sparse_vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	sparse_vector& operator -= (const Expression<E>& e)
+	{
+		assign_from(operators::Difference<sparse_vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	sparse_vector& operator *= (const Expression<E>& e)
+	{
+		assign_from(operators::Product<sparse_vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	sparse_vector& operator *= (const U& u)
+	{
+		assign_from(operators::Product<sparse_vector, scalar>(*this, scalar(static_cast<typename scalar::value_type>(u), n)));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	sparse_vector& operator /= (const Expression<E>& e)
+	{
+		assign_from(operators::Quotient<sparse_vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	sparse_vector& operator /= (const U& u)
+	{
+		assign_from(operators::Quotient<sparse_vector, scalar>(*this, scalar(static_cast<typename scalar::value_type>(u), n)));
+		return *this;
+	}
+
+	// Sets element i, which becomes a non-zero if it was not one
+	void insert(const std::size_t i, const T& value)
+	{
+		assert(i < n);
+
+		const auto at = std::lower_bound(nonzero.begin(), nonzero.end(), i);
+		const auto k  = at - nonzero.begin();
+
+		if (at != nonzero.end() && *at == i)
+		{
+			entries[k] = value;
+			return;
+		}
+
+		nonzero.insert(at, i);
+		entries.insert(entries.begin() + k, value);
+	}
+
+	iterator begin() const { return iterator(nonzero.data(), entries.data(), nonzero.size(), 0); }
+	iterator end()	 const { return iterator(nonzero.data(), entries.data(), nonzero.size(), n); }
+
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend()	const { return end(); }
+
+	std::size_t size()	   const { return n; }
+	std::size_t nonzeros() const { return nonzero.size(); }
+
+	const std::vector<std::size_t>& indices() const { return nonzero; }
+	const std::vector<T>&			values()  const { return entries; }
+
+	// Binary search among the non-zeros
+	T operator [] (const std::size_t i) const
+	{
+		const auto at = std::lower_bound(nonzero.begin(), nonzero.end(), i);
+		return at != nonzero.end() && *at == i ? entries[at - nonzero.begin()] : T(0);
+	}
+};
+
+template <typename T, class Exec>
+struct expression_traits<sparse_vector<T, Exec>>
+{
+	static_assert(
+		vap::detail::is_storage<T>::value,
+		"Sparse Vector Traits: Scalar type must be an arithmetic or storage type");
+
+	static const bool is_operator	= false;
+	static const bool packet_access = false;
+
+	static const std::size_t loads			 = 1;
+	static const std::size_t bytes			 = sizeof(T);
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 0;
+	static const std::size_t depth			 = 0;
+
+	using value_type	 = T;
+	using exec			 = Exec;
+	using iterator		 = iterators::sparse_iterator<T>;
+	using const_iterator = iterators::sparse_iterator<T>;
+};
+
+} // end namespace expressions
+
+using expressions::sparse_vector;
+
+namespace sparse {
+namespace detail {
+
+inline std::vector<std::size_t> unite(const std::vector<std::size_t>& a, const std::vector<std::size_t>& b)
+{
+	std::vector<std::size_t> result;
+	result.reserve(a.size() + b.size());
+	std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+	return result;
+}
+
+inline std::vector<std::size_t> intersect(const std::vector<std::size_t>& a, const std::vector<std::size_t>& b)
+{
+	std::vector<std::size_t> result;
+	result.reserve(std::min(a.size(), b.size()));
+	std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+	return result;
+}
+
+/*========*/
+/* Leaves */
+/*========*/
+// Values at the indices of a pattern, contiguous: the values of a sparse vector there
+template <typename T, class Exec>
+class compact :
+	public expressions::Expression<compact<T, Exec>>
+{
+public:
+	using typename expressions::Expression<compact>::value_type;
+	using typename expressions::Expression<compact>::iterator;
+	using typename expressions::Expression<compact>::const_iterator;
+	using typename expressions::Expression<compact>::exec;
+
+private:
+	const T*	first;
+	std::size_t count;
+
+public:
+	compact(const T* values, const std::size_t n) : first(values), count(n) {}
+
+	iterator begin() const { return first; }
+	iterator end()	 const { return first + count; }
+
+	const_iterator cbegin() const { return first; }
+	const_iterator cend()	const { return first + count; }
+
+	const T*	data() const { return first; }
+	std::size_t size() const { return count; }
+
+	T operator [] (const std::size_t j) const { return first[j]; }
+
+	template <class Packet>
+	Packet packet(const std::size_t j) const { return vap::simd::load<Packet>(first + j); }
+};
+
+// A dense leaf read at the indices of a pattern: element j is leaf[index[j]]
+template <class Leaf, class Exec>
+class indexed :
+	public expressions::Expression<indexed<Leaf, Exec>>
+{
+public:
+	using typename expressions::Expression<indexed>::value_type;
+	using typename expressions::Expression<indexed>::iterator;
+	using typename expressions::Expression<indexed>::const_iterator;
+	using typename expressions::Expression<indexed>::exec;
+
+private:
+	vap::detail::operand_t<Leaf> leaf;
+	const std::size_t*			 index;
+	std::size_t					 count;
+
+public:
+	indexed(const Leaf& l, const std::size_t* i, const std::size_t n) : leaf(l), index(i), count(n) {}
+
+	iterator begin() const { return iterator(leaf.cbegin(), index); }
+	iterator end()	 const { return iterator(leaf.cbegin(), index + count); }
+
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend()	const { return end(); }
+
+	const Leaf&		   operand() const { return leaf; }
+	const std::size_t* indices() const { return index; }
+	std::size_t		   size()	 const { return count; }
+
+	value_type operator [] (const std::size_t j) const { return leaf[index[j]]; }
+
+	// The elements are gathered into the lanes of the packet
+	template <class Packet>
+	Packet packet(const std::size_t j) const
+	{
+		typename Packet::value_type lanes[Packet::width];
+		for (std::size_t k = 0; k < Packet::width; ++k)
+			lanes[k] = static_cast<typename Packet::value_type>(leaf[index[j + k]]);
+
+		return Packet::load(lanes);
+	}
+};
+
+// Values of the sparse leaves of an expression at the indices of a pattern, merged from
+// their non-zeros, for as long as the expression is evaluated there
+struct context
+{
+	const std::vector<std::size_t>&	   pattern;
+	std::vector<std::shared_ptr<void>> buffers;
+
+	explicit context(const std::vector<std::size_t>& p) : pattern(p) {}
+
+	template <typename T, class Exec>
+	const T* align(const sparse_vector<T, Exec>& s)
+	{
+		const auto values = std::make_shared<std::vector<T>>(pattern.size(), T(0));
+		buffers.push_back(values);
+
+		const std::vector<std::size_t>& indices = s.indices();
+
+		std::size_t k = 0;
+		for (std::size_t j = 0; j < pattern.size() && k < indices.size(); ++j)
+		{
+			while (k < indices.size() && indices[k] < pattern[j]) ++k;
+			if (k < indices.size() && indices[k] == pattern[j]) (*values)[j] = s.values()[k];
+		}
+
+		return values->data();
+	}
+};
+
+/*===========*/
+/* Structure */
+/*===========*/
+// Zero-preserving unary operators: f(0) = 0
+template <class Op>
+struct preserves_zero : std::false_type {};
+
+template <typename T>
+struct preserves_zero <vap::negate<T>> : std::true_type {};
+
+template <typename T, class Accuracy>
+struct preserves_zero <vap::sin<T, Accuracy>> : std::true_type {};
+
+template <typename T, class Accuracy>
+struct preserves_zero <vap::tan<T, Accuracy>> : std::true_type {};
+
+// Whether an expression is sparse, and if so the indices where it may be non-zero
+// (pattern); and the indices of the non-zeros of all of its sparse leaves (support).
+// Operator types are handled as the node types they derive from.
+template <class E, bool = std::is_same<E, typename E::Derived>::value>
+struct structure : structure<typename E::Derived> {};
+
+template <class E>
+struct structure <E, true>
+{
+	static const bool sparse = false;
+
+	static std::vector<std::size_t> pattern(const E&) { return {}; }
+	static void support(const E&, std::vector<std::size_t>&) {}
+};
+
+template <typename T, class Exec>
+struct structure <sparse_vector<T, Exec>, true>
+{
+	static const bool sparse = true;
+
+	static std::vector<std::size_t> pattern(const sparse_vector<T, Exec>& s) { return s.indices(); }
+	static void support(const sparse_vector<T, Exec>& s, std::vector<std::size_t>& indices) { indices = unite(indices, s.indices()); }
+};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct structure <expressions::Binary<L, R, Op, Exec, IsOp>, true>
+{
+	using kind = expressions::rewriting::kind;
+
+	static const kind op	 = expressions::rewriting::kind_of<Op>::value;
+	static const bool left	 = structure<L>::sparse;
+	static const bool right	 = structure<R>::sparse;
+	static const bool merged = op == kind::sum || op == kind::difference;
+
+	static const bool sparse = (op == kind::product && (left || right)) || (op == kind::quotient && left) || (merged && left && right);
+
+	static std::vector<std::size_t> pattern(const expressions::Binary<L, R, Op, Exec, IsOp>& e)
+	{
+		if (merged)						  return unite(structure<L>::pattern(e.lhs()), structure<R>::pattern(e.rhs()));
+		if (op == kind::product && right) return left ? intersect(structure<L>::pattern(e.lhs()), structure<R>::pattern(e.rhs())) : structure<R>::pattern(e.rhs());
+		return structure<L>::pattern(e.lhs());
+	}
+
+	static void support(const expressions::Binary<L, R, Op, Exec, IsOp>& e, std::vector<std::size_t>& indices)
+	{
+		structure<L>::support(e.lhs(), indices);
+		structure<R>::support(e.rhs(), indices);
+	}
+};
+
+template <typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct structure <expressions::Ternary<A, B, C, Op, Exec, IsOp>, true>
+{
+	static const bool sparse = false;
+
+	static std::vector<std::size_t> pattern(const expressions::Ternary<A, B, C, Op, Exec, IsOp>&) { return {}; }
+
+	static void support(const expressions::Ternary<A, B, C, Op, Exec, IsOp>& e, std::vector<std::size_t>& indices)
+	{
+		structure<A>::support(e.first(), indices);
+		structure<B>::support(e.second(), indices);
+		structure<C>::support(e.third(), indices);
+	}
+};
+
+template <typename U, class Op, class Exec, bool IsOp>
+struct structure <expressions::Unary<U, Op, Exec, IsOp>, true>
+{
+	static const bool sparse = structure<U>::sparse && preserves_zero<Op>::value;
+
+	static std::vector<std::size_t> pattern(const expressions::Unary<U, Op, Exec, IsOp>& e) { return structure<U>::pattern(e.operand()); }
+
+	static void support(const expressions::Unary<U, Op, Exec, IsOp>& e, std::vector<std::size_t>& indices)
+	{ structure<U>::support(e.operand(), indices); }
+};
+
+/*========*/
+/* Gather */
+/*========*/
+// The expression at the indices of a pattern: element j of the result is element
+// pattern[j] of e. Dense leaves are indexed, sparse leaves aligned to the pattern.
+// Exec is the execution policy of the whole expression.
+template <class E, bool = std::is_same<E, typename E::Derived>::value>
+struct gather : gather<typename E::Derived> {};
+
+template <class E>
+struct gather <E, true>
+{
+	template <class Exec>
+	using type = indexed<E, Exec>;
+
+	template <class Exec>
+	static type<Exec> apply(const E& e, context& c) { return type<Exec>(e, c.pattern.data(), c.pattern.size()); }
+};
+
+template <typename T>
+struct gather <expressions::Scalar<T>, true>
+{
+	template <class Exec>
+	using type = expressions::Scalar<T>;
+
+	template <class Exec>
+	static type<Exec> apply(const expressions::Scalar<T>& s, context& c) { return type<Exec>(s[0], c.pattern.size()); }
+};
+
+template <typename T, long Num, long Den>
+struct gather <expressions::Constant<T, Num, Den>, false>
+{
+	template <class Exec>
+	using type = expressions::Constant<T, Num, Den>;
+
+	template <class Exec>
+	static type<Exec> apply(const expressions::Constant<T, Num, Den>&, context& c) { return type<Exec>(c.pattern.size()); }
+};
+
+template <typename T, class E>
+struct gather <sparse_vector<T, E>, true>
+{
+	template <class Exec>
+	using type = compact<T, Exec>;
+
+	template <class Exec>
+	static type<Exec> apply(const sparse_vector<T, E>& s, context& c) { return type<Exec>(c.align(s), c.pattern.size()); }
+};
+
+template <typename L, typename R, class Op, class E, bool IsOp>
+struct gather <expressions::Binary<L, R, Op, E, IsOp>, true>
+{
+	template <class Exec>
+	using type = expressions::Binary<typename gather<L>::template type<Exec>, typename gather<R>::template type<Exec>, Op, E, IsOp>;
+
+	template <class Exec>
+	static type<Exec> apply(const expressions::Binary<L, R, Op, E, IsOp>& e, context& c)
+	{ return type<Exec>(gather<L>::template apply<Exec>(e.lhs(), c), gather<R>::template apply<Exec>(e.rhs(), c)); }
+};
+
+template <typename A, typename B, typename C, class Op, class E, bool IsOp>
+struct gather <expressions::Ternary<A, B, C, Op, E, IsOp>, true>
+{
+	template <class Exec>
+	using type = expressions::Ternary<typename gather<A>::template type<Exec>, typename gather<B>::template type<Exec>,
+									  typename gather<C>::template type<Exec>, Op, E, IsOp>;
+
+	template <class Exec>
+	static type<Exec> apply(const expressions::Ternary<A, B, C, Op, E, IsOp>& e, context& c)
+	{
+		return type<Exec>(gather<A>::template apply<Exec>(e.first(), c),
+						  gather<B>::template apply<Exec>(e.second(), c),
+						  gather<C>::template apply<Exec>(e.third(), c));
+	}
+};
+
+template <typename U, class Op, class E, bool IsOp>
+struct gather <expressions::Unary<U, Op, E, IsOp>, true>
+{
+	template <class Exec>
+	using type = expressions::Unary<typename gather<U>::template type<Exec>, Op, E, IsOp>;
+
+	template <class Exec>
+	static type<Exec> apply(const expressions::Unary<U, Op, E, IsOp>& e, context& c)
+	{ return type<Exec>(gather<U>::template apply<Exec>(e.operand(), c), e.functor()); }
+};
+
+/*======*/
+/* Zero */
+/*======*/
+// The expression with its sparse leaves taken as the constant zero, which the rewrite
+// pass folds away: x + s becomes x. Other leaves are kept as they are, and the nodes
+// keep the execution policy of the sparse leaves, which constants do not carry.
+template <class E, bool = std::is_same<E, typename E::Derived>::value>
+struct zero : zero<typename E::Derived> {};
+
+template <class E>
+struct zero <E, true>
+{
+	using type = E;
+
+	static const E& apply(const E& e) { return e; }
+};
+
+template <typename T, long Num, long Den>
+struct zero <expressions::Constant<T, Num, Den>, false>
+{
+	using type = expressions::Constant<T, Num, Den>;
+
+	static const type& apply(const type& e) { return e; }
+};
+
+template <typename T, class Exec>
+struct zero <sparse_vector<T, Exec>, true>
+{
+	using type = expressions::Constant<vap::detail::compute_t<T>, 0>;
+
+	static type apply(const sparse_vector<T, Exec>& s) { return type(s.size()); }
+};
+
+template <typename L, typename R, class Op, class Exec, bool IsOp>
+struct zero <expressions::Binary<L, R, Op, Exec, IsOp>, true>
+{
+	using type = expressions::Binary<typename zero<L>::type, typename zero<R>::type, Op, typename expressions::Binary<L, R, Op, Exec, IsOp>::exec, IsOp>;
+
+	static type apply(const expressions::Binary<L, R, Op, Exec, IsOp>& e) { return type(zero<L>::apply(e.lhs()), zero<R>::apply(e.rhs())); }
+};
+
+template <typename A, typename B, typename C, class Op, class Exec, bool IsOp>
+struct zero <expressions::Ternary<A, B, C, Op, Exec, IsOp>, true>
+{
+	using type = expressions::Ternary<typename zero<A>::type, typename zero<B>::type, typename zero<C>::type, Op,
+									 typename expressions::Ternary<A, B, C, Op, Exec, IsOp>::exec, IsOp>;
+
+	static type apply(const expressions::Ternary<A, B, C, Op, Exec, IsOp>& e)
+	{ return type(zero<A>::apply(e.first()), zero<B>::apply(e.second()), zero<C>::apply(e.third())); }
+};
+
+template <typename U, class Op, class Exec, bool IsOp>
+struct zero <expressions::Unary<U, Op, Exec, IsOp>, true>
+{
+	using type = expressions::Unary<typename zero<U>::type, Op, typename expressions::Unary<U, Op, Exec, IsOp>::exec, IsOp>;
+
+	static type apply(const expressions::Unary<U, Op, Exec, IsOp>& e) { return type(zero<U>::apply(e.operand()), e.functor()); }
+};
+
+/*============*/
+/* Evaluation */
+/*============*/
+template <class C, class E>
+void evaluate(C& c, const E& e, parallel_execution)
+{
+	vap::detail::parallel_for(0, e.size(), vap::detail::parallel_grain, [&c, &e](const std::size_t first, const std::size_t last)
+	{
+		vap::simd::evaluate(c, e, first, last);
+	});
+}
+
+template <class C, class E, class Exec>
+void evaluate(C& c, const E& e, Exec)
+{
+	vap::simd::evaluate(c, e, 0, e.size());
+}
+
+// Values of e at the indices of pattern, evaluated with packets
+template <typename T, class E>
+std::vector<T> evaluate_at(const E& e, const std::vector<std::size_t>& pattern)
+{
+	using Exec = typename E::exec;
+
+	context c(pattern);
+	const auto gathered = gather<E>::template apply<Exec>(e, c);
+
+	std::vector<T> values(pattern.size());
+	evaluate(values, vap::rewrite(gathered), Exec());
+	return values;
+}
+
+} // end namespace detail
+} // end namespace sparse
+
+template <typename T, class Exec>
+template <class E>
+void expressions::sparse_vector<T, Exec>::assign_from(const E& e)
+{
+	using structure = sparse::detail::structure<E>;
+
+	static_assert(structure::sparse, "sparse_vector: the expression is not sparse, assign it to a vap::vector");
+
+	std::vector<std::size_t> pattern = structure::pattern(e);
+	std::vector<T>			 values	 = sparse::detail::evaluate_at<T>(e, pattern);
+
+	n		= e.size();
+	nonzero = std::move(pattern);
+	entries = std::move(values);
+}
+
+namespace detail {
+
+// Whether the expression is the vector v itself, evaluated into its own elements c
+template <class E, class V, class C>
+bool is_destination(const E&, const V&, const C&) { return false; }
+
+template <class V, class C>
+bool is_destination(const V& e, const V& v, const C& c) { return &e == &v && &c == &static_cast<const C&>(v); }
+
+// Evaluates e into the container c of the vector v: first in a dense pass with the
+// constructor policy of v and the sparse leaves taken as zero, which gives every element
+// outside of their non-zeros; then at the indices of these non-zeros. The latter are
+// evaluated before the dense pass, which may write operands of e.
+template <class E>
+struct sparse_evaluation
+{
+	template <class V, class C>
+	static void apply(V& v, C& c, const E& e)
+	{
+		std::vector<std::size_t> support;
+		sparse::detail::structure<E>::support(e, support);
+
+		const auto values = sparse::detail::evaluate_at<typename E::value_type>(e, support);
+
+		// x += s leaves x as it is outside of the non-zeros of s
+		const auto& dense = vap::rewrite(sparse::detail::zero<E>::apply(e));
+		if (!is_destination(dense, v, c)) v.assignment(c, dense);
+
+		for (std::size_t j = 0; j < support.size(); ++j)
+			c[support[j]] = values[j];
+	}
+};
+
+// Sparse vectors own their elements, which are never a destination container
+template <typename T, class Exec>
+struct aliasing <expressions::sparse_vector<T, Exec>>
+{
+	template <class C>
+	using may_read = std::false_type;
+
+	template <class C>
+	static alias classify(const C&, const expressions::sparse_vector<T, Exec>&) { return alias::none; }
+};
+
+} // end namespace detail
+
+namespace expressions {
+
+template <typename T, class Exec>
+struct expression_traits<vap::sparse::detail::compact<T, Exec>>
+{
+	static const bool is_operator	= false;
+	static const bool packet_access = true;
+
+	static const std::size_t loads			 = 1;
+	static const std::size_t bytes			 = sizeof(T);
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 0;
+	static const std::size_t depth			 = 0;
+
+	using value_type	 = T;
+	using exec			 = Exec;
+	using iterator		 = const T*;
+	using const_iterator = const T*;
+};
+
+template <class Leaf, class Exec>
+struct expression_traits<vap::sparse::detail::indexed<Leaf, Exec>>
+{
+	static const bool is_operator	= false;
+	static const bool packet_access = true;
+
+	static const std::size_t loads			 = 1;
+	static const std::size_t bytes			 = expression_traits<typename Leaf::Derived>::bytes + sizeof(std::size_t);
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 0;
+	static const std::size_t depth			 = 0;
+
+	using value_type	 = typename Leaf::value_type;
+	using exec			 = Exec;
+	using iterator		 = boost::permutation_iterator<typename Leaf::const_iterator, const std::size_t*>;
+	using const_iterator = iterator;
+};
+
+namespace rewriting {
+
+template <typename T, class Exec>
+struct equality <sparse_vector<T, Exec>>
+{
+	static bool apply(const sparse_vector<T, Exec>& a, const sparse_vector<T, Exec>& b) { return &a == &b; }
+};
+
+template <typename T, class Exec>
+struct equality <vap::sparse::detail::compact<T, Exec>>
+{
+	static bool apply(const vap::sparse::detail::compact<T, Exec>& a, const vap::sparse::detail::compact<T, Exec>& b)
+	{ return a.data() == b.data(); }
+};
+
+template <class Leaf, class Exec>
+struct equality <vap::sparse::detail::indexed<Leaf, Exec>>
+{
+	static bool apply(const vap::sparse::detail::indexed<Leaf, Exec>& a, const vap::sparse::detail::indexed<Leaf, Exec>& b)
+	{ return a.indices() == b.indices() && equal(a.operand(), b.operand()); }
+};
+
+} // end namespace rewriting
+} // end namespace expressions
+} // end namespace vap
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/detail/alias.h>
+#include <vap/detail/cache.h>
+#include <vap/detail/thread_pool.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/cost.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/rewrite.h>
+#include <vap/execution_policy.h>
+#include <vap/simd/evaluate.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <initializer_list>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace vap	{
+namespace tiled {
+
+// An assignment destination = expression, to be evaluated as part of a batch. The
+// expression holds its operands as expression nodes do: vectors by reference.
+template <class V, class E>
+struct statement
+{
+	V&						  destination;
+	vap::detail::operand_t<E> expression;
+};
+
+template <class V, class E>
+statement<V, E> assign(V& destination, const expressions::Expression<E>& e)
+{
+	return statement<V, E>{ destination, e.derived() };
+}
+
+namespace detail {
+
+using expand = int[];
+
+// Tiles are a multiple of this many elements, so that they start on a cache line and
+// hold whole packets
+static const std::size_t alignment = 64;
+
+// Bytes of memory touched per element by a statement: its loads and its store
+template <class E>
+struct footprint : std::integral_constant<std::size_t, expressions::static_cost<E>().bytes> {};
+
+inline std::size_t environment_tile()
+{
+	if (const char* env = std::getenv("VAP_TILE"))
+	{
+		const long n = std::atol(env);
+		if (n > 0) return static_cast<std::size_t>(n);
+	}
+
+	return 0;
+}
+
+inline std::atomic<std::size_t>& tile_setting()
+{
+	static std::atomic<std::size_t> tile(environment_tile());
+	return tile;
+}
+
+inline std::size_t round(const std::size_t elements)
+{
+	return std::max(alignment, elements / alignment * alignment);
+}
+
+} // end namespace detail
+
+// Number of elements per tile. 0, the default, picks the tile size of each batch so that
+// its working set fills half of the L2 cache (see detail/cache.h); VAP_TILE sets it
+// from the environment.
+inline std::size_t tile_size()							 { return detail::tile_setting().load(std::memory_order_relaxed); }
+inline void		   set_tile_size(const std::size_t elements) { detail::tile_setting().store(elements, std::memory_order_relaxed); }
+
+// Tile size for a batch whose statements touch the given number of bytes per element
+inline std::size_t tile_size(std::initializer_list<std::size_t> footprints)
+{
+	if (const std::size_t tile = tile_size()) return detail::round(tile);
+
+	std::size_t bytes = 0;
+	for (const std::size_t b : footprints)
+		bytes += b;
+
+	return detail::round(vap::detail::caches().l2 / 2 / std::max<std::size_t>(bytes, 1));
+}
+
+namespace detail {
+
+template <class V>
+void resize(V& v, const std::size_t n)
+{
+	if (v.size() < n) v.resize(n);
+}
+
+// Statement k may read any destination at the index being written, which holds the
+// value of the statements before k, but no other element of a destination
+template <class D, class... Vs, class... Es, std::size_t... K>
+bool conflicts(const D& destination, const std::tuple<const statement<Vs, Es>&...>& s, std::index_sequence<K...>)
+{
+	bool result = false;
+	(void) expand{ 0, (result = result || vap::detail::classify(destination, std::get<K>(s).expression) == vap::detail::alias::partial, 0)... };
+	return result;
+}
+
+template <class... Vs, class... Es, std::size_t... K>
+void evaluate(const std::tuple<const statement<Vs, Es>&...>& s, std::index_sequence<K...> indices)
+{
+	using exec = typename vap::get_exec<Es...>::type;
+
+	(void) expand{ 0, (resize(std::get<K>(s).destination, std::get<K>(s).expression.size()), 0)... };
+
+	bool sequential = false;
+	(void) expand{ 0, (sequential = sequential ||
+		conflicts(static_cast<const vap::detail::container_t<Vs>&>(std::get<K>(s).destination), s, indices), 0)... };
+
+	if (sequential)
+	{
+		(void) expand{ 0, (std::get<K>(s).destination = std::get<K>(s).expression, 0)... };
+		return;
+	}
+
+	const std::size_t n = std::get<0>(s).expression.size();
+	for (const std::size_t size : { std::get<K>(s).expression.size()... })
+		assert(size == n), (void) size;
+
+	const std::size_t tile = tiled::tile_size({ footprint<Es>::value... });
+
+	const std::tuple<vap::detail::operand_t<expressions::rewrite_t<Es>>...> rewritten(vap::rewrite(std::get<K>(s).expression)...);
+
+	const auto tiles = [&](const std::size_t first, const std::size_t last) {
+		for (std::size_t begin = first; begin < last; begin += tile)
+		{
+			const std::size_t end = std::min(last, begin + tile);
+
+			(void) expand{ 0, (vap::simd::evaluate(static_cast<vap::detail::container_t<Vs>&>(std::get<K>(s).destination),
+												   std::get<K>(rewritten), begin, end), 0)... };
+		}
+	};
+
+	if (std::is_same<exec, parallel_execution>::value) vap::detail::parallel_for(0, n, std::max(vap::detail::parallel_grain, tile), tiles);
+	else											   tiles(0, n);
+}
+
+} // end namespace detail
+
+// Evaluates a batch of dependent assignments tile by tile: every statement is evaluated
+// on the first tile, then on the second, and so on, so that the destinations written by
+// a statement are still in cache when the following statements read them:
+//
+//	vap::tiled::evaluate(vap::tiled::assign(t, a * b),
+//						 vap::tiled::assign(u, t + sin(c)),
+//						 vap::tiled::assign(v, u * t));
+//
+// The result is that of the assignments in order. The expressions must all have the same
+// size, so the destinations read by later statements must already have it (the others
+// are resized).
+// Tiles are distributed over the thread pool when a statement has a parallel_execution
+// policy. A statement that reads elements of a destination other than the one being
+// written, e.g. through a shifted view, makes the whole batch fall back to evaluating
+// the statements one after the other with operator =.
+template <class... Vs, class... Es>
+void evaluate(const statement<Vs, Es>&... statements)
+{
+	static_assert(sizeof...(Es) > 0, "tiled::evaluate: at least one statement expected");
+
+	detail::evaluate(std::forward_as_tuple(statements...), std::index_sequence_for<Es...>());
+}
+
+} // end namespace tiled
+} // end namespace vap
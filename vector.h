@@ -1,18 +1,24 @@
 #pragma once
 
-#include <vap\config.h>
-#include <vap\detail\traits.h>
-#include <vap\detail\constructors.h>
-#include <vap\expressions\operators.h>
-#include <vap\execution_policy.h>
+#include <vap/config.h>
+#include <vap/detail/alias.h>
+#include <vap/detail/traits.h>
+#include <vap/detail/constructors.h>
+#include <vap/detail/first_touch.h>
+#include <vap/expressions/cost.h>
+#include <vap/expressions/operators.h>
+#include <vap/expressions/rewrite.h>
+#include <vap/simd/packet.h>
+#include <vap/execution_policy.h>
 
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <utility>
 
 #ifdef VAP_USING_THRUST
-#include <thrust\copy.h>
-#include <thrust\execution_policy.h>
+#include <thrust/copy.h>
+#include <thrust/execution_policy.h>
 #endif
 
 namespace vap		  {
@@ -31,9 +37,51 @@ class vector :
 	public  expressions::Expression<vap::expressions::vector<T, Constructor, Container, Execution_Policy>>,
 	private Constructor
 {
+public:
+	using typename expressions::Expression<vector>::value_type;
+	using typename expressions::Expression<vector>::iterator;
+	using typename expressions::Expression<vector>::const_iterator;
+	using typename expressions::Expression<vector>::exec;
+
 protected:
 	Container elements;
 
+	// Evaluates e into the elements, in place unless e reads elements of this vector
+	// other than the one being written (see detail::alias)
+	template <class E>
+	void assign_from(const E& e)
+	{
+		if (vap::detail::classify(elements, e) == vap::detail::alias::partial)
+		{
+			Container temporary(e.size());
+			evaluate(temporary, e, vap::detail::has_sparse<typename E::Derived>());
+			elements = std::move(temporary);
+			return;
+		}
+
+		if (elements.size() < e.size()) resize(e.size());
+		evaluate(elements, e, vap::detail::has_sparse<typename E::Derived>());
+	}
+
+	template <class E>
+	void evaluate(Container& c, const E& e, std::false_type) { assignment(c, vap::rewrite(e)); }
+
+	// Expressions with sparse leaves are evaluated with the leaves taken as zero, then
+	// at the indices of their non-zeros only (see sparse.h)
+	template <class E>
+	void evaluate(Container& c, const E& e, std::true_type) { vap::detail::sparse_evaluation<E>::apply(*this, c, e); }
+
+	// Containers whose elements are left uninitialized (detail/first_touch.h) are filled
+	// in parallel, in the chunks of the parallel evaluations
+	void initialize(std::false_type) {}
+	void initialize(std::true_type)	 { vap::detail::parallel_fill(elements, 0, elements.size(), T()); }
+
+	void assign(const std::size_t count, const T& element, std::false_type) { elements.assign(count, element); }
+	void assign(const std::size_t count, const T& element, std::true_type)	{ vap::detail::touch_assign(elements, count, element); }
+
+	void resize(const std::size_t size, std::false_type) { elements.resize(size); }
+	void resize(const std::size_t size, std::true_type)	 { vap::detail::touch_resize(elements, size, T()); }
+
 public:
 	// Empty functor
 	void update(const std::size_t&) {}
@@ -49,31 +97,103 @@ public:
 	T operator [] (const std::size_t i)				  { return elements[i]; }
 	std::size_t size()							const { return elements.size(); }
 
-	void assign(const std::size_t count, const T& element)  { elements.assign(count, element); }
-	void resize(const std::size_t size)						{ elements.resize(size); }
+	// Unaligned load of Packet::width elements, see expression_traits::packet_access.
+	// Elements of another type than the packet's are converted.
+	template <class Packet>
+	Packet packet(const std::size_t i) const { return vap::simd::load<Packet>(&elements[i]); }
+
+	void assign(const std::size_t count, const T& element)  { assign(count, element, vap::detail::first_touch<Container>()); }
+	void resize(const std::size_t size)						{ resize(size, vap::detail::first_touch<Container>()); }
 
 	// CTOR policy details
 	using Constructor::ctor;
 	using Constructor::assignment;
 
 	vector() {}
-	vector(const std::size_t n) : elements(n) {}
+	vector(const std::size_t n) : elements(n) { initialize(vap::detail::first_touch<Container>()); }
 	vector(const Container& c)  : elements(c) {}
 
 	explicit vector(Container&& c) : elements(std::move(c)) {}
 
-	// The actual evaluation is done here in the constructor for vector
+	// The actual evaluation is done here in the constructor for vector, after the
+	// expression has been simplified by expressions/rewrite.h
 	template <typename E,
 			  typename = std::enable_if_t<vap::is_expression<E>::value>>
 	vector(const expressions::Expression<E>& e) : elements(e.size())
-	{ ctor(elements, e); }
+	{ evaluate(elements, e.derived(), vap::detail::has_sparse<E>()); }
 
 	template <typename E,
 			  typename = std::enable_if_t<vap::is_expression<E>::value>>
 	vector& operator = (const expressions::Expression<E>& e)
 	{ 
-		if (elements.size() < e.size()) elements.resize(e.size());
-		assignment(elements, e); 
+		assign_from(e.derived());
+		return *this;
+	}
+
+	// Compound assignments update the elements in place in a single pass. Numbers are
+	// broadcast without being stored, as in x + u (see detail::broadcast).
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	vector& operator += (const expressions::Expression<E>& e)
+	{
+		assign_from(operators::Sum<vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	vector& operator += (const U& u)
+	{
+		assign_from(operators::Sum<vector, vap::detail::broadcast_t<U, vector>>(*this, vap::detail::broadcast_t<U, vector>(u, size())));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	vector& operator -= (const expressions::Expression<E>& e)
+	{
+		assign_from(operators::Difference<vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	vector& operator -= (const U& u)
+	{
+		assign_from(operators::Difference<vector, vap::detail::broadcast_t<U, vector>>(*this, vap::detail::broadcast_t<U, vector>(u, size())));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	vector& operator *= (const expressions::Expression<E>& e)
+	{
+		assign_from(operators::Product<vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	vector& operator *= (const U& u)
+	{
+		assign_from(operators::Product<vector, vap::detail::broadcast_t<U, vector>>(*this, vap::detail::broadcast_t<U, vector>(u, size())));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	vector& operator /= (const expressions::Expression<E>& e)
+	{
+		assign_from(operators::Quotient<vector, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	vector& operator /= (const U& u)
+	{
+		assign_from(operators::Quotient<vector, vap::detail::broadcast_t<U, vector>>(*this, vap::detail::broadcast_t<U, vector>(u, size())));
+		return *this;
 	}
 
 	operator	   Container&()		  { return this->elements; }
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <vap/config.h>
+#include <vap/vector.h>
+#include <vap/detail/alias.h>
+#include <vap/detail/constructors.h>
+#include <vap/detail/traits.h>
+#include <vap/expressions/expressions.h>
+#include <vap/expressions/operators.h>
+#include <vap/expressions/rewrite.h>
+#include <vap/iterators/strided_iterator.h>
+#include <vap/simd/evaluate.h>
+#include <vap/simd/packet.h>
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace vap		  {
+namespace expressions {
+
+// Non-owning view of count elements stride apart, starting at first: a sub-range, every
+// other element, a column of interleaved data. It is a leaf of expressions like a vector,
+// and assigning it an expression writes the viewed elements in place:
+//
+//	vap::slice(u, 1, n - 2) = 0.5 * (vap::slice(u, 0, n - 2) + vap::slice(u, 2, n - 2));
+//	vap::slice(xyz, 0, n, 3) *= 2;		// the x component of interleaved points
+//
+// Copying a view copies the reference, but assigning a view to another one copies the
+// elements, as for std::slice_array. A view of const T is read-only. Assignments are
+// evaluated with packets, on the thread pool when Exec is parallel_execution, and go
+// through a temporary when the expression reads the viewed elements at other indices.
+template <typename T, class Exec = serial_execution>
+class view :
+	public	Expression<view<T, Exec>>,
+	private std::conditional_t<std::is_same<Exec, parallel_execution>::value, constructors::Parallel, constructors::SIMD>
+{
+public:
+	using typename Expression<view>::value_type;
+	using typename Expression<view>::iterator;
+	using typename Expression<view>::const_iterator;
+	using typename Expression<view>::exec;
+
+private:
+	using Constructor = std::conditional_t<std::is_same<Exec, parallel_execution>::value, constructors::Parallel, constructors::SIMD>;
+
+	T*			   first;
+	std::size_t	   count;
+	std::ptrdiff_t step;
+
+	template <class E>
+	void assign_from(const E& e)
+	{
+		assert(e.size() == count);
+
+		if (vap::detail::classify(*this, e) == vap::detail::alias::partial)
+		{
+			std::vector<value_type> temporary(count);
+			Constructor::ctor(temporary, vap::rewrite(e));
+
+			for (std::size_t i = 0; i < count; ++i)
+				(*this)[i] = temporary[i];
+
+			return;
+		}
+
+		Constructor::assignment(*this, vap::rewrite(e));
+	}
+
+public:
+	using element_type = T;
+
+	view(T* data, const std::size_t n, const std::ptrdiff_t stride = 1) : first(data), count(n), step(stride) {}
+
+	view(const view&) = default;
+
+	view& operator = (const view& other)
+	{
+		assign_from(other);
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	view& operator = (const Expression<E>& e)
+	{
+		assign_from(e.derived());
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	view& operator = (const U& u)
+	{
+		assign_from(vap::detail::broadcast_t<U, view>(u, count));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	view& operator += (const Expression<E>& e)
+	{
+		assign_from(operators::Sum<view, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	view& operator += (const U& u)
+	{
+		assign_from(operators::Sum<view, vap::detail::broadcast_t<U, view>>(*this, vap::detail::broadcast_t<U, view>(u, count)));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	view& operator -= (const Expression<E>& e)
+	{
+		assign_from(operators::Difference<view, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	view& operator -= (const U& u)
+	{
+		assign_from(operators::Difference<view, vap::detail::broadcast_t<U, view>>(*this, vap::detail::broadcast_t<U, view>(u, count)));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	view& operator *= (const Expression<E>& e)
+	{
+		assign_from(operators::Product<view, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	view& operator *= (const U& u)
+	{
+		assign_from(operators::Product<view, vap::detail::broadcast_t<U, view>>(*this, vap::detail::broadcast_t<U, view>(u, count)));
+		return *this;
+	}
+
+	template <typename E,
+			  typename = std::enable_if_t<vap::is_expression<E>::value>>
+	view& operator /= (const Expression<E>& e)
+	{
+		assign_from(operators::Quotient<view, E>(*this, e.derived()));
+		return *this;
+	}
+
+	template <typename U,
+			  typename = std::enable_if_t<std::is_arithmetic<U>::value>>
+	view& operator /= (const U& u)
+	{
+		assign_from(operators::Quotient<view, vap::detail::broadcast_t<U, view>>(*this, vap::detail::broadcast_t<U, view>(u, count)));
+		return *this;
+	}
+
+	iterator begin() const { return iterator(first, step, 0); }
+	iterator end()	 const { return iterator(first, step, std::ptrdiff_t(count)); }
+
+	const_iterator cbegin() const { return const_iterator(first, step, 0); }
+	const_iterator cend()	const { return const_iterator(first, step, std::ptrdiff_t(count)); }
+
+	T*			   data()	const { return first; }
+	std::size_t	   size()	const { return count; }
+	std::ptrdiff_t stride() const { return step; }
+
+	// Views are shallow, so the elements stay writable through a const view
+	T& operator [] (const std::size_t i) const { return first[std::ptrdiff_t(i) * step]; }
+
+	// Contiguous views load packets like vectors; other strides gather the elements
+	template <class Packet>
+	Packet packet(const std::size_t i) const
+	{
+		if (step == 1) return vap::simd::load<Packet>(first + i);
+
+		typename Packet::value_type lanes[Packet::width];
+		for (std::size_t k = 0; k < Packet::width; ++k)
+			lanes[k] = static_cast<typename Packet::value_type>((*this)[i + k]);
+
+		return Packet::load(lanes);
+	}
+};
+
+template <typename T, class Exec>
+struct expression_traits<view<T, Exec>>
+{
+	static_assert(
+		vap::detail::is_storage<std::remove_const_t<T>>::value,
+		"View Traits: Scalar type must be an arithmetic or storage type");
+
+	static const bool is_operator	= false;
+	static const bool packet_access = true;
+
+	static const std::size_t loads			 = 1;
+	static const std::size_t bytes			 = sizeof(T);
+	static const std::size_t flops			 = 0;
+	static const std::size_t transcendentals = 0;
+	static const std::size_t depth			 = 0;
+
+	using value_type	 = std::remove_const_t<T>;
+	using exec			 = Exec;
+	using iterator		 = iterators::strided_iterator<T>;
+	using const_iterator = iterators::strided_iterator<const T>;
+};
+
+namespace rewriting {
+
+// Views are equal when they are the same elements, for the common sub-expression pass
+template <typename T, class Exec>
+struct equality <view<T, Exec>>
+{
+	static bool apply(const view<T, Exec>& a, const view<T, Exec>& b)
+	{ return a.data() == b.data() && a.size() == b.size() && a.stride() == b.stride(); }
+};
+
+} // end namespace rewriting
+} // end namespace expressions
+
+using expressions::view;
+
+// View of count elements of v stride apart, from element offset
+template <typename T, class Ctor, typename C, class Exec>
+view<T, Exec> slice(vector<T, Ctor, C, Exec>& v, const std::size_t offset, const std::size_t count, const std::ptrdiff_t stride = 1)
+{
+	static_assert(detail::is_contiguous<C>::value, "slice: vectors of contiguous containers expected");
+	assert(count == 0 || (offset + (count - 1) * stride < v.size()));
+
+	return view<T, Exec>(static_cast<C&>(v).data() + offset, count, stride);
+}
+
+template <typename T, class Ctor, typename C, class Exec>
+view<const T, Exec> slice(const vector<T, Ctor, C, Exec>& v, const std::size_t offset, const std::size_t count, const std::ptrdiff_t stride = 1)
+{
+	static_assert(detail::is_contiguous<C>::value, "slice: vectors of contiguous containers expected");
+	assert(count == 0 || (offset + (count - 1) * stride < v.size()));
+
+	return view<const T, Exec>(static_cast<const C&>(v).data() + offset, count, stride);
+}
+
+namespace detail {
+
+// A view reads the elements of a destination when their addresses overlap
+template <typename T, class Exec>
+struct aliasing <expressions::view<T, Exec>>
+{
+	template <class C>
+	using may_read = std::integral_constant<bool, is_view<C>::value || is_contiguous<C>::value>;
+
+	template <class C>
+	static alias classify(const C& destination, const expressions::view<T, Exec>& leaf)
+	{ return overlap(extent_of(destination), extent_of(leaf)); }
+};
+
+} // end namespace detail
+
+namespace simd	 {
+namespace detail {
+
+template <typename T, class Exec, class E, isa I>
+struct use_packets <expressions::view<T, Exec>, E, I>
+{
+	static const bool value = has_packet<typename E::value_type, I>::value &&
+							  vap::expressions::expression_traits<typename E::Derived>::packet_access &&
+							  std::is_convertible<typename E::value_type, T>::value;
+};
+
+// Packets are stored directly into contiguous views and scattered into the others
+template <typename T, class Exec, class E>
+struct packet_loop <expressions::view<T, Exec>, E>
+{
+	template <isa I>
+	static void run(expressions::view<T, Exec>& c, const E& e, const std::size_t first, const std::size_t last)
+	{
+		using Packet = packet<typename E::value_type, I>;
+
+		std::size_t i = first;
+		if (c.stride() == 1)
+		{
+			for (; i + Packet::width <= last; i += Packet::width)
+				vap::simd::store(e.template packet<Packet>(i), c.data() + i);
+		}
+		else
+		{
+			typename Packet::value_type lanes[Packet::width];
+
+			for (; i + Packet::width <= last; i += Packet::width)
+			{
+				e.template packet<Packet>(i).store(lanes);
+
+				for (std::size_t k = 0; k < Packet::width; ++k)
+					c[i + k] = static_cast<T>(lanes[k]);
+			}
+		}
+
+		evaluate_scalar(c, e, i, last);
+	}
+};
+
+} // end namespace detail
+} // end namespace simd
+} // end namespace vap